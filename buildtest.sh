@@ -30,6 +30,11 @@ do
 			else
 				../build/printipi --do-tests
 			fi
+			#exercise the rpi platform's DMA scheduling against its software-emulated peripherals
+			if [[ "$machine" == machines/rpi/* ]] ; then
+				make CXX=$compiler MACHINE=$machine $target EMULATE_RPI=1 ENABLE_TESTS=1 -j2
+				../build/printipi --do-tests "[hardwarescheduler]"
+			fi
 		done
 	done
 done
@@ -0,0 +1,63 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_BENCHMARK_H
+#define COMMON_BENCHMARK_H
+
+#include <chrono>
+#include <string>
+
+#include "platforms/auto/chronoclock.h" //for EventClockT
+#include "common/logging.h"
+
+/*
+ * Helpers for the microbenchmarks, which are the test cases tagged [.][benchmark].
+ * They're hidden by default; run them with `printipi --do-tests [benchmark]`.
+ *
+ * A benchmark usually times two implementations of the same computation, each of which returns a checksum of its output.
+ * The checksums keep the compiler from discarding the work, and the benchmark REQUIREs that the two implementations agree on them.
+ */
+namespace benchmark {
+
+struct Timing {
+    float ns; //nanoseconds per item (e.g. per step)
+    double checksum;
+};
+
+//Run @fn, which processes @numItems items and returns a checksum of its output.
+template <typename Fn> Timing measure(long numItems, Fn fn) {
+    auto start = EventClockT::now();
+    double checksum = fn();
+    auto elapsed = EventClockT::now() - start;
+    Timing timing = { std::chrono::duration<float, std::nano>(elapsed).count() / numItems, checksum };
+    return timing;
+}
+
+//Log the timings of two implementations, e.g. "StepTournament, 4 axes: linear scan 3.1 ns/step, tournament 1.2 ns/step (checksums 1.5, 1.5)"
+inline void logComparison(const std::string &name, const char *item, const char *nameA, const Timing &a, const char *nameB, const Timing &b) {
+    LOG("%s: %s %f ns/%s, %s %f ns/%s (checksums %f, %f)\n", name.c_str(), nameA, a.ns, item, nameB, b.ns, item, a.checksum, b.checksum);
+}
+
+}
+
+#endif
@@ -0,0 +1,54 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_PERFCOUNTER_H
+#define COMMON_PERFCOUNTER_H
+
+#include <cstdint> //for uint64_t
+
+/* 
+ * PerfCounter counts hardware events (e.g. L1 data cache misses) of the calling thread with the Linux perf_event interface, for use in benchmarks.
+ * The counter may be unavailable (e.g. inside a VM, on a kernel built without perf events, or if /proc/sys/kernel/perf_event_paranoid forbids it),
+ *   in which case isAvailable() is false and every count is 0.
+ */
+class PerfCounter {
+    int _fd;
+    public:
+        enum Event {
+            L1D_READ_MISSES,
+            L1D_READ_ACCESSES,
+            INSTRUCTIONS
+        };
+        PerfCounter(Event event);
+        ~PerfCounter();
+        PerfCounter(const PerfCounter &) = delete;
+        PerfCounter& operator=(const PerfCounter &) = delete;
+        inline bool isAvailable() const { return _fd >= 0; }
+        //reset the count to 0 and begin counting
+        void start();
+        //stop counting.
+        //@return the number of events since start()
+        uint64_t stop();
+};
+
+#endif
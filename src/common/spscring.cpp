@@ -0,0 +1,70 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "spscring.h"
+#include "catch.hpp"
+#include <thread>
+
+TEST_CASE("SpscRing is a FIFO of fixed capacity", "[spscring]") {
+    SpscRing<int, 3> ring;
+    REQUIRE(ring.empty());
+    REQUIRE(ring.push(1));
+    REQUIRE(ring.push(2));
+    REQUIRE(ring.push(3));
+    REQUIRE(ring.full());
+    REQUIRE(!ring.push(4));
+    REQUIRE(ring.front() == 1);
+    ring.pop();
+    //wrap around the end of the underlying storage
+    REQUIRE(ring.push(4));
+    for (int expected=2; expected<=4; ++expected) {
+        REQUIRE(!ring.empty());
+        REQUIRE(ring.front() == expected);
+        ring.pop();
+    }
+    REQUIRE(ring.empty());
+}
+
+TEST_CASE("SpscRing passes every element between threads in order", "[spscring]") {
+    SpscRing<int, 16> ring;
+    const int numItems = 200000;
+    std::thread producer([&]() {
+        for (int i=0; i<numItems; ) {
+            if (ring.push(i)) {
+                ++i;
+            }
+        }
+    });
+    //Catch isn't thread-safe, so count any errors & only REQUIRE once the producer has been joined.
+    int numOutOfOrder = 0;
+    for (int expected=0; expected<numItems; ) {
+        if (!ring.empty()) {
+            numOutOfOrder += ring.front() != expected;
+            ring.pop();
+            ++expected;
+        }
+    }
+    producer.join();
+    REQUIRE(numOutOfOrder == 0);
+    REQUIRE(ring.empty());
+}
@@ -0,0 +1,87 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_SPSCRING_H
+#define COMMON_SPSCRING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef> //for std::size_t
+
+
+/* 
+ * SpscRing is a fixed-capacity, lock-free FIFO that may be shared between exactly one producer thread and one consumer thread.
+ * The producer may only call full() and push(); the consumer may only call empty(), front() and pop().
+ * Each side only ever writes its own index, so no locks are needed; the acquire/release pairs ensure that an element's contents
+ *   are visible to the consumer before it can observe the element, and that the producer can't overwrite an element until the consumer is done with it.
+ *
+ * @T type of element to store. Should be cheap to copy.
+ * @Capacity maximum number of elements that can be held at once.
+ */
+template <typename T, std::size_t Capacity> class SpscRing {
+    //one slot is always left empty, so that head == tail unambiguously means the ring is empty
+    static constexpr std::size_t NumSlots = Capacity+1;
+    std::array<T, NumSlots> _slots;
+    //index of the oldest element. Only written by the consumer
+    std::atomic<std::size_t> _head;
+    //index at which the next element will be pushed. Only written by the producer
+    std::atomic<std::size_t> _tail;
+
+    static std::size_t nextIndex(std::size_t idx) {
+        return idx+1 == NumSlots ? 0 : idx+1;
+    }
+    public:
+        SpscRing() : _slots(), _head(0), _tail(0) {}
+        static constexpr std::size_t capacity() {
+            return Capacity;
+        }
+        //consumer side
+        bool empty() const {
+            return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+        }
+        //producer side
+        bool full() const {
+            return nextIndex(_tail.load(std::memory_order_relaxed)) == _head.load(std::memory_order_acquire);
+        }
+        //producer side. Returns false (and doesn't modify the ring) if the ring is full.
+        bool push(const T &item) {
+            std::size_t tail = _tail.load(std::memory_order_relaxed);
+            std::size_t next = nextIndex(tail);
+            if (next == _head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            _slots[tail] = item;
+            _tail.store(next, std::memory_order_release);
+            return true;
+        }
+        //consumer side. It is illegal to call this if the ring is empty.
+        const T& front() const {
+            return _slots[_head.load(std::memory_order_relaxed)];
+        }
+        //consumer side. It is illegal to call this if the ring is empty.
+        void pop() {
+            _head.store(nextIndex(_head.load(std::memory_order_relaxed)), std::memory_order_release);
+        }
+};
+
+#endif
@@ -34,6 +34,23 @@
     #define MAX_RPI_PIN_ID 31
 #endif
 
+//Number of steps that each AxisStepper computes at a time (see motion/axisstepper.h).
+//Larger batches amortize more per-call overhead, but waste more work at the end of each move.
+#ifndef AXIS_STEPPER_BATCH_SIZE
+    #define AXIS_STEPPER_BATCH_SIZE 8
+#endif
+
+//Size of an L1 data cache line, used to align data that's accessed on every step.
+//The Raspberry Pi 2/3 (Cortex-A7/A53) use 64-byte lines; the original Pi (ARM1176) uses 32-byte lines, so 64 works for both.
+#ifndef CACHE_LINE_SIZE
+    #define CACHE_LINE_SIZE 64
+#endif
+
+//Number of OutputEvents that the step-generation thread may compute ahead of the scheduler (only used if USE_STEP_THREAD).
+#ifndef STEP_THREAD_RING_SIZE
+    #define STEP_THREAD_RING_SIZE 1024
+#endif
+
 //allow for generation of code that still works in high-latency enviroments, like valgrind
 #ifdef DRUNNING_IN_VM
     #define RUNNING_IN_VM 1
@@ -51,6 +68,42 @@
 	#define USE_PTHREAD 0
 #endif
 
+//explicit SIMD (NEON/SSE) isn't required, but speeds up some of the step-time solvers where the target supports it
+#ifdef DUSE_SIMD
+	#define USE_SIMD 1
+#else
+	#define USE_SIMD 0
+#endif
+
+//refine the acceleration profile's square roots from the previous step, rather than computing them directly (see motion/constantacceleration.h)
+//  Only ConstantAcceleration does this, and it's slower than sqrt on x86 (see the Makefile).
+#ifdef DUSE_INCREMENTAL_ACCEL
+	#define USE_INCREMENTAL_ACCEL 1
+#else
+	#define USE_INCREMENTAL_ACCEL 0
+#endif
+
+//optionally generate steps on a dedicated thread (see State::_stepThreadLoop), to isolate step timing from g-code parsing, etc.
+#ifdef DUSE_STEP_THREAD
+	#define USE_STEP_THREAD 1
+#else
+	#define USE_STEP_THREAD 0
+#endif
+
+//generate the steps of lines on cartesian (LinearCoordMap) machines with an integer DDA & ramp table, rather than solving each axis' step times in float (see motion/cartesiandda.h)
+#ifdef DUSE_CARTESIAN_DDA
+	#define USE_CARTESIAN_DDA 1
+#else
+	#define USE_CARTESIAN_DDA 0
+#endif
+
+//emulate the Raspberry Pi's peripherals (DMA, PWM pacing, GPIO, system timer) in software, so that the rpi platform can be tested & benchmarked on any Linux machine
+#ifdef DEMULATE_RPI
+	#define EMULATE_RPI 1
+#else
+	#define EMULATE_RPI 0
+#endif
+
 #ifdef DNO_LOGGING
     #define DO_LOG 0
 #else
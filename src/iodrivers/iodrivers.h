@@ -27,6 +27,8 @@
 
 #include <tuple>
 
+#include "nexteventheap.h"
+
 namespace iodrv {
 
 /*
@@ -36,10 +38,15 @@ namespace iodrv {
  */ 
 template <typename TupleT> class IODrivers {
 	TupleT drivers;
+	//The next event of each IODriver, so that peekNextEvent needn't query every driver.
+	//A driver's next event may only change when it consumes an event or has its servo angle changed (through an iterator),
+	//  at which point just that driver's entry is refreshed. The heap is filled on the first call to peekNextEvent.
+	NextEventHeap<std::tuple_size<TupleT>::value> nextEvents;
+	bool isNextEventsFilled;
 	public:
 		//@ioDrivers std::tuple of IODrivers to construct from (will be moved).
 		//  Eg IODrivers(std::make_tuple(Fan(), A4988(), Endstop()))
-		IODrivers(TupleT &&ioDrivers) : drivers(std::move(ioDrivers)) {}
+		IODrivers(TupleT &&ioDrivers) : drivers(std::move(ioDrivers)), isNextEventsFilled(false) {}
 		//@return a reference to the underlying tuple of IODrivers
 		TupleT& tuple() {
 			return drivers;
@@ -189,26 +196,26 @@ template <typename TupleT> class IODrivers {
         //But it does not implement operator++;
         //  this is expected to be implemented by the derived types which may do filtering.
 		class iteratorbase {
-            TupleT *_tuple;
+            IODrivers *_owner;
         	protected:
             	std::size_t idx;
             	bool isAtEnd() const {
             		return idx == std::tuple_size<TupleT>::value;
             	}
                 TupleT& tuple() {
-                    return *_tuple;
+                    return _owner->drivers;
                 }
                 const TupleT& tuple() const {
-                    return *_tuple;
+                    return _owner->drivers;
                 }
             public:
-                iteratorbase(TupleT &tuple, std::size_t idx=0) : _tuple(&tuple), idx(idx) {
+                iteratorbase(IODrivers &owner, std::size_t idx=0) : _owner(&owner), idx(idx) {
                 }
                 iteratorbase& operator*() {
                     return *this;
                 }
                 friend bool operator==(const iteratorbase &a, const iteratorbase &b) {
-                    return a.idx == b.idx && a._tuple == b._tuple;
+                    return a.idx == b.idx && a._owner == b._owner;
                 }
                 friend bool operator!=(const iteratorbase &a, const iteratorbase &b) {
                     return !(a == b);
@@ -251,12 +258,14 @@ template <typename TupleT> class IODrivers {
                 }
                 void setServoAngleDegrees(float angle) {
                     tupleCallOnIndex(tuple(), GenericSetServoAngleDegrees(), idx, angle);
+                    _owner->refreshNextEvent(idx);
                 }
                 OutputEvent peekNextEvent() const {
                     return tupleCallOnIndex(tuple(), GenericPeekNextEvent(), idx);
                 }
                 void consumeNextEvent() {
                     tupleCallOnIndex(tuple(), GenericConsumeNextEvent(), idx);
+                    _owner->refreshNextEvent(idx);
                 }
                 bool onIdleCpu(OnIdleCpuIntervalT interval) {
                     return tupleCallOnIndex(tuple(), GenericOnIdleCpu(), idx, interval);
@@ -268,7 +277,7 @@ template <typename TupleT> class IODrivers {
     	//  Note that the Predicate function cannot easily store state info, as it may be instantiated for each item.
         template <typename Predicate=NoPredicate> class iterator : public iteratorbase {
         	public:
-        		iterator(TupleT &drivers, std::size_t idx=0, bool filterFirst=true)
+        		iterator(IODrivers &drivers, std::size_t idx=0, bool filterFirst=true)
         		 : iteratorbase(drivers, idx) {
         		 	if (filterFirst && !Predicate()(*this)) {
         		 		++(*this);
@@ -301,9 +310,9 @@ template <typename TupleT> class IODrivers {
     	//Allow one to build a filter before iterating.
     	//Also supports indexing and convenience functions that operate on the whole set.
     	template <typename Predicate=NoPredicate> class iterinfo {
-    		TupleT &drivers;
+    		IODrivers &drivers;
 	    	public:
-	    		iterinfo(TupleT &drivers) : drivers(drivers) {}
+	    		iterinfo(IODrivers &drivers) : drivers(drivers) {}
 	    		iterator<Predicate> begin() {
 	    			return iterator<Predicate>(drivers);
 	    		}
@@ -379,7 +388,7 @@ template <typename TupleT> class IODrivers {
 
     	//return an iterable/indexable object containing ALL the iodrivers
     	iterinfo<> iter() {
-    		return iterinfo<>(drivers);
+    		return iterinfo<>(*this);
     	}
     	//begin iterator for the set of all IODrivers
         iterator<> begin() {
@@ -401,7 +410,7 @@ template <typename TupleT> class IODrivers {
         //@return an iterable <iterinfo> object based on the Predicate
         template <typename Predicate> iterinfo<Predicate> filter(const Predicate &p) {
         	(void)p; //unused
-        	return iterinfo<Predicate>(drivers);
+        	return iterinfo<Predicate>(*this);
     	}
     	//@return an iterable <iterinfo> object that contains only the fan IODrivers
     	iterinfo<GenericIsFan> fans() {
@@ -451,12 +460,22 @@ template <typename TupleT> class IODrivers {
 		bool onIdleCpu(OnIdleCpuIntervalT interval) {
 			return iter().any(GenericOnIdleCpu(), NO_SHORT_CIRCUIT, interval);
 		}
+        //@return the earliest upcoming event of any IODriver, and an iterator to the IODriver it belongs to (or end() & a null event if there are none).
         std::pair<iteratorbase, OutputEvent> peekNextEvent() {
-            return iter().reduce([](std::pair<iteratorbase, OutputEvent> &&reduced, iteratorbase &d) {
-                OutputEvent curEvt = d.peekNextEvent();
-                bool isCurEvtSooner = reduced.second.isNull() || (!curEvt.isNull() && curEvt.time() < reduced.second.time());
-                return isCurEvtSooner ? std::make_pair(d, curEvt) : reduced;
-            }, std::pair<iteratorbase, OutputEvent>(iter().end(), OutputEvent()));
+            if (!isNextEventsFilled) {
+                for (std::size_t idx=0; idx < std::tuple_size<TupleT>::value; ++idx) {
+                    nextEvents.update(idx, tupleCallOnIndex(drivers, GenericPeekNextEvent(), idx));
+                }
+                isNextEventsFilled = true;
+            }
+            OutputEvent evt = nextEvents.topEvent();
+            return std::make_pair(iteratorbase(*this, evt.isNull() ? std::tuple_size<TupleT>::value : nextEvents.topIndex()), evt);
+        }
+    private:
+        void refreshNextEvent(std::size_t idx) {
+            if (isNextEventsFilled) {
+                nextEvents.update(idx, tupleCallOnIndex(drivers, GenericPeekNextEvent(), idx));
+            }
         }
 };
 
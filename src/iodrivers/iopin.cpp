@@ -113,6 +113,12 @@ void IoPin::makePwmOutput(float duty, EventClockT::duration desiredPeriod) {
     #endif
     _pin.makePwmOutput(translateDutyCycleToPrimitive(duty), desiredPeriod);
 }
+void IoPin::makePulseOutput(EventClockT::duration onTime, EventClockT::duration period) {
+    #ifndef NDEBUG
+        _currentMode = IOPIN_MODE_PWM;
+    #endif
+    _pin.makePulseOutput(onTime, period, translateWriteToPrimitive(IoHigh));
+}
 IoLevel IoPin::digitalRead() const {
     #ifndef NDEBUG
         assert(_currentMode == IOPIN_MODE_INPUT);
@@ -134,6 +140,13 @@ void IoPin::pwmWrite(float duty, EventClockT::duration desiredPeriod) {
     //relay the call to the real pin, performing any inversions necessary
     _pin.pwmWrite(translateDutyCycleToPrimitive(duty), desiredPeriod);
 }
+void IoPin::pulseWrite(EventClockT::duration onTime, EventClockT::duration period) {
+    #ifndef NDEBUG
+        assert(_currentMode == IOPIN_MODE_PWM);
+    #endif
+    //relay the call to the real pin, performing any inversions necessary
+    _pin.pulseWrite(onTime, period, translateWriteToPrimitive(IoHigh));
+}
 
 void IoPin::setToDefault() {
     //set the pin to a "safe" default state:
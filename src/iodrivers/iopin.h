@@ -125,6 +125,9 @@ class IoPin {
         //set the pin as a pwm output & give it the desired duty / period.
         //Doing these two actions together allow us to prevent the pin from ever being in an undefined state.
         void makePwmOutput(float duty, EventClockT::duration desiredPeriod=EventClockT::duration(0));
+        //set the pin to repeatedly output an ACTIVE pulse of length onTime, once every period, with the timing handled by the platform (e.g. by DMA).
+        //Note: the platform may round the period to something it can output seamlessly.
+        void makePulseOutput(EventClockT::duration onTime, EventClockT::duration period);
         //Configure the pin as an input
         void makeDigitalInput();
         //Read a binary logic level from the pin. MUST first call makeDigitalInput() to put the pin in input mode.
@@ -135,6 +138,8 @@ class IoPin {
         //@duty proportion of time that the pin should be ACTIVE (0.0 - 1.0).
         //@desiredPeriod *desired* PWM cycle length (the actual length isn't guaranteed). Useful for decreasing fet/relay switching frequency, etc. 
         void pwmWrite(float duty, EventClockT::duration desiredPeriod=EventClockT::duration(0));
+        //Change the pulse length & period. MUST first call makePulseOutput() to put the pin in pulse mode.
+        void pulseWrite(EventClockT::duration onTime, EventClockT::duration period);
         //put the pin into its default state, as set by setDefaultState(...).
         void setToDefault();
 };
@@ -0,0 +1,58 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "nexteventheap.h"
+#include "catch.hpp"
+
+#include <cstdlib> //for rand
+#include <vector>
+
+#include "iodrivers/iopin.h"
+
+TEST_CASE("NextEventHeap always yields the first, earliest event", "[nexteventheap]") {
+    const std::size_t numDrivers = 9;
+    iodrv::NextEventHeap<numDrivers> heap;
+    REQUIRE(heap.topEvent().isNull());
+    iodrv::IoPin::null pin;
+    std::vector<OutputEvent> events(numDrivers);
+    srand(1);
+    for (int iter=0; iter<2000; ++iter) {
+        //replace a random driver's event with a random (possibly null) one. Use few distinct times, so there are plenty of ties.
+        std::size_t idx = rand() % numDrivers;
+        events[idx] = rand() % 4 == 0 ? OutputEvent() : OutputEvent(EventClockT::time_point(std::chrono::milliseconds(rand() % 16)), pin, IoHigh);
+        heap.update(idx, events[idx]);
+        //compare with a linear scan
+        std::size_t expectedIdx = numDrivers;
+        for (std::size_t i=0; i<numDrivers; ++i) {
+            if (!events[i].isNull() && (expectedIdx == numDrivers || events[i].time() < events[expectedIdx].time())) {
+                expectedIdx = i;
+            }
+        }
+        if (expectedIdx == numDrivers) {
+            REQUIRE(heap.topEvent().isNull());
+        } else {
+            REQUIRE(heap.topIndex() == expectedIdx);
+            REQUIRE(heap.topEvent() == events[expectedIdx]);
+        }
+    }
+}
@@ -0,0 +1,110 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IODRIVERS_NEXTEVENTHEAP_H
+#define IODRIVERS_NEXTEVENTHEAP_H
+
+#include <array>
+#include <cstddef> //for std::size_t
+#include <utility> //for std::swap
+
+#include "outputevent.h"
+
+namespace iodrv {
+
+/* 
+ * Indexed binary min-heap holding the next OutputEvent of each of N IODrivers, ordered by time.
+ * The earliest event is available in O(1), and replacing the event of any one driver costs O(log N).
+ * Null events sort after all others, and events at the same time are ordered by driver index
+ *   (so the result is the same as scanning the drivers in order for the first, earliest event).
+ *
+ * @N number of IODrivers.
+ */
+template <std::size_t N> class NextEventHeap {
+    std::array<OutputEvent, N> _events; //_events[i] is the next event of driver #i
+    std::array<std::size_t, N> _heap; //driver indices, in heap order
+    std::array<std::size_t, N> _posInHeap; //_heap[_posInHeap[i]] == i
+    public:
+        //initially, every driver has a null event.
+        NextEventHeap() {
+            for (std::size_t i=0; i<N; ++i) {
+                _heap[i] = i;
+                _posInHeap[i] = i;
+            }
+        }
+        //@return the index of the driver with the earliest event, or N if there are no drivers.
+        std::size_t topIndex() const {
+            return N == 0 ? N : _heap[0];
+        }
+        //@return the earliest event (null if no driver has an event).
+        OutputEvent topEvent() const {
+            return N == 0 ? OutputEvent() : _events[_heap[0]];
+        }
+        //replace the event of driver #driverIdx
+        void update(std::size_t driverIdx, const OutputEvent &evt) {
+            _events[driverIdx] = evt;
+            siftUp(_posInHeap[driverIdx]);
+            siftDown(_posInHeap[driverIdx]);
+        }
+    private:
+        //@return true if driver #a's event should come before driver #b's
+        bool isBefore(std::size_t a, std::size_t b) const {
+            const OutputEvent &evtA = _events[a], &evtB = _events[b];
+            if (evtA.isNull() || evtB.isNull()) {
+                return !evtA.isNull() || (evtB.isNull() && a < b);
+            }
+            return evtA.time() < evtB.time() || (evtA.time() == evtB.time() && a < b);
+        }
+        void swapAt(std::size_t posA, std::size_t posB) {
+            std::swap(_heap[posA], _heap[posB]);
+            _posInHeap[_heap[posA]] = posA;
+            _posInHeap[_heap[posB]] = posB;
+        }
+        void siftUp(std::size_t pos) {
+            while (pos > 0 && isBefore(_heap[pos], _heap[(pos-1)/2])) {
+                swapAt(pos, (pos-1)/2);
+                pos = (pos-1)/2;
+            }
+        }
+        void siftDown(std::size_t pos) {
+            while (true) {
+                std::size_t first = pos;
+                std::size_t left = 2*pos+1, right = 2*pos+2;
+                if (left < N && isBefore(_heap[left], _heap[first])) {
+                    first = left;
+                }
+                if (right < N && isBefore(_heap[right], _heap[first])) {
+                    first = right;
+                }
+                if (first == pos) {
+                    return;
+                }
+                swapAt(pos, first);
+                pos = first;
+            }
+        }
+};
+
+}
+
+#endif
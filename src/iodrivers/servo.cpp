@@ -28,9 +28,15 @@ namespace iodrv {
 
 void Servo::setServoAngleDegrees(float angle) {
 	highTime = getOnTime(angle);
+	if (useHardwarePulses) {
+		pin.pulseWrite(highTime, cycleLength);
+	}
 }
 
 OutputEvent Servo::peekNextEvent() const {
+	if (useHardwarePulses) {
+		return OutputEvent(); //the platform generates the pulses, so there's nothing to schedule
+	}
 	bool nextState = !curState;
 	EventClockT::time_point nextEventTime = lastEventTime + (curState ? highTime : (cycleLength-highTime));
 	return OutputEvent(nextEventTime, pin, nextState);
@@ -131,6 +137,21 @@ struct ServoTester {
     				prevInactive = curInactive;
     			}
     		}
+			GIVEN("A Servo whose pulses are generated by the platform") {
+				iodrv::Servo hwServo(iodrv::IoPin(iodrv::NO_INVERSIONS, iodrv::IoPin::null().primitiveIoPin()), 
+							 std::chrono::milliseconds(20), //cycle length
+							 std::make_pair(std::chrono::milliseconds(1), std::chrono::milliseconds(2)), //min/max duty cycle
+							 std::make_pair(0, 180), //min/max angle
+							 0, //default angle
+							 true //use hardware pulses
+				);
+				THEN("It should never give the State any events to schedule") {
+					REQUIRE(hwServo.peekNextEvent().isNull());
+					hwServo.setServoAngleDegrees(90);
+					REQUIRE(hwServo.peekNextEvent().isNull());
+					TestHelper<>::requireDurationsApproxEqual(hwServo.highTime, std::chrono::microseconds(1500));
+				}
+			}
 	    	GIVEN("A TestHelper that owns references to those IoDrivers") {
 				//only give the State references to the ioDrivers so that we can track changes without private member access
 				auto getIoDrivers = [&]() {
@@ -140,7 +161,9 @@ struct ServoTester {
 									std::get<3>(ioDrivers),
 									std::get<4>(ioDrivers));
 				};
-		    	auto helper = makeTestHelper(makeTestMachine(getIoDrivers));
+		    	//constructed in place, as the State can't be moved if steps are generated on a thread (USE_STEP_THREAD)
+		    	auto machine = makeTestMachine(getIoDrivers);
+		    	TestHelper<decltype(machine)> helper(std::move(machine));
 
 		    	WHEN("Servo0 is set to 90 degrees") {
 		    		helper.sendCommand("M280 P0 S90.0", "ok");
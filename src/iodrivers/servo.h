@@ -50,6 +50,7 @@ class Servo : public IODriver {
 	EventClockT::duration cycleLength;
 	EventClockT::duration minOnTime, maxOnTime;
 	float minAngle, maxAngle;
+	bool useHardwarePulses;
 	//internal state:
 	EventClockT::time_point lastEventTime;
 	EventClockT::duration highTime;
@@ -64,15 +65,22 @@ class Servo : public IODriver {
 		//@minMaxAngle a pair of <minAngle, maxAngle> where minAngle is the minimum angle the Servo can be set to, in degrees, and 
 		//   maxAngle is the maximum angle the Servo can be set to, in degrees.
 		//@initialAngle the angle the Servo should be set to at startup.
+		//@useHardwarePulses if true, have the platform output the pulses itself (see IoPin::makePulseOutput) instead of scheduling each edge as an OutputEvent.
+		//   This removes all servo work from the event loop & makes the pulse timing independent of cpu load, but only some platforms support it (e.g. rpi).
+		//   The platform may also adjust the cycleLength (the rpi rounds it down to a power-of-two number of DMA frames, e.g. 20 ms -> 16.4 ms).
 		inline Servo(IoPin &&pin, EventClockT::duration cycleLength, std::pair<EventClockT::duration, EventClockT::duration> minMaxOnTime,
-			std::pair<float, float> minMaxAngle=std::pair<float, float>(0, 360), float initialAngle=0)
+			std::pair<float, float> minMaxAngle=std::pair<float, float>(0, 360), float initialAngle=0, bool useHardwarePulses=false)
 		 : pin(std::move(pin)) , cycleLength(cycleLength), minOnTime(minMaxOnTime.first), maxOnTime(minMaxOnTime.second), 
-		   minAngle(minMaxAngle.first), maxAngle(minMaxAngle.second),
+		   minAngle(minMaxAngle.first), maxAngle(minMaxAngle.second), useHardwarePulses(useHardwarePulses),
 		   lastEventTime(EventClockT::now()), highTime(getOnTime(initialAngle)), curState(IoLow) {
 		   	//ensure that the servo control pin is not left floating when shutdown
 		   	this->pin.setDefaultState(IO_DEFAULT_LOW);
 		   	//configure the pin for output mode
-		   	this->pin.makeDigitalOutput(IoLow);
+		   	if (useHardwarePulses) {
+		   		this->pin.makePulseOutput(highTime, cycleLength);
+		   	} else {
+		   		this->pin.makeDigitalOutput(IoLow);
+		   	}
 	    }
 
 		inline bool isServo() const {
@@ -75,15 +75,16 @@ class StepDirStepperDriver : public IODriver {
             //let stepper motors move freely
             enablePin.digitalWrite(IoLow);
         }
-        inline std::array<OutputEvent, 3> getEventOutputSequence(EventClockT::time_point evtTime, motion::StepDirection dir) const {
+        //@isDirChanged false if the previous step was in the same direction, in which case the DIR pin is already correct.
+        //  Any null OutputEvents in the returned sequence should be skipped.
+        inline std::array<OutputEvent, 2> getEventOutputSequence(EventClockT::time_point evtTime, motion::StepDirection dir, bool isDirChanged=true) const {
             //A4988 is directed by putting a direction on the DIRPIN, and then
             //sending a pulse on the STEPPIN.
             //It's the low->high transition that triggers the step. 
             //NOTE: documentation says STEP must be LOW for at least 1 uS and then HIGH for at least 1 uS (for A4988)
             //DRV8825 requires 1.9 uS here.
-            return {{OutputEvent(evtTime, dirPin, dir == motion::StepForward ? IoHigh : IoLow),
-                OutputEvent(evtTime, stepPin, IoLow),
-                OutputEvent(evtTime+std::chrono::microseconds(8), stepPin, IoHigh)}};
+            return {{isDirChanged ? OutputEvent(evtTime, dirPin, dir == motion::StepForward ? IoHigh : IoLow) : OutputEvent(),
+                OutputEvent(evtTime, stepPin, IoLow, std::chrono::microseconds(8))}};
         }
 };
 
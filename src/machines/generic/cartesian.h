@@ -35,7 +35,7 @@
 #define MACHINES_GENERIC_CARTESIAN_H
 
 #include <tuple>
-#include "motion/constantacceleration.h"
+#include "motion/junctionacceleration.h"
 #include "motion/linearcoordmap.h"
 #include "machines/machine.h"
 #include "common/matrix.h"
@@ -63,6 +63,8 @@
 #define MAX_MOVE_RATE_MM_SEC 120      // Maximum cartesian verlocity of end effector, in mm/s
 #define HOME_RATE_MM_SEC 10           // Speed at which to home the endstops, in mm/s
 #define MAX_EXT_RATE_MM_SEC 150       // Maximum rate at which filament should ever be extruded, in mm of filament / s
+#define JUNCTION_DEVIATION_MM 0.050   // How far the effector may stray from a sharp corner when cornering at speed, in mm (0 = stop at every vertex)
+#define MOVE_QUEUE_CAPACITY 16        // Number of moves that can be planned ahead of the current one
 
 
 //Pin Definitions:
@@ -135,8 +137,8 @@ using namespace motion; //for Acceleration & such
 
 class cartesian : public Machine {
     public:
-        inline ConstantAcceleration getAccelerationProfile() const {
-            return ConstantAcceleration(MAX_ACCEL_MM_SEC2);
+        inline JunctionAcceleration getAccelerationProfile() const {
+            return JunctionAcceleration(MAX_ACCEL_MM_SEC2, JUNCTION_DEVIATION_MM);
         }
         inline LinearCoordMap<A4988, A4988, A4988, A4988> getCoordMap() const {
             return LinearCoordMap<A4988, A4988, A4988, A4988>(
@@ -202,6 +204,9 @@ class cartesian : public Machine {
         inline float clampMoveRate(float inp) const {
             return std::min(inp, defaultMoveRate());
         }
+        static constexpr std::size_t moveQueueCapacity() {
+            return MOVE_QUEUE_CAPACITY;
+        }
 };
 
 }
@@ -24,6 +24,7 @@
 #ifndef DRIVERS_MACHINES_MACHINE_H
 #define DRIVERS_MACHINES_MACHINE_H
 
+#include <cstddef> //for size_t
 #include <tuple>
 
 #include "motion/coordmap.h"
@@ -58,6 +59,17 @@ class Machine {
         inline bool doHomeBeforeFirstMovement() const {
             return true; //if we get a G1 before the first G28, then yes - we want to home first.
         }
+        //maximum number of moves that can be planned & queued behind the one currently being executed.
+        //Each queued move occupies a fixed amount of memory inside the MotionPlanner (no heap allocations are made),
+        //  and a deeper queue allows the lookahead to carry more velocity through long runs of short segments.
+        static constexpr std::size_t moveQueueCapacity() {
+            return 16;
+        }
+        //if non-zero, arcs (G2/G3) are approximated by linear chords that stray no further than this from the true arc (in mm),
+        //  which are far cheaper to step than the arc itself. 0 steps along the exact arc.
+        static constexpr float arcChordTolerance() {
+            return 0;
+        }
 };
 
 }
@@ -626,13 +626,16 @@ class firepickdelta : public Machine {
         //Define the coordinate system:
         //  We are using a LinearDelta coordinate system, where vertically-moving carriages are
         //    attached to an end effector via fixed-length, rotatable rods.
-        inline AngularDeltaCoordMap<A4988, A4988, A4988, A4988> getCoordMap() const {
+        //  Each step is placed by solving the kinematics exactly. CubicStepEngine would instead approximate each arm's motion piecewise
+        //    (see cubicstepengine.h): several times faster for arcs (G2/G3), but somewhat slower for lines.
+        typedef ExactStepEngine StepEngine;
+        inline AngularDeltaCoordMap<A4988, A4988, A4988, A4988, Matrix3x3, StepEngine> getCoordMap() const {
             //the Matrix3x3 defines the level of the bed:
             //  This is a matrix such that M * {x,y,z} should transform desired coordinates into a 
             //    bed-level-compensated equivalent.
             //  Usually, this is just a rotation matrix.
             LOG("fpdelta XYZ_STEPS: %f\n", XYZ_STEPS);
-            return AngularDeltaCoordMap<A4988, A4988, A4988, A4988>(
+            return AngularDeltaCoordMap<A4988, A4988, A4988, A4988, Matrix3x3, StepEngine>(
                 DELTA_E, DELTA_F, DELTA_RE, DELTA_RF, DELTA_Z_OFFSET, DELTA_PRINTABLE_RADIUS, XYZ_STEPS, STEPS_MM_EXT, HOME_RATE_MM_SEC, Z_HOME_ANGLE,
                 //A tower:
                 A4988(IoPin(NO_INVERSIONS, PIN_STEPPER_A_STEP), 
@@ -350,7 +350,7 @@
 #include "pid.h"
 #include "common/filters/lowpassfilter.h"
 #include "common/matrix.h"
-#include "motion/constantacceleration.h"
+#include "motion/scurveacceleration.h"
 #include "iodrivers/a4988.h"
 #include "motion/lineardeltacoordmap.h"
 #include "iodrivers/rcthermistor2pin.h"
@@ -382,9 +382,13 @@
 
 //Movement rates:
 #define MAX_ACCEL_MM_SEC2 900.000   // Maximum cartesian acceleration of end effector in mm / s^2
+#define MAX_JERK_MM_SEC3 90000.000  // Maximum rate of change of the acceleration, in mm / s^3
 #define MAX_MOVE_RATE_MM_SEC 120    // Maximum cartesian verlocity of end effector, in mm/s
 #define HOME_RATE_MM_SEC 10         // Speed at which to home the endstops, in mm/s
 #define MAX_EXT_RATE_MM_SEC 150     // Maximum rate at which filament should ever be extruded, in mm of filament / s
+#define JUNCTION_DEVIATION_MM 0.050 // How far the effector may stray from a sharp corner when cornering at speed, in mm (0 = stop at every vertex)
+#define MOVE_QUEUE_CAPACITY 32      // Number of moves that can be planned ahead of the current one (deltas tend to receive many short segments)
+#define ARC_CHORD_TOLERANCE_MM 0     // How far the chords that approximate an arc (G2/G3) may stray from it, in mm (0 = step along the exact arc)
 
 
 //Pin Definitions:
@@ -544,21 +548,38 @@ class kosselrampsfd : public Machine {
                 //    PID(HOTEND_PID_P, HOTEND_PID_I, HOTEND_PID_D), LowPassFilter(3.000)));
         }
 
-        //Define the acceleration method to use. This uses a constant acceleration (resulting in linear velocity).
-        inline ConstantAcceleration getAccelerationProfile() const {
-            return ConstantAcceleration(MAX_ACCEL_MM_SEC2);
+        //Define how many moves can be planned ahead of the current one.
+        static constexpr std::size_t moveQueueCapacity() {
+            return MOVE_QUEUE_CAPACITY;
+        }
+
+        //Define how closely arcs must be followed. Stepping a series of chords is much cheaper than stepping the exact arc.
+        static constexpr float arcChordTolerance() {
+            return ARC_CHORD_TOLERANCE_MM;
+        }
+
+        //Define the acceleration method to use. This uses a jerk-limited (S-curve) velocity profile,
+        //  and allows consecutive moves to be chained together without stopping at each vertex.
+        inline SCurveAcceleration getAccelerationProfile() const {
+            return SCurveAcceleration(MAX_ACCEL_MM_SEC2, MAX_JERK_MM_SEC3, JUNCTION_DEVIATION_MM);
         }
         
         //Define the coordinate system:
         //  We are using a LinearDelta coordinate system, where vertically-moving carriages are
         //    attached to an end effector via fixed-length, rotatable rods.
-        inline LinearDeltaCoordMap<A4988, A4988, A4988, A4988> getCoordMap() const {
+        //  The dimensions of this machine are fixed at compile-time, so the kinematics can fold them into constants.
+        //    To set them at runtime instead, use LinearDeltaGeometry(R_MM, L_MM, ...).
+        typedef ConstLinearDeltaGeometry<milli(R_MM), milli(L_MM), milli(H_MM), milli(BUILDRAD_MM), milli(STEPS_MM), milli(STEPS_MM_EXT)> Geometry;
+        //  Each step is placed by solving the kinematics exactly. CubicStepEngine would instead approximate each carriage's motion piecewise
+        //    (see cubicstepengine.h), which only pays off for arcs. Alternatively, arcs can be split into chords (see ARC_CHORD_TOLERANCE_MM).
+        typedef ExactStepEngine StepEngine;
+        inline LinearDeltaCoordMap<A4988, A4988, A4988, A4988, Matrix3x3, Geometry, StepEngine> getCoordMap() const {
             //the Matrix3x3 defines the level of the bed:
             //  This is a matrix such that M * {x,y,z} should transform desired coordinates into a 
             //    bed-level-compensated equivalent.
             //  Usually, this is just a rotation matrix.
-            return LinearDeltaCoordMap<A4988, A4988, A4988, A4988>(
-                R_MM, L_MM, H_MM, BUILDRAD_MM, STEPS_MM, STEPS_MM_EXT, HOME_RATE_MM_SEC, 
+            return LinearDeltaCoordMap<A4988, A4988, A4988, A4988, Matrix3x3, Geometry, StepEngine>(
+                Geometry(), HOME_RATE_MM_SEC, 
                 //A tower:
                 A4988(IoPin(NO_INVERSIONS, PIN_STEPPER_A_STEP), 
                       IoPin(NO_INVERSIONS, PIN_STEPPER_A_DIR), 
@@ -25,6 +25,9 @@
 #ifndef MOTION_ACCELERATIONPROFILE_H
 #define MOTION_ACCELERATIONPROFILE_H
 
+#include <cmath> //for INFINITY
+#include "platforms/auto/chronoclock.h" //for EventClockT
+
 namespace motion {
 
 /* 
@@ -33,22 +36,37 @@ namespace motion {
  * 0.1, 0.2, 0.3, 0.4, 0.5, 0.6
  * and transform them to something like:
  * 0.2, 0.35, 0.5, 0.6, 0.75, 0.9
- * Currently, the initial and final velocity should both be 0 mm/sec.
- * Note that the events are already encoded at a *constant* velocity of Vmax (mm/sec) when they are passed through the AccelerationProfile. The AccelerationProfile should re-encode them so that the accelerate up to Vmax and then back to 0, and the velocity NEVER EXCEEDS Vmax.
+ * The initial and final velocity of a move are given by Vstart and Vend (in mm/sec). 
+ *   These are only ever non-zero if the profile reports a non-zero junctionDeviation(), in which case the MotionPlanner's lookahead
+ *   will chain consecutive moves together without stopping at each vertex (see motion/lookaheadplanner.h).
+ * Note that the events are already encoded at a *constant* velocity of Vmax (mm/sec) when they are passed through the AccelerationProfile. The AccelerationProfile should re-encode them so that the accelerate from Vstart up to Vmax and then back to Vend, and the velocity NEVER EXCEEDS Vmax.
  *
  * Note: AccelerationProfile is an interface and all derivatives must implement the methods outlined in the AccelerationProfile class. NoAcceleration can be considered a default implementation of this interface.
  */
 struct AccelerationProfile {
 	//Optional, but almost surely needed:
-    inline void begin(float moveDuration, float Vmax) {
-    	(void)moveDuration; (void)Vmax; //unused
+    inline void begin(float moveDuration, float Vmax, float Vstart=0, float Vend=0) {
+    	(void)moveDuration; (void)Vmax; (void)Vstart; (void)Vend; //unused
     }
     //float transform(float inp, float moveDuration, float Vmax);
+    //The MotionPlanner transforms step times given in EventClockT ticks since the start of the move:
+    //EventClockT::duration transform(EventClockT::duration inp);
+
+    //Optional. The maximum cartesian acceleration (mm/sec^2) the lookahead planner may assume when chaining moves.
+    inline float maxAcceleration() const {
+        return INFINITY;
+    }
+    //Optional. The maximum distance (mm) that the path may deviate from a sharp corner when taking it at speed.
+    //  Larger values allow faster cornering. The default of 0 forces the machine to come to a stop at every vertex.
+    inline float junctionDeviation() const {
+        return 0;
+    }
 };
 
 //AccelerationProfile implementation that doesn't perform any acceleration transformation
 struct NoAcceleration : public AccelerationProfile {
     inline float transform(float inp) { return inp; }
+    inline EventClockT::duration transform(EventClockT::duration inp) { return inp; }
 };
 
 }
@@ -52,14 +52,16 @@ namespace motion {
  * R1000 is 'r' (in mm) multiplied by 1000,
  * L1000 is 'L' (in mm) multiplied by 1000
  *
+ * StepEngineT chooses how the arms' step times are found: ExactStepEngine or CubicStepEngine (see cubicstepengine.h).
+ *
  * The math is described more in /code/proof-of-concept/coordmath.py and coord-math.nb (note: file has been deleted; must view an archived version of printipi on Github to view this documentation)
  */
 
-template <typename Stepper1, typename Stepper2, typename Stepper3, typename Stepper4, typename BedLevelT=Matrix3x3> class AngularDeltaCoordMap : public CoordMap {
+template <typename Stepper1, typename Stepper2, typename Stepper3, typename Stepper4, typename BedLevelT=Matrix3x3, typename StepEngineT=ExactStepEngine> class AngularDeltaCoordMap : public CoordMap {
     typedef std::tuple<Stepper1, Stepper2, Stepper3, Stepper4> StepperDriverTypes;
-    typedef std::tuple<AngularDeltaStepper<Stepper1>, 
-                       AngularDeltaStepper<Stepper2>, 
-                       AngularDeltaStepper<Stepper3>, 
+    typedef std::tuple<AngularDeltaStepper<Stepper1, StepEngineT>, 
+                       AngularDeltaStepper<Stepper2, StepEngineT>, 
+                       AngularDeltaStepper<Stepper3, StepEngineT>, 
                        LinearStepper<Stepper4> > _AxisStepperTypes;
 
     static constexpr float MIN_Z() { return -2; } //useful to be able to go a little under z=0 when tuning.
@@ -81,8 +83,8 @@ template <typename Stepper1, typename Stepper2, typename Stepper3, typename Step
         inline float MM_STEPS_EXT() const { return _MM_STEPS_EXT; }
     public:
         //define these functions so our AxisSteppers can know a bit about their coordinate system
-        inline float STEPS_DEGREE(std::size_t axisIdx) const { return _STEPS_DEGREE; }
-        inline float DEGREES_STEP(std::size_t axisIdx) const { return _DEGREES_STEP; }
+        inline float STEPS_DEGREE(std::size_t axisIdx) const { (void)axisIdx; return _STEPS_DEGREE; }
+        inline float DEGREES_STEP(std::size_t axisIdx) const { (void)axisIdx; return _DEGREES_STEP; }
         //The following are only valid for the extruder:
         inline float STEPS_MM(std::size_t axisIdx)     const { assert(axisIdx==CARTESIAN_AXIS_E); return _STEPS_MM_EXT; }
         inline float MM_STEPS(std::size_t axisIdx)     const { assert(axisIdx==CARTESIAN_AXIS_E); return _MM_STEPS_EXT; }
@@ -158,10 +160,10 @@ template <typename Stepper1, typename Stepper2, typename Stepper3, typename Step
         }
         inline _AxisStepperTypes getAxisSteppers() const {
             return std::make_tuple(
-                       AngularDeltaStepper<Stepper1>(0, ANGULARDELTA_AXIS_A, *this, std::get<0>(stepperDrivers), &endstops[0], e, f, re, rf, _zoffset), 
-                       AngularDeltaStepper<Stepper2>(1, ANGULARDELTA_AXIS_B, *this, std::get<1>(stepperDrivers), &endstops[1], e, f, re, rf, _zoffset), 
-                       AngularDeltaStepper<Stepper3>(2, ANGULARDELTA_AXIS_C, *this, std::get<2>(stepperDrivers), &endstops[2], e, f, re, rf, _zoffset), 
-                       LinearStepper<Stepper4>      (3, CARTESIAN_AXIS_E,    *this, std::get<3>(stepperDrivers), &endstops[3])
+                       AngularDeltaStepper<Stepper1, StepEngineT>(0, ANGULARDELTA_AXIS_A, *this, std::get<0>(stepperDrivers), &endstops[0], e, f, re, rf, _zoffset), 
+                       AngularDeltaStepper<Stepper2, StepEngineT>(1, ANGULARDELTA_AXIS_B, *this, std::get<1>(stepperDrivers), &endstops[1], e, f, re, rf, _zoffset), 
+                       AngularDeltaStepper<Stepper3, StepEngineT>(2, ANGULARDELTA_AXIS_C, *this, std::get<2>(stepperDrivers), &endstops[2], e, f, re, rf, _zoffset), 
+                       LinearStepper<Stepper4>                   (3, CARTESIAN_AXIS_E,    *this, std::get<3>(stepperDrivers), &endstops[3])
             );
         }
 
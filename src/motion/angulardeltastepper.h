@@ -93,13 +93,14 @@
 
 #include "axisstepper.h"
 #include "linearstepper.h" //for LinearHomeStepper
+#include "cubicstepengine.h"
 #include "iodrivers/endstop.h"
 #include "common/matrix.h"
 #include "common/logging.h"
 
 namespace motion {
 
-enum DeltaAxis {
+enum AngularDeltaAxis {
     ANGULARDELTA_AXIS_A=0,
     ANGULARDELTA_AXIS_B=1,
     ANGULARDELTA_AXIS_C=2,
@@ -109,51 +110,68 @@ enum DeltaAxis {
 /* 
  * LinearDeltaStepper implements the AxisStepper interface for (rail-based) Delta-style robots like the Kossel, 
  *   for linear (G0/G1) and arc movements (G2/G3)
+ * StepEngineT chooses how the step times are found: ExactStepEngine or CubicStepEngine (see cubicstepengine.h).
  */
-template <typename StepperDriverT> class AngularDeltaStepper : public AxisStepperWithDriver<StepperDriverT> {
-    DeltaAxis axisIdx;
-    const iodrv::Endstop *endstop; //must be pointer, because cannot move a reference
-    // calibration settings from the CoordMap
-    float e, f, re, rf, _zoffset;
-    float w; //angle of this arm about the +z axis, in radians
-    float _RADIANS_STEP;
-
-    float M0_rad; //initial coordinate of THIS axis in radians
+template <typename StepperDriverT, typename StepEngineT=ExactStepEngine> class AngularDeltaStepper : public AxisStepperWithDriver<StepperDriverT> {
+    //members are ordered from most to least frequently accessed (see AxisStepper).
+    //state used to compute each batch of steps:
     int sTotal; //current step offset from M0
+    bool isArcMotion;
+    float M0_rad; //initial coordinate of THIS axis in radians
+    float _RADIANS_STEP;
+    //cos & sin of RADIANS_STEP, so that consecutive arm angles can be visited by rotation rather than by evaluating sinf & cosf at each angle
+    float _cosStep, _sinStep;
 
-    Vector3f F1; //position of F1 joint in our YZ reference frame
+    //Within a move, the equations for the step times only depend upon the arm angle, a, through terms of the form
+    //  cosCoeff*cos(a) + sinCoeff*sin(a) + constant
+    struct AngleTerm {
+        float cosCoeff, sinCoeff, constant;
+        inline float at(float cosAngle, float sinAngle) const {
+            return cosCoeff*cosAngle + sinCoeff*sinAngle + constant;
+        }
+    };
 
+    //coefficients computed once per move by beginLine/beginArc (see _solveLineRoots & _solveArcRoots):
     //variables used during linear motion
-    Vector3f line_E1v; //velocity of the E1 point in our YZ reference frame
-    Vector3f line_E1_0; //initial position of the E1 point in our YZ reference frame at the start of the movement
-    float line_inverseVelocitySquared;
-
+    AngleTerm line_b_2a, line_c_a; //b/(2a) and c/a of the quadratic in t
     //variables used during arc motion
-    Vector3f arc_E1_0; //arc centerpoint (cartesian)
-    Vector3f arc_u, arc_v; //u and v vectors (cartesian); P(t) = Pc + u*cos(mt) + v*sin(mt)
-    float arc_rad; //radius of arc
+    AngleTerm arc_mTerm, arc_nTerm, arc_pTerm; //{m,n,p} . {Sin[mt], Cos[mt], 1} == 0
     float arc_m; //angular velocity of the arc.
-    bool isArcMotion;
+    //variables used by the CubicStepEngine (see _exactPosition). The path of the E1 joint, in our YZ reference frame:
+    //  E1(t) = path_E0 + path_vel*t for linear motion, or path_E0 + path_rad*(cos(path_m*t)*path_u + sin(path_m*t)*path_v) for arc motion.
+    StepEngineT engine;
+    Vector3f path_E0, path_vel, path_u, path_v;
+    float path_rad, path_m;
+    float path_branch; //+1 or -1: which of the 2 solutions for the arm angle the arm is in (see _exactPosition)
+
+    //machine configuration:
+    AngularDeltaAxis axisIdx;
+    const iodrv::Endstop *endstop; //must be pointer, because cannot move a reference
+    float re, rf; // calibration settings from the CoordMap
+    Vector3f F1; //position of F1 joint in our YZ reference frame
+    Vector3f E0toE1; //offset from the center of the effector (E0) to the E1 joint
+    Matrix3x3 toArmFrame; //rotates cartesian coordinates into our YZ reference frame (i.e. by -w, where w is the angle of this arm about the +z axis)
 
     float RADIANS_STEP() const { return _RADIANS_STEP; } //number of radians per step
     public:
         template <typename CoordMapT> AngularDeltaStepper(
-            int idx, DeltaAxis axisIdx, const CoordMapT &map, const StepperDriverT &stepper, const iodrv::Endstop *endstop,
+            int idx, AngularDeltaAxis axisIdx, const CoordMapT &map, const StepperDriverT &stepper, const iodrv::Endstop *endstop,
             float e, float f, float re, float rf, float zoffset)
          : AxisStepperWithDriver<StepperDriverT>(idx, stepper),
+           _RADIANS_STEP(map.DEGREES_STEP(axisIdx) * M_PI / 180.0f),
+           _cosStep(cosf(_RADIANS_STEP)),
+           _sinStep(sinf(_RADIANS_STEP)),
            axisIdx(axisIdx),
            endstop(endstop),
-           e(e),
-           f(f),
            re(re),
            rf(rf),
-           _zoffset(zoffset),
-           w(axisIdx*2*M_PI/3), 
-           _RADIANS_STEP(map.DEGREES_STEP(axisIdx) * M_PI / 180.0f) {
+           // The location of F1 is fixed in our rotated reference frame
+           F1(0, -f/(2*sqrtf(3.f)), zoffset),
+           // E1 is a fixed offset from E0
+           E0toE1(0, -e/(2*sqrt(3)), 0),
+           toArmFrame(Matrix3x3::rotationAboutPositiveZ(-axisIdx*2*M_PI/3)) {
               // E axis has to be controlled using a LinearStepper (as if it were cartesian)
               assert(axisIdx == ANGULARDELTA_AXIS_A || axisIdx == ANGULARDELTA_AXIS_B || axisIdx == ANGULARDELTA_AXIS_C);
-              // The location of F1 is fixed in our rotated reference frame
-              this->F1 = Vector3f(0, -f/(2*sqrtf(3.f)), _zoffset);
         }
 
         //function to initiate a linear (through cartesian space) motion
@@ -161,19 +179,23 @@ template <typename StepperDriverT> class AngularDeltaStepper : public AxisSteppe
         const Vector4f &vel) {
             this->M0_rad = map.getAxisPosition(curPos, axisIdx)*RADIANS_STEP(); 
             this->sTotal = 0;
-            this->time = 0;
+            this->_beginTime();
             this->isArcMotion = false;
             Vector3f line_P0 = map.xyzeFromMechanical(curPos).xyz();
             Vector3f line_v = vel.xyz();
 
             // rotate the cartesian position function into our flat YZ reference frame
-            auto rot = Matrix3x3::rotationAboutPositiveZ(-w);
-            this->line_E1v = rot.transform(line_v);
+            Vector3f E1v = toArmFrame.transform(line_v);
             // line_P0 specifies the initial center of the effector; translate that into our rotated coordinate system
-            Vector3f E0_0 = rot.transform(line_P0);
-            // E1 is a fixed offset from E0
-            this->line_E1_0 = E0_0  + Vector3f(0, -e/(2*sqrt(3)), 0);
-            this->line_inverseVelocitySquared = 1.f / line_v.magSq();
+            Vector3f E1_0 = toArmFrame.transform(line_P0) + E0toE1;
+            // cache the inverse of a to avoid a float division
+            float inv_a = 1.f / line_v.magSq();
+            // only the arm angle varies within the move, so compute everything else once (see _solveLineRoots for the derivation)
+            this->line_b_2a = { inv_a*rf*E1v.y(), inv_a*rf*E1v.z(), -inv_a*(F1-E1_0).dot(E1v) };
+            this->line_c_a = { -2*inv_a*rf*(F1.y()-E1_0.y()), -2*inv_a*rf*(F1.z()-E1_0.z()), inv_a*(-re*re + rf*rf + (F1-E1_0).magSq()) };
+            this->path_E0 = E1_0;
+            this->path_vel = E1v;
+            _beginEngine(engine);
         }
         //function to initiate a circular arc (through cartesian space) motion
         template <typename CoordMapT, std::size_t sz> void beginArc(const CoordMapT &map, const std::array<int, sz> &curPos, 
@@ -182,115 +204,109 @@ template <typename StepperDriverT> class AngularDeltaStepper : public AxisSteppe
             (void)extVel; //unused
             this->M0_rad = map.getAxisPosition(curPos, axisIdx)*RADIANS_STEP(); 
             this->sTotal = 0;
-            this->time = 0;
+            this->_beginTime();
             this->isArcMotion = true;
 
             // rotate the cartesian position function into our flat YZ reference frame
-            auto rot = Matrix3x3::rotationAboutPositiveZ(-w);
-            this->arc_u = rot.transform(u);
-            this->arc_v = rot.transform(v);
-            Vector3f E0_0 = rot.transform(center);
-            // E1 is a fixed offset from E0
-            this->arc_E1_0 = E0_0  + Vector3f(0, -e/(2*sqrt(3)), 0);
-            this->arc_rad = arcRad;
+            Vector3f armU = toArmFrame.transform(u);
+            Vector3f armV = toArmFrame.transform(v);
+            Vector3f E1_0 = toArmFrame.transform(center) + E0toE1;
+            // only the arm angle varies within the move, so compute everything else once (see _solveArcRoots for the derivation)
+            // sin(m*t)*[ - 2rf*s*vy*cos(a) - 2rf*s*vz*sin(a) + 2*(F1-E1o) . s*v]
+            this->arc_mTerm = { -2*rf*arcRad*armV.y(), -2*rf*arcRad*armV.z(), 2*arcRad*(F1-E1_0).dot(armV) };
+            // cos(m*t)*[ - 2rf*s*uy*cos(a) - 2rf*s*uz*sin(a) + 2*(F1-E1o) . s*u]
+            this->arc_nTerm = { -2*rf*arcRad*armU.y(), -2*rf*arcRad*armU.z(), 2*arcRad*(F1-E1_0).dot(armU) };
+            // 2rf*[(F1y-E1'oy)cos(a) + (F1z-E1'oz)sin(a)] + re^2 - rf^2 - |F1-E1o|^2 - s^2*|u|^2
+            this->arc_pTerm = { 2*rf*(F1.y()-E1_0.y()), 2*rf*(F1.z()-E1_0.z()), re*re - rf*rf - (F1-E1_0).magSq() - arcRad*arcRad };
             this->arc_m = arcVel;
+            this->path_E0 = E1_0;
+            this->path_u = armU;
+            this->path_v = armV;
+            this->path_rad = arcRad;
+            this->path_m = arcVel;
+            _beginEngine(engine);
         }
 
-        inline float testDir(float s) {
-            if (isArcMotion) {
-                /*
-                 * Given the constraint equations derived further up the page:
-                 *   2rf*(F1-E1) . (0, cos(a), sin(a)) + re^2 - rf^2 - |F1-E1|^2 == 0
-                 * For circular motion, E1 = E1o + s*cos(m*t)u + s*sin(m*t)v
-                 *   where s is the radius of the curve, u and v are two perpindicular vectors from the curve center to its edge,
-                 * We desire to test at what time t will a = D*RADIANS_STEP = (M0+s)*RADIANS_STEP
-                 *   0 == 2rf*(F1 - E1o - s*cos(m*t)u - s*sin(m*t)v) . (0, cos(a), sin(a)) + re^2 - rf^2 - |(F1 - E1o) - s*cos(m*t)u - s*sin(m*t)v|^2
-                 * Substitute:
-                 *   0 == 2rf*[(F1y-E1'oy)cos(a) + (F1z-E1'oz)sin(a) - s*uy*cos(m*t)*cos(a) - s*vy*sin(m*t)*cos(a) - s*uz*cos(m*t)*sin(a) - s*vz*sin(m*t)*sin(a)] + re^2 - rf^2 - [|F1-E1o|^2 + s^2*cos(m*t)^2|u|^2 + s^2*sin(m*t)^2|v|^2 - 2*(F1-E1o) . s*cos(m*t)u - 2*(F1-E1o) . s*sin(m*t)v + s^2*cos(m*t)sin(m*t)*u . v]
-                 * u and v are perpindicular, therefore u . v = 0
-                 * also |u|=1 and |v|=1
-                 *   0 == 2rf*[(F1y-E1'oy)cos(a) + (F1z-E1'oz)sin(a) - s*uy*cos(m*t)*cos(a) - s*vy*sin(m*t)*cos(a) - s*uz*cos(m*t)*sin(a) - s*vz*sin(m*t)*sin(a)] + re^2 - rf^2 - [|F1-E1o|^2 + s^2 - 2*(F1-E1o) . s*cos(m*t)u - 2*(F1-E1o) . s*sin(m*t)v]
-                 * Expand to separate the cos(m*t) from the sin(m*t):
-                 *   0 == 2rf*[(F1y-E1'oy)cos(a) + (F1z-E1'oz)sin(a)] - 2rf*s*uy*cos(m*t)*cos(a) - 2rf*s*vy*sin(m*t)*cos(a) - 2rf*s*uz*cos(m*t)*sin(a) - 2rf*s*vz*sin(m*t)*sin(a) + re^2 - rf^2 - |F1-E1o|^2 - s^2 + 2*(F1-E1o) . s*cos(m*t)u + 2*(F1-E1o) . s*sin(m*t)v
-                 * Group the cos(m*t), sin(m*t) and constant terms:
-                 *   0 == 2rf*[(F1y-E1'oy)cos(a) + (F1z-E1'oz)sin(a)] + re^2 - rf^2 - |F1-E1o|^2 - s^2
-                 *     + cos(m*t)*[ - 2rf*s*uy*cos(a) - 2rf*s*uz*sin(a) + 2*(F1-E1o) . s*u]
-                 *     + sin(m*t)*[ - 2rf*s*vy*cos(a) - 2rf*s*vz*sin(a) + 2*(F1-E1o) . s*v]
-                 *
-                 * Now we can use the identity: {m,n,p} . {Sin[q], Cos[q], 1} == 0 has solutions of:
-                 *        q = arctan((-n*p - m*sqrt(m*m+n*n-p*p))/(m*m+n*n),  (-m*p + n*sqrt(m*m+n*n-p*p))/(m*m + n*n)  )  where arctan(x, y) = atan(y/x)
-                 *     OR q = arctan((-n*p + m*sqrt(m*m+n*n-p*p))/(m*m+n*n),  (-m*p - n*sqrt(m*m+n*n-p*p))/(m*m + n*n)  )
-                 */
-                // determine the queried angle of our arm, in radians
-                float angle = M0_rad+s;
-                float sinAngle = sinf(angle);
-                float cosAngle = cosf(angle);
-                Vector3f E1_0 = arc_E1_0;
-                Vector3f u = arc_u;
-                Vector3f v = arc_v;
-                // sin(m*t)*[ - 2rf*s*vy*cos(a) - 2rf*s*vz*sin(a) + 2*(F1-E1o) . s*v]
-                float m = -2*rf*arc_rad*v.dot(0, cosAngle, sinAngle) + 2*arc_rad*(F1-E1_0).dot(v);
-                // cos(m*t)*[ - 2rf*s*uy*cos(a) - 2rf*s*uz*sin(a) + 2*(F1-E1o) . s*u]
-                float n = -2*rf*arc_rad*u.dot(0, cosAngle, sinAngle) + 2*arc_rad*(F1-E1_0).dot(u);
-                // 2rf*[(F1y-E1'oy)cos(a) + (F1z-E1'oz)sin(a)] + re^2 - rf^2 - |F1-E1o|^2 - s^2*|u|^2
-                float p = 2*rf*(F1-E1_0).dot(0, cosAngle, sinAngle) + re*re - rf*rf - (F1-E1_0).magSq() - arc_rad*arc_rad;
+        //Solve for the (up to 2) times at which this arm is at each of the angles corresponding to positions firstPos, firstPos+1, ..., firstPos+numPos-1
+        //  (in steps, relative to M0), storing the results in root1 and root2 (NAN if there is no solution).
+        //The per-move terms were computed in beginArc, so each position only needs the cos & sin of its arm angle.
+        inline void _solveArcRoots(int firstPos, int numPos, float *root1, float *root2) const {
+            /*
+             * Given the constraint equations derived further up the page:
+             *   2rf*(F1-E1) . (0, cos(a), sin(a)) + re^2 - rf^2 - |F1-E1|^2 == 0
+             * For circular motion, E1 = E1o + s*cos(m*t)u + s*sin(m*t)v
+             *   where s is the radius of the curve, u and v are two perpindicular vectors from the curve center to its edge,
+             * We desire to test at what time t will a = D*RADIANS_STEP = (M0+s)*RADIANS_STEP
+             *   0 == 2rf*(F1 - E1o - s*cos(m*t)u - s*sin(m*t)v) . (0, cos(a), sin(a)) + re^2 - rf^2 - |(F1 - E1o) - s*cos(m*t)u - s*sin(m*t)v|^2
+             * Substitute:
+             *   0 == 2rf*[(F1y-E1'oy)cos(a) + (F1z-E1'oz)sin(a) - s*uy*cos(m*t)*cos(a) - s*vy*sin(m*t)*cos(a) - s*uz*cos(m*t)*sin(a) - s*vz*sin(m*t)*sin(a)] + re^2 - rf^2 - [|F1-E1o|^2 + s^2*cos(m*t)^2|u|^2 + s^2*sin(m*t)^2|v|^2 - 2*(F1-E1o) . s*cos(m*t)u - 2*(F1-E1o) . s*sin(m*t)v + s^2*cos(m*t)sin(m*t)*u . v]
+             * u and v are perpindicular, therefore u . v = 0
+             * also |u|=1 and |v|=1
+             *   0 == 2rf*[(F1y-E1'oy)cos(a) + (F1z-E1'oz)sin(a) - s*uy*cos(m*t)*cos(a) - s*vy*sin(m*t)*cos(a) - s*uz*cos(m*t)*sin(a) - s*vz*sin(m*t)*sin(a)] + re^2 - rf^2 - [|F1-E1o|^2 + s^2 - 2*(F1-E1o) . s*cos(m*t)u - 2*(F1-E1o) . s*sin(m*t)v]
+             * Expand to separate the cos(m*t) from the sin(m*t):
+             *   0 == 2rf*[(F1y-E1'oy)cos(a) + (F1z-E1'oz)sin(a)] - 2rf*s*uy*cos(m*t)*cos(a) - 2rf*s*vy*sin(m*t)*cos(a) - 2rf*s*uz*cos(m*t)*sin(a) - 2rf*s*vz*sin(m*t)*sin(a) + re^2 - rf^2 - |F1-E1o|^2 - s^2 + 2*(F1-E1o) . s*cos(m*t)u + 2*(F1-E1o) . s*sin(m*t)v
+             * Group the cos(m*t), sin(m*t) and constant terms:
+             *   0 == 2rf*[(F1y-E1'oy)cos(a) + (F1z-E1'oz)sin(a)] + re^2 - rf^2 - |F1-E1o|^2 - s^2
+             *     + cos(m*t)*[ - 2rf*s*uy*cos(a) - 2rf*s*uz*sin(a) + 2*(F1-E1o) . s*u]
+             *     + sin(m*t)*[ - 2rf*s*vy*cos(a) - 2rf*s*vz*sin(a) + 2*(F1-E1o) . s*v]
+             *
+             * Now we can use the identity: {m,n,p} . {Sin[q], Cos[q], 1} == 0 has solutions of:
+             *        q = arctan((-n*p - m*sqrt(m*m+n*n-p*p))/(m*m+n*n),  (-m*p + n*sqrt(m*m+n*n-p*p))/(m*m + n*n)  )  where arctan(x, y) = atan(y/x)
+             *     OR q = arctan((-n*p + m*sqrt(m*m+n*n-p*p))/(m*m+n*n),  (-m*p - n*sqrt(m*m+n*n-p*p))/(m*m + n*n)  )
+             */
+            float cosAngle, sinAngle;
+            _firstArmAngle(firstPos, cosAngle, sinAngle);
+            for (int i=0; i<numPos; ++i, _nextArmAngle(cosAngle, sinAngle)) {
+                float m = arc_mTerm.at(cosAngle, sinAngle);
+                float n = arc_nTerm.at(cosAngle, sinAngle);
+                float p = arc_pTerm.at(cosAngle, sinAngle);
 
                 // solve {m,n,p} . {Sin[q], Cos[q], 1} == 0:
                 float mt_1 = atan2f((-m*p + n*sqrtf(m*m+n*n-p*p))/(m*m + n*n), (-n*p - m*sqrtf(m*m+n*n-p*p))/(m*m+n*n));
                 float mt_2 = atan2f((-m*p - n*sqrtf(m*m+n*n-p*p))/(m*m + n*n), (-n*p + m*sqrtf(m*m+n*n-p*p))/(m*m+n*n));
-                float t1 = mt_1/this->arc_m;
-                float t2 = mt_2/this->arc_m;
-                //two possible solutions; choose the NEAREST one that is not in the past:
-                //TODO: are solutions to mt = x +/- c*2*pi?
-                if (t1 < this->time && t2 < this->time) { return NAN; }
-                else if (t1 < this->time) { return t2; }
-                else if (t2 < this->time) { return t1; }
-                else { return std::min(t1, t2); }
-            } else {
-                /*
-                 * Given the constraint equations derived further up the page:
-                 *    -(F1y-E1'y)cos(a) - (F1z-E1'z)sin(a) - 1/(2rf)*(re^2-E1x^2 - rf^2 - |F1-E1'|^2) == 0
-                 * For linear motion, E1' = E1'o + E1'v*t and E1 = E1o + E1v*t
-                 * Then -(F1y-E1'oy-E1'vy*t)cos(a) - (F1z-E1'oz-E1'vz*t)sin(a) - 1/(2rf)*(re^2-(E1ox+E1vx*t)^2 - rf^2 - |F1-E1'o-E1'v*t|^2) == 0
-                 *
-                 * We desire to test at what time t will a = D*RADIANS_STEP = (M0+s)*RADIANS_STEP
-                 * Expand to separate the various powers of t:
-                 *    -(F1y-E1'oy)cos(D) + E1'vy*t*cos(D) - (F1z-E1'oz)sin(D) + E1'vz*t*sin(D) - 1/(2rf)*(re^2 - (E1ox^2+2*E1ox*E1vx*t+E1vx^2*t^2) - rf^2 - (F1-E1'o-E1'v*t) . (F1-E1'o-E1'v*t)) == 0
-                 * Multiply by 2rf & expand a little more
-                 *    2rf( -(F1y-E1'oy)cos(D) + E1'vy*t*cos(D) - (F1z-E1'oz)sin(D) + E1'vz*t*sin(D) ) - re^2 + E1ox^2+2*E1ox*E1vx*t+E1vx^2*t^2 + rf^2 + (F1-E1'o) . (F1-E1'o) - 2(F1-E1'o) . E1'v*t + |E1'v*t|^2 == 0
-                 * Group by t^0, t^1 and t^2
-                 *    t^2 * (E1vx^2 + |E1'v|^2)
-                    + t*(2rf*E1'vy*cos(D) + 2rf*E1'vz*sin(D) + 2*E1ox*E1vx - 2(F1-E1'o) . E1'v)
-                    + -2rf(F1y-E1'oy)*cos(D) - 2rf(F1z-E1'oz)sin(D) - re^2 + E1ox^2 + rf^2 + (F1-E1'o) . (F1-E1'o) == 0
-                 * This is a quadratic equation of t that we can solve using t = (-b +/- sqrt(b^2-4a*c)) / (2*a)
-                 * There are two solutions; both may be valid, but have different meanings. 
-                 *   If one solution is at a time in the past, then it's just a projection of the current path into the past. 
-                 *   If both solutions are in the future, then pick the nearest one; 
-                 *   it means that there are two points in this path where the arm angle should be the same.
-                 */
-                
-                Vector3f E1v = line_E1v;
-                Vector3f E1_0 = line_E1_0;
-                // determine the queried angle of our arm, in radians
-                float angle = M0_rad+s;
-                float sinAngle = sinf(angle);
-                float cosAngle = cosf(angle);
-                
-                // determine the coefficients to at^2 + bt + c = 0, which gives the time at which our arm will be at the above angle (possibly non-existant).
-                // unoptimized (preserve for reference)
-                // float a = E1v.x()*E1v.x() + E1primev.magSq();
-                // float b = 2*(rf*E1primev.y()*cos(angle) + rf*E1primev.z()*sin(angle)  + E1_0.x()*E1v.x() - (F1-E1prime0).dot(E1primev));
-                // float c = -2*rf*(F1.y()-E1prime0.y())*cosAngle - 2*rf*(F1.z()-E1prime0.z())*sinAngle - re*re  + E1_0.x()*E1_0.x() + rf*rf + (F1-E1prime0).magSq();
-                
-                // More efficient implementation than the above
-                // cache the inverse of a to avoid a float division
-                float inv_a = line_inverseVelocitySquared;
-                // calculate only b/(2*a) (see below for explanation)
-                // float b_2a = inv_a*(rf*E1primev.y()*cosAngle + rf*E1primev.z()*sinAngle  + E1_0.x()*E1v.x() - (F1-E1prime0).dot(E1primev));
-                float b_2a = inv_a*(rf*E1v.y()*cosAngle + rf*E1v.z()*sinAngle  - (F1-E1_0).dot(E1v));
-                // calculate only c/a (see below for explanation)
-                // float c_a = inv_a*(-2*rf*(F1.y()-E1prime0.y())*cosAngle - 2*rf*(F1.z()-E1prime0.z())*sinAngle - re*re  + E1_0.x()*E1_0.x() + rf*rf + (F1-E1prime0).magSq());
-                float c_a = inv_a*(-2*rf*(F1.y()-E1_0.y())*cosAngle - 2*rf*(F1.z()-E1_0.z())*sinAngle - re*re  + rf*rf + (F1-E1_0).magSq());
+                //an arc may sweep up to 2pi, so the angles that atan2 gives in (-pi, 0) are reached in its second half
+                root1[i] = (mt_1 < 0 ? mt_1 + (float)(2*M_PI) : mt_1)/this->arc_m;
+                root2[i] = (mt_2 < 0 ? mt_2 + (float)(2*M_PI) : mt_2)/this->arc_m;
+            }
+        }
+        inline void _solveLineRoots(int firstPos, int numPos, float *root1, float *root2) const {
+            /*
+             * Given the constraint equations derived further up the page:
+             *    -(F1y-E1'y)cos(a) - (F1z-E1'z)sin(a) - 1/(2rf)*(re^2-E1x^2 - rf^2 - |F1-E1'|^2) == 0
+             * For linear motion, E1' = E1'o + E1'v*t and E1 = E1o + E1v*t
+             * Then -(F1y-E1'oy-E1'vy*t)cos(a) - (F1z-E1'oz-E1'vz*t)sin(a) - 1/(2rf)*(re^2-(E1ox+E1vx*t)^2 - rf^2 - |F1-E1'o-E1'v*t|^2) == 0
+             *
+             * We desire to test at what time t will a = D*RADIANS_STEP = (M0+s)*RADIANS_STEP
+             * Expand to separate the various powers of t:
+             *    -(F1y-E1'oy)cos(D) + E1'vy*t*cos(D) - (F1z-E1'oz)sin(D) + E1'vz*t*sin(D) - 1/(2rf)*(re^2 - (E1ox^2+2*E1ox*E1vx*t+E1vx^2*t^2) - rf^2 - (F1-E1'o-E1'v*t) . (F1-E1'o-E1'v*t)) == 0
+             * Multiply by 2rf & expand a little more
+             *    2rf( -(F1y-E1'oy)cos(D) + E1'vy*t*cos(D) - (F1z-E1'oz)sin(D) + E1'vz*t*sin(D) ) - re^2 + E1ox^2+2*E1ox*E1vx*t+E1vx^2*t^2 + rf^2 + (F1-E1'o) . (F1-E1'o) - 2(F1-E1'o) . E1'v*t + |E1'v*t|^2 == 0
+             * Group by t^0, t^1 and t^2
+             *    t^2 * (E1vx^2 + |E1'v|^2)
+                + t*(2rf*E1'vy*cos(D) + 2rf*E1'vz*sin(D) + 2*E1ox*E1vx - 2(F1-E1'o) . E1'v)
+                + -2rf(F1y-E1'oy)*cos(D) - 2rf(F1z-E1'oz)sin(D) - re^2 + E1ox^2 + rf^2 + (F1-E1'o) . (F1-E1'o) == 0
+             * This is a quadratic equation of t that we can solve using t = (-b +/- sqrt(b^2-4a*c)) / (2*a)
+             * There are two solutions; both may be valid, but have different meanings. 
+             *   If one solution is at a time in the past, then it's just a projection of the current path into the past. 
+             *   If both solutions are in the future, then pick the nearest one; 
+             *   it means that there are two points in this path where the arm angle should be the same.
+             */
+            // unoptimized (preserve for reference)
+            // float a = E1v.x()*E1v.x() + E1primev.magSq();
+            // float b = 2*(rf*E1primev.y()*cos(angle) + rf*E1primev.z()*sin(angle)  + E1_0.x()*E1v.x() - (F1-E1prime0).dot(E1primev));
+            // float c = -2*rf*(F1.y()-E1prime0.y())*cosAngle - 2*rf*(F1.z()-E1prime0.z())*sinAngle - re*re  + E1_0.x()*E1_0.x() + rf*rf + (F1-E1prime0).magSq();
+            
+
+            // More efficient implementation than the above
+            // only the arm angle varies between positions, so beginLine computed the remaining terms once:
+            // b/(2*a) = inv_a*(rf*E1v.y()*cosAngle + rf*E1v.z()*sinAngle) - inv_a*(F1-E1_0).dot(E1v)
+            // c/a     = inv_a*(-2*rf*(F1.y()-E1_0.y())*cosAngle - 2*rf*(F1.z()-E1_0.z())*sinAngle) + inv_a*(-re*re + rf*rf + (F1-E1_0).magSq())
+            // (see below for why only b/(2*a) and c/a are needed)
+            float cosAngle, sinAngle;
+            _firstArmAngle(firstPos, cosAngle, sinAngle);
+            for (int i=0; i<numPos; ++i, _nextArmAngle(cosAngle, sinAngle)) {
+                float b_2a = line_b_2a.at(cosAngle, sinAngle);
+                float c_a = line_c_a.at(cosAngle, sinAngle);
 
                 // Solve the quadratic equation: x = (-b +/- sqrt(b^2-4ac)) / (2a)
                 // Note: if we divide numerator and denominator by 2, we get:
@@ -300,68 +316,92 @@ template <typename StepperDriverT> class AngularDeltaStepper : public AxisSteppe
                 // we can do that because a is guaranteed to be positive, since it is the square of the velocity
                 float term1 = -b_2a;
                 float rootParam = b_2a*b_2a - c_a;
-                //check if the sqrt argument is negative
-                //TODO: can it ever be negative?
-                if (rootParam < 0) {
-                    return NAN;
-                }
-                float root = sqrtf(rootParam);
-                float t1 = term1 - root;
-                float t2 = term1 + root;
-                //return the nearest of the two times that is > current time.
-                //note: root will always be positive.
-                if (root > term1) { //if this is true, then t1 MUST be negative.
-                    //return t2 if t2 > last_step_time else None
-                    return t2 > this->time ? t2 : NAN;
-                } else {
-                    return t1 > this->time ? t1 : (t2 > this->time ? t2 : NAN); //ensure no value < time is returned.
-                }
+                // if the sqrt argument is negative, the arm never reaches this angle.
+                float root = sqrtf(std::max(0.f, rootParam));
+                root1[i] = rootParam < 0 ? NAN : term1 - root;
+                root2[i] = rootParam < 0 ? NAN : term1 + root;
             }
         }
+        //get the cos & sin of the arm angle at position @pos (in steps, relative to M0)
+        inline void _firstArmAngle(int pos, float &cosAngle, float &sinAngle) const {
+            float angle = M0_rad+pos*RADIANS_STEP();
+            cosAngle = cosf(angle);
+            sinAngle = sinf(angle);
+        }
+        //advance the cos & sin of the arm angle by one step, using the angle-sum identities.
+        //Batches are short (AXIS_STEPPER_BATCH_SIZE+2 positions), so the rounding error that accumulates is negligible.
+        inline void _nextArmAngle(float &cosAngle, float &sinAngle) const {
+            float nextCos = cosAngle*_cosStep - sinAngle*_sinStep;
+            sinAngle = sinAngle*_cosStep + cosAngle*_sinStep;
+            cosAngle = nextCos;
+        }
     
+        //the exact angle of the arm (in steps, relative to M0_rad) at time t into the move, and its angular velocity (in steps/sec).
+        //With W = F1 - E1, the constraint derived at the top of this file is 2rf*W . (0, cos(a), sin(a)) + re^2 - rf^2 - |W|^2 == 0.
+        //  That's A*cos(a) + B*sin(a) == C for A = 2rf*Wy, B = 2rf*Wz, C = |W|^2 - re^2 + rf^2, so a = atan2(B, A) +/- acos(C/sqrt(A^2+B^2)).
+        //  Differentiating the constraint with respect to t gives the angular velocity: dG/da * a' + dG/dW . W' == 0, where W' = -E1'.
+        inline float _exactPosition(float t, float &vel) const {
+            Vector3f E1, E1vel;
+            if (isArcMotion) {
+                float cosMt = cosf(path_m*t), sinMt = sinf(path_m*t);
+                E1 = path_E0 + (path_u*cosMt + path_v*sinMt)*path_rad;
+                E1vel = (path_v*cosMt - path_u*sinMt)*(path_rad*path_m);
+            } else {
+                E1 = path_E0 + path_vel*t;
+                E1vel = path_vel;
+            }
+            Vector3f W = F1 - E1;
+            float A = 2*rf*W.y(), B = 2*rf*W.z(), C = W.magSq() - re*re + rf*rf;
+            float angle = atan2f(B, A) + path_branch*acosf(C/sqrtf(A*A + B*B)); //NAN if the arm can't reach E1
+            float cosAngle = cosf(angle), sinAngle = sinf(angle);
+            float dGda = 2*rf*(W.z()*cosAngle - W.y()*sinAngle);
+            Vector3f dGdW = Vector3f(0, 2*rf*cosAngle, 2*rf*sinAngle) - W*2;
+            vel = dGdW.dot(E1vel)/dGda/RADIANS_STEP();
+            return remainderf(angle - M0_rad, 2*(float)M_PI)/RADIANS_STEP();
+        }
+        inline void _beginEngine(ExactStepEngine &) {}
+        inline void _beginEngine(CubicStepEngine &engine) {
+            //use whichever solution for the arm angle that the arm is currently at.
+            float vel;
+            path_branch = 1;
+            float offset = std::fabs(_exactPosition(0, vel));
+            path_branch = -1;
+            if (!(std::fabs(_exactPosition(0, vel)) < offset)) {
+                path_branch = 1;
+            }
+            engine.begin([this](float t, float &vel) { return this->_exactPosition(t, vel); });
+        }
+        //Steps are computed in batches (see AxisStepper::_fillBatchFromRoots): we solve for the times at which the arm passes through
+        //  each angle near its current one, and then repeatedly choose the nearest of the backward & forward step.
+        inline void _fillBatch(ExactStepEngine &, unsigned maxSteps) {
+            int firstPos = this->_batchFirstPos(sTotal, maxSteps);
+            int numPos = maxSteps+2;
+            float root1[AXIS_STEPPER_BATCH_SIZE+2], root2[AXIS_STEPPER_BATCH_SIZE+2];
+            if (isArcMotion) {
+                _solveArcRoots(firstPos, numPos, root1, root2);
+                this->_fillBatchFromRoots(sTotal, firstPos, numPos, root1, root2, AxisStepper::_nearestRootAfter, maxSteps);
+            } else {
+                _solveLineRoots(firstPos, numPos, root1, root2);
+                this->_fillBatchFromRoots(sTotal, firstPos, numPos, root1, root2, AxisStepper::_firstRootAfter, maxSteps);
+            }
+        }
+        //Steps are found one after another from a piecewise-cubic approximation of the arm angle.
+        inline void _fillBatch(CubicStepEngine &engine, unsigned maxSteps) {
+            auto position = [this](float t, float &vel) { return this->_exactPosition(t, vel); };
+            this->_fillBatchSequentially([&](float &time, StepDirection &direction) {
+                time = engine.nextStep(position, sTotal, time, direction);
+            }, maxSteps);
+        }
         inline void _nextStep(bool useEndstops) {
-            //called to set this->time and this->direction; the time (in seconds) and the direction at which the next step should occur for this axis
+            //called to set this->time and this->direction; the time (in ticks) and the direction at which the next step should occur for this axis
             //General formula is outlined in comments at the top of this file.
-            //First, we test the time at which a forward step (sTotal + 1) should occur given constant angular velocity.
-            //Then we test that time for a backward step (sTotal - 1).
-            //We choose the nearest resulting time as our next step.
-            //This is necessary because axis velocity can actually reverse direction during a circular cartesian movement.
             if (useEndstops && endstop->isEndstopTriggered()) {
-                this->time = NAN; //at endstop; no more steps.
-            } else {
-                float negTime = testDir((this->sTotal-1)*RADIANS_STEP()); //get the time at which next steps would occur.
-                float posTime = testDir((this->sTotal+1)*RADIANS_STEP());
-                if (negTime < this->time || std::isnan(negTime)) { //negTime is invalid
-                    if (posTime > this->time) {
-                        LOGV("LinearDeltaStepper<%u>::chose %f (pos) vs %f (neg)\n", axisIdx, posTime, negTime);
-                        this->time = posTime;
-                        this->direction = StepForward;
-                        ++this->sTotal;
-                    } else {
-                        this->time = NAN;
-                    }
-                } else if (posTime < this->time || std::isnan(posTime)) { //posTime is invalid
-                    if (negTime > this->time) {
-                        LOGV("LinearDeltaStepper<%u>::chose %f (neg) vs %f (pos)\n", axisIdx, negTime, posTime);
-                        this->time = negTime;
-                        this->direction = StepBackward;
-                        --this->sTotal;
-                    } else {
-                        this->time = NAN;
-                    }
-                } else { //neither time is invalid
-                    if (negTime < posTime) {
-                        LOGV("LinearDeltaStepper<%u>::chose %f (neg) vs %f (pos)\n", axisIdx, negTime, posTime);
-                        this->time = negTime;
-                        this->direction = StepBackward;
-                        --this->sTotal;
-                    } else {
-                        LOGV("LinearDeltaStepper<%u>::chose %f (pos) vs %f (neg)\n", axisIdx, posTime, negTime);
-                        this->time = posTime;
-                        this->direction = StepForward;
-                        ++this->sTotal;
-                    }
-                }
+                this->time = AxisStepper::NO_STEP(); //at endstop; no more steps.
+            } else if (!this->_popBatchedStep()) {
+                //when homing, the endstop must be checked before each step, so only compute one step at a time.
+                unsigned maxSteps = useEndstops ? 1 : AXIS_STEPPER_BATCH_SIZE;
+                _fillBatch(engine, maxSteps);
+                this->_popBatchedStep();
             }
         }
 };
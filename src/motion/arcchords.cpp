@@ -0,0 +1,118 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "arcchords.h"
+#include "catch.hpp"
+
+#include <cfloat> //for FLT_EPSILON
+#include <cmath> //for std::cos, std::fabs, std::sin, std::sqrt
+#include <string> //for std::to_string
+
+namespace {
+    //@return the distance from p to the nearest point on the circle of radius r about center, in the plane spanned by u & v.
+    //  Every point on a chord lies within the chord's sector of the circle, so this is also the distance to the arc itself.
+    float distanceFromCircle(const Vector3f &p, const Vector3f &center, const Vector3f &u, const Vector3f &v, float r) {
+        Vector3f rel = p - center;
+        float along = rel.dot(u), across = rel.dot(v);
+        Vector3f outOfPlane = rel - u*along - v*across;
+        float radialErr = std::sqrt(along*along + across*across) - r;
+        return std::sqrt(radialErr*radialErr + outOfPlane.magSq());
+    }
+}
+
+TEST_CASE("Every arc chord stays within the tolerance of the true arc", "[arcchords]") {
+    //a plane tilted away from every axis
+    Vector3f center(12, -7, 30);
+    Vector3f u = Vector3f(1, 2, 2).norm();
+    Vector3f v = Vector3f(2, 1, -2).norm();
+    const float radii[] = { 0.5, 5, 40, 150 };
+    const float angles[] = { 0.05, 1.5707963, 3.1415927, 6.2 };
+    //includes the Kossel's tolerance
+    const float tolerances[] = { 0.001, 0.010, 0.050 };
+    for (float r : radii) {
+        for (float arcAngle : angles) {
+            for (float tolerance : tolerances) {
+                Vector4f dest(center + u*(r*std::cos(arcAngle)) + v*(r*std::sin(arcAngle)), 3.f);
+                motion::ArcChords chords(center, u, v, r, arcAngle, 1, dest, tolerance);
+                INFO("radius " + std::to_string(r) + " angle " + std::to_string(arcAngle) + " tolerance " + std::to_string(tolerance) + " chords " + std::to_string(chords.numChords()));
+                //the error inherent in single-precision points on the arc
+                float slack = 8*FLT_EPSILON*(r + center.mag());
+                //the arc begins at P(0)
+                REQUIRE(distanceFromCircle(chords.chordEnd(0).xyz(), center, u, v, r) <= slack);
+                //the arc ends exactly at dest
+                REQUIRE(chords.chordEnd(chords.numChords()).xyz().distance(dest.xyz()) == 0);
+                for (unsigned chord=1; chord<=chords.numChords(); ++chord) {
+                    Vector4f start = chords.chordEnd(chord-1);
+                    Vector4f end = chords.chordEnd(chord);
+                    //the chord ends on the arc
+                    REQUIRE(distanceFromCircle(end.xyz(), center, u, v, r) <= slack);
+                    //and nowhere along its length does it stray more than the tolerance from the arc
+                    for (int i=1; i<32; ++i) {
+                        float frac = i/32.f;
+                        Vector3f p = start.xyz() + (end.xyz()-start.xyz())*frac;
+                        REQUIRE(distanceFromCircle(p, center, u, v, r) <= tolerance + slack);
+                    }
+                    //the extruder moves linearly along the arc
+                    REQUIRE(std::fabs(end.e() - (1 + 2.f*chord/chords.numChords())) <= 4*FLT_EPSILON);
+                }
+                //the arc is split into as few chords as possible: any fewer would stray beyond the tolerance
+                //  (to within the precision of 1-cos(x) for small x in single-precision, as the chord angle is found by acos)
+                if (chords.numChords() > 1) {
+                    float fewerChordAngle = arcAngle / (chords.numChords()-1);
+                    float fewerChordSagitta = r*(1 - std::cos(fewerChordAngle/2));
+                    REQUIRE(fewerChordSagitta > 0.99f*tolerance);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Arcs sweep the long way round when their end lies behind them", "[arcchords]") {
+    Vector3f u(1, 0, 0);
+    Vector3f ccw(0, 1, 0), cw(0, -1, 0);
+    const float pi = 3.1415927;
+    //a quarter turn one way is three quarters of a turn the other way
+    REQUIRE(motion::arcSweep(Vector3f(0, 10, 0), u, ccw, false) == Approx(pi/2));
+    REQUIRE(motion::arcSweep(Vector3f(0, 10, 0), u, cw, false) == Approx(3*pi/2));
+    REQUIRE(motion::arcSweep(Vector3f(0, -10, 0), u, ccw, false) == Approx(3*pi/2));
+    REQUIRE(motion::arcSweep(Vector3f(0, -10, 0), u, cw, false) == Approx(pi/2));
+    //half a turn either way
+    REQUIRE(motion::arcSweep(Vector3f(-10, 0, 0), u, ccw, false) == Approx(pi));
+    REQUIRE(motion::arcSweep(Vector3f(-10, 0, 0), u, cw, false) == Approx(pi));
+    //an arc that ends where it begins is a full turn
+    REQUIRE(motion::arcSweep(Vector3f(10, 0, 0), u, ccw, true) == Approx(2*pi));
+
+    //the chords of a clockwise arc from (10, 0) to (0, 10) pass through the third quadrant, not the first
+    Vector3f center(0, 0, 0);
+    Vector4f dest(0, 10, 0, 1);
+    float arcAngle = motion::arcSweep(dest.xyz(), u, cw, false);
+    motion::ArcChords chords(center, u, cw, 10, arcAngle, 0, dest, 0.01);
+    bool passesThirdQuadrant = false;
+    for (unsigned chord=0; chord<chords.numChords(); ++chord) {
+        Vector3f p = chords.chordEnd(chord).xyz();
+        bool inFirstQuadrant = p.x() > 0.01 && p.y() > 0.01;
+        REQUIRE(!inFirstQuadrant);
+        passesThirdQuadrant = passesThirdQuadrant || (p.x() < -5 && p.y() < -5);
+    }
+    REQUIRE(passesThirdQuadrant);
+}
@@ -0,0 +1,87 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MOTION_ARCCHORDS_H
+#define MOTION_ARCCHORDS_H
+
+#include <algorithm> //for std::max
+#include <cmath> //for std::acos, std::atan2, std::ceil, std::cos, std::sin, M_PI
+
+#include "common/vector3.h"
+#include "common/vector4.h"
+
+namespace motion {
+
+/*
+ * @return the angle that an arc sweeps, in (0, 2pi], going from u towards v (u & v are perpendicular unit vectors) until it reaches b.
+ * b is relative to the arc's center. If isFullCircle, the arc ends where it begins, so it sweeps the whole 2pi.
+ * Unlike acos(a . b / |a| / |b|), this can also go the long way round, as G2/G3 arcs may.
+ */
+inline float arcSweep(const Vector3f &b, const Vector3f &u, const Vector3f &v, bool isFullCircle) {
+    float arcAngle = isFullCircle ? 0 : std::atan2(b.dot(v), b.dot(u));
+    if (arcAngle <= 0) {
+        arcAngle += 2*(float)M_PI;
+    }
+    return arcAngle;
+}
+
+/*
+ * ArcChords approximates an arc by the fewest linear chords that stray no further than a given tolerance from it.
+ * The arc is P(f) = center + r*cos(f*arcAngle)*u + r*sin(f*arcAngle)*v for f in [0, 1] (u & v are perpendicular unit vectors, arcAngle in (0, 2pi]),
+ *   while the extruder moves linearly from startE to dest.e().
+ * Each chord spans an equal angle. The furthest a chord strays from the arc is at its midpoint (the sagitta): r*(1-cos(chordAngle/2)).
+ * Used by the MotionPlanner when the machine's arcChordTolerance() is non-zero.
+ */
+class ArcChords {
+    Vector3f _center, _u, _v;
+    float _arcRad, _arcAngle;
+    float _startE;
+    Vector4f _dest;
+    unsigned _numChords;
+    public:
+        inline ArcChords() : _center(), _u(), _v(), _arcRad(0), _arcAngle(0), _startE(0), _dest(), _numChords(0) {}
+        inline ArcChords(const Vector3f &center, const Vector3f &u, const Vector3f &v, float arcRad, float arcAngle, float startE, const Vector4f &dest, float tolerance)
+          : _center(center), _u(u), _v(v), _arcRad(arcRad), _arcAngle(arcAngle), _startE(startE), _dest(dest) {
+            float maxChordAngle = 2*std::acos(std::max(-1.f, 1 - tolerance/arcRad));
+            //Note: also catches a degenerate (NaN) arcAngle, which results in a single line to dest
+            _numChords = arcAngle > maxChordAngle ? (unsigned)std::ceil(arcAngle/maxChordAngle) : 1;
+        }
+        inline unsigned numChords() const {
+            return _numChords;
+        }
+        //@return the point at which chord #chord ends, for chord in [1, numChords()], or the start of the arc if chord == 0.
+        //  The last chord ends exactly at dest.
+        inline Vector4f chordEnd(unsigned chord) const {
+            if (chord == _numChords) {
+                return _dest;
+            }
+            float frac = (float)chord / _numChords;
+            float angle = frac*_arcAngle;
+            return Vector4f(_center + _u*(_arcRad*std::cos(angle)) + _v*(_arcRad*std::sin(angle)),
+                _startE + frac*(_dest.e() - _startE));
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "axisstepper.h"
+#include "steptournament.h"
+#include "catch.hpp"
+
+#include <algorithm> //for std::count
+#include <vector>
+#include "common/benchmark.h"
+#include "common/logging.h"
+#include "common/perfcounter.h"
+
+//MACHINE_PATH is calculated in the Makefile and then passed as a define through the make system (ie gcc -DMACHINEPATH='"path"')
+#include MACHINE_PATH
+
+TEST_CASE("Linear step times don't accumulate rounding error over long moves", "[axisstepper]") {
+    auto map = machines::MACHINE().getCoordMap();
+    auto steppers = map.getAxisSteppers();
+    //every machine drives its extruder (axis 3) with a LinearStepper
+    motion::AxisStepper &extruder = std::get<3>(steppers);
+    auto startPos = map.getHomePosition(std::array<int, decltype(map)::numAxis()>());
+    //a slow extrusion-only move, lasting several minutes
+    const float extVel = 0.01;
+    const double timePerStep = map.MM_STEPS(3) / extVel;
+    motion::AxisStepper::initAxisSteppers(steppers, false, map, startPos, Vector4f(0, 0, 0, extVel));
+    int n = 1;
+    for (; n*timePerStep < 300; ++n) {
+        //each step time should be within a tick, plus the rounding of the time per step to a float (24 bits of precision), of the exact value
+        double exact = n*timePerStep;
+        double time = std::chrono::duration<double>(extruder.time).count();
+        double tick = std::chrono::duration<double>(EventClockT::duration(1)).count();
+        REQUIRE(std::fabs(time - exact) <= exact / (1 << 22) + tick);
+        extruder.nextStep(steppers, false);
+    }
+    REQUIRE(n > 1000);
+}
+
+//The step loop of the MotionPlanner (selecting the next axis & computing its next step), for the machine that's being built.
+//  Reports the L1 data cache misses per step where the kernel exposes hardware counters (e.g. on the Raspberry Pi),
+//  so that changes to the layout of the AxisSteppers can be compared.
+TEST_CASE("AxisStepper step loop benchmark", "[.][benchmark][axisstepper]") {
+    auto map = machines::MACHINE().getCoordMap();
+    auto steppers = map.getAxisSteppers();
+    typedef decltype(steppers) AxisStepperTypes;
+    const std::size_t numAxis = std::tuple_size<AxisStepperTypes>::value;
+    motion::StepTournament<numAxis> tournament;
+    auto startPos = map.getHomePosition(std::array<int, decltype(map)::numAxis()>());
+    //a downward diagonal move, with extrusion
+    const Vector4f vel(30, -20, -40, 5);
+    const EventClockT::duration duration = motion::ticksFromSeconds(1.0);
+    const int numMoves = 50;
+
+    //the same move is repeated, so every repetition must give the same steps; moveChecksums[i] is the sum of the step times of move i.
+    std::vector<double> moveChecksums(numMoves);
+    long numSteps = 0;
+    auto stepMoves = [&]() {
+        for (int move=0; move<numMoves; ++move) {
+            motion::AxisStepper::initAxisSteppers(steppers, false, map, startPos, vel);
+            tournament.reset(steppers);
+            while (true) {
+                motion::AxisStepper &s = motion::AxisStepper::atIndex(steppers, tournament.winner());
+                if (s.time == motion::AxisStepper::NO_STEP() || s.time > duration) {
+                    break;
+                }
+                moveChecksums[move] += s.time.count();
+                s.nextStep(steppers, false);
+                tournament.set(s.index(), s.time);
+                ++numSteps;
+            }
+        }
+        return moveChecksums[0];
+    };
+    PerfCounter l1dMisses(PerfCounter::L1D_READ_MISSES), l1dAccesses(PerfCounter::L1D_READ_ACCESSES);
+    l1dMisses.start();
+    l1dAccesses.start();
+    //the number of steps is only known afterward, so measure the time per move and convert it.
+    benchmark::Timing timing = benchmark::measure(numMoves, stepMoves);
+    uint64_t accesses = l1dAccesses.stop();
+    uint64_t misses = l1dMisses.stop();
+
+    REQUIRE(numSteps > 0);
+    float ns = timing.ns*numMoves/numSteps;
+    LOG("AxisStepper step loop: %ld steps, %f ns/step (checksum %f)\n", numSteps, ns, timing.checksum);
+    if (l1dMisses.isAvailable() && l1dAccesses.isAvailable()) {
+        LOG("AxisStepper step loop: %f L1D read misses/step, %f L1D reads/step\n", (float)misses/numSteps, (float)accesses/numSteps);
+    } else {
+        LOG("AxisStepper step loop: L1D counters are unavailable on this system\n");
+    }
+    bool isRepeatable = std::count(moveChecksums.begin(), moveChecksums.end(), moveChecksums[0]) == numMoves;
+    REQUIRE(isRepeatable);
+}
@@ -28,6 +28,7 @@
 #include <tuple>
 #include <array>
 #include <cmath> //for isnan
+#include <algorithm> //for std::min
 #include <utility> //for std::move
 #include <cassert>
 
@@ -35,13 +36,15 @@
 #include "platforms/auto/chronoclock.h"
 #include "common/tupleutil.h"
 #include "outputevent.h"
+#include "steptime.h"
 
 #include "common/vector3.h"
 #include "common/vector4.h"
 
 namespace motion {
 
-enum StepDirection {
+//stored in 1 byte, to keep the per-step state of each AxisStepper compact (see AxisStepper)
+enum StepDirection : unsigned char {
     StepBackward,
     StepForward
 };
@@ -58,8 +61,18 @@ template <typename T> T stepDirToSigned(StepDirection dir) {
  * AxisSteppers are used to queue movements.
  * When a movement is desired, an AxisStepper is instantiated for each MECHANICAL axis (eg each column of a Kossel, plus extruders. Or perhaps an X stepper, a Y stepper, a Z stepper, and an extruder for a cartesian bot).
  * The AxisStepper provides the relative time at which its associated axis should next be advanced, as well as in what mechanical direction, given an initial mechanical position and cartesian velocity.
+ *   The time is in EventClockT ticks since the start of the move (see steptime.h), or NO_STEP() if the axis has no more steps.
  * It also implements the 'nextStep' method, which will update the time & direction of the step that would follow the current one. In this way, the AxisStepper can be queried for the 1st step, 2nd step, and so on, for the given path.
  *
+ * Internally, implementations compute their steps in batches of up to AXIS_STEPPER_BATCH_SIZE, stored as a structure-of-arrays (times[], directions[]).
+ *   'time' and 'direction' then just expose the head of that batch, so the MotionPlanner's selection of the earliest step among all axes is a merge of their batches.
+ *   Batching amortizes the per-call overhead and allows the compiler to vectorize the step-time solves, since the solve for each step position is independent.
+ *
+ * Memory layout: the state that's touched on every step (time, direction and the batch) is declared first, and is followed by the driver state of AxisStepperWithDriver,
+ *   so that it occupies the start of each stepper (the first 2 cache lines on a 32-bit target). Implementations should then declare the state used to compute each batch,
+ *   then the coefficients computed once per move in beginLine/beginArc, and lastly the machine configuration, which is only needed when a move begins.
+ *   The MotionPlanner selects the next axis to step from a StepTournament, which keeps a copy of every axis' time in one contiguous, aligned block.
+ *
  * Note: AxisStepper is an interface, and not an implementation.
  * An implementation is needed for each coordinate style - Cartesian, deltabot, etc.
  * These implementations must provide the functions outlined further down in the header.
@@ -68,16 +81,141 @@ class AxisStepper {
     private:
         AxisIdType _index; //ID of axis. Does not necessarily have to be stored as a variable (other option is one template instance per ID, which pretty much already happens), but this allows AxisStepper::nextStep() to not be virtual
     public:
-        float time; //time of next step
+        EventClockT::duration time; //time of next step
         StepDirection direction; //direction of next step
         inline int index() const { return _index; } //NOT TO BE OVERRIDEN
+        //the time of a step that never comes (e.g. the axis has reached its endstop). It's later than any other time.
+        static constexpr EventClockT::duration NO_STEP() { return EventClockT::duration::max(); }
         
-        template <typename TupleT> static AxisStepper& getNextTime(TupleT &axes);
+        //@return the AxisStepper at position @idx of the tuple (its index() is @idx). Use StepTournament to find which axis steps next.
+        template <typename TupleT> static AxisStepper& atIndex(TupleT &axes, std::size_t idx);
         template <typename TupleT, typename CoordMapT, std::size_t MechSize> static void initAxisSteppers(TupleT &steppers, bool useEndstops, const CoordMapT &map, const std::array<int, MechSize>& curPos, const Vector4f &vel);
         template <typename TupleT, typename CoordMapT, std::size_t MechSize> static void initAxisArcSteppers(TupleT &steppers, bool useEndstops, const CoordMapT &map, const std::array<int, MechSize>& curPos, const Vector3f &center, const Vector3f &u, const Vector3f &v, float arcRad, float arcVel, float extVel);
         template <typename TupleT> void nextStep(TupleT &axes, bool useEndstops); //NOT TO BE OVERRIDEN
+        //discard any steps that were computed ahead of time. Called whenever a new move begins.
+        inline void resetBatch() { //NOT TO BE OVERRIDEN
+            _batch.count = _batch.next = 0;
+        }
     protected:
-        AxisStepper(int idx) : _index(idx) {} //only callable via children
+        //Steps that have been computed but not yet exposed through time & direction.
+        struct StepBatch {
+            EventClockT::duration times[AXIS_STEPPER_BATCH_SIZE];
+            StepDirection directions[AXIS_STEPPER_BATCH_SIZE];
+            unsigned char count, next;
+        };
+        StepBatch _batch;
+        //the time (in seconds) of the last step that was placed in the batch, from which the steps of the next batch are solved (see _fillBatchFromRoots).
+        //  The solves are done in float seconds; only their results are converted to ticks.
+        float _solvedTime;
+        //Note: direction must be defined before the first move, as the steps that are solved in each batch depend on it (see _batchFirstPos)
+        AxisStepper(int idx) : _index(idx), time(NO_STEP()), direction(StepForward), _solvedTime(NAN) { resetBatch(); } //only callable via children
+        //called by implementations as a move begins: the steps that follow are solved from time 0.
+        inline void _beginTime() {
+            this->time = EventClockT::duration::zero();
+            this->_solvedTime = 0;
+        }
+        //move the next precomputed step into time & direction.
+        //@return false if there are no precomputed steps left
+        inline bool _popBatchedStep() {
+            if (_batch.next == _batch.count) {
+                return false;
+            }
+            this->time = _batch.times[_batch.next];
+            this->direction = _batch.directions[_batch.next];
+            ++_batch.next;
+            return true;
+        }
+        //For axes whose step times are found by solving for the (up to 2) times at which the axis passes through a given position:
+        //  fill the batch by choosing, step after step, the nearest of the backward & forward step that isn't in the past.
+        //  This is necessary because axis velocity can actually reverse direction during a cartesian movement.
+        //@sTotal the axis's current position (in steps). It's advanced past every step placed in the batch.
+        //@root1, root2 the candidate times at which the axis is at positions firstPos, firstPos+1, ..., firstPos+numPos-1
+        //@select function that, given root1, root2 and the time of the preceding step, returns the time of the next step at that position (or NAN if none)
+        //The batch ends early if the axis moves outside the range of solved positions, or if the axis has no more steps (in which case the final step is NO_STEP()).
+        template <typename SelectT> void _fillBatchFromRoots(int &sTotal, int firstPos, int numPos, const float *root1, const float *root2, SelectT select, unsigned maxSteps) {
+            float time = _solvedTime;
+            StepDirection direction = this->direction;
+            resetBatch();
+            while (_batch.count < maxSteps) {
+                int negIdx = sTotal-1-firstPos;
+                int posIdx = sTotal+1-firstPos;
+                if (negIdx < 0 || posIdx >= numPos) {
+                    break;
+                }
+                float negTime = select(root1[negIdx], root2[negIdx], time);
+                float posTime = select(root1[posIdx], root2[posIdx], time);
+                if (negTime < time || std::isnan(negTime)) { //negTime is invalid
+                    if (posTime > time) {
+                        time = posTime;
+                        direction = StepForward;
+                        ++sTotal;
+                    } else {
+                        time = NAN;
+                    }
+                } else if (posTime < time || std::isnan(posTime)) { //posTime is invalid
+                    if (negTime > time) {
+                        time = negTime;
+                        direction = StepBackward;
+                        --sTotal;
+                    } else {
+                        time = NAN;
+                    }
+                } else { //neither time is invalid
+                    if (negTime < posTime) {
+                        time = negTime;
+                        direction = StepBackward;
+                        --sTotal;
+                    } else {
+                        time = posTime;
+                        direction = StepForward;
+                        ++sTotal;
+                    }
+                }
+                _batch.times[_batch.count] = ticksFromSeconds(time); //NO_STEP() if time is NAN
+                _batch.directions[_batch.count] = direction;
+                ++_batch.count;
+                if (std::isnan(time)) {
+                    break; //no more steps
+                }
+            }
+            _solvedTime = time;
+        }
+        //For axes whose steps are found one after another (see CubicStepEngine): fill the batch with up to maxSteps steps,
+        //  where next(time, direction) advances time (in seconds) & direction from one step to the one that follows it.
+        //The batch ends early if the axis has no more steps (in which case next() gives a time of NAN, and the final step is NO_STEP()).
+        template <typename NextStepT> void _fillBatchSequentially(NextStepT next, unsigned maxSteps) {
+            float time = _solvedTime;
+            StepDirection direction = this->direction;
+            resetBatch();
+            while (_batch.count < maxSteps) {
+                next(time, direction);
+                _batch.times[_batch.count] = ticksFromSeconds(time); //NO_STEP() if time is NAN
+                _batch.directions[_batch.count] = direction;
+                ++_batch.count;
+                if (std::isnan(time)) {
+                    break; //no more steps
+                }
+            }
+            _solvedTime = time;
+        }
+        //the range of positions to solve for in order to compute up to maxSteps steps, biased towards the direction the axis is moving in.
+        //@return the first position; numPos = maxSteps+2.
+        inline int _batchFirstPos(int sTotal, unsigned maxSteps) const {
+            return this->direction == StepForward ? sTotal-1 : sTotal-(int)maxSteps;
+        }
+        //select functions for _fillBatchFromRoots:
+        //given the 2 solutions to a quadratic, t1 <= t2 (or NAN), return the first that's after the given time.
+        static inline float _firstRootAfter(float t1, float t2, float time) {
+            return t1 > time ? t1 : (t2 > time ? t2 : NAN);
+        }
+        //given 2 unordered solutions (e.g. from the arc equations), return the nearest one that is not in the past.
+        static inline float _nearestRootAfter(float t1, float t2, float time) {
+            //TODO: are solutions to mt = x +/- c*2*pi?
+            if (t1 < time && t2 < time) { return NAN; }
+            else if (t1 < time) { return t2; }
+            else if (t2 < time) { return t1; }
+            else { return std::min(t1, t2); }
+        }
         //OVERRIDE THIS. And yes, it will be called upon initialization too.
         inline void _nextStep(bool useEndstops) {
             //should be implemented in derivatives.
@@ -88,39 +226,36 @@ class AxisStepper {
 
 template <typename StepperDriver> class AxisStepperWithDriver : public AxisStepper {
     const StepperDriver *driver; //must be pointer, because cannot move a reference
+    //the direction of the last step that was output, so that the direction only needs to be output when it changes.
+    StepDirection lastOutputDirection;
+    bool hasOutputStep;
     public:
-        AxisStepperWithDriver(int idx, const StepperDriver &d) : AxisStepper(idx), driver(&d) {}
-        inline auto getStepOutputEventSequence(EventClockT::time_point absoluteTime) const
-         -> decltype(driver->getEventOutputSequence(absoluteTime, direction)) {
-            return driver->getEventOutputSequence(absoluteTime, this->direction);
+        AxisStepperWithDriver(int idx, const StepperDriver &d) : AxisStepper(idx), driver(&d), hasOutputStep(false) {}
+        //Get the OutputEvents needed to perform the current step. Any null events in the sequence should be skipped.
+        inline auto getStepOutputEventSequence(EventClockT::time_point absoluteTime)
+         -> decltype(driver->getEventOutputSequence(absoluteTime, direction, true)) {
+            bool isDirChanged = !hasOutputStep || this->direction != lastOutputDirection;
+            lastOutputDirection = this->direction;
+            hasOutputStep = true;
+            return driver->getEventOutputSequence(absoluteTime, this->direction, isDirChanged);
+        }
+        //carry on from another AxisStepper for the same axis, once it has computed & output all of its steps
+        //  (e.g. so that the next move can be set up in a second set of AxisSteppers while the current one completes).
+        //The direction of its last step biases the next batch, and the direction is still only output when it changes.
+        inline void continueFrom(const AxisStepperWithDriver<StepperDriver> &other) {
+            this->direction = other.direction;
+            lastOutputDirection = other.lastOutputDirection;
+            hasOutputStep = other.hasOutputStep;
         }
 };
 
 namespace {
     //place helper functions in an unnamed namespace to limit visibility and hint the documentation generator
 
-    //Helper classes for AxisStepper::getNextTime method
-    //C++ doesn't support partial template function specialization, so we need to use templated classes instead.
-    //Below function(s) select the AxisStepper with the smallest time attribute from a tuple of such AxisSteppers
-    template <typename TupleT, int idx> struct _AxisStepper__getNextTime {
-        AxisStepper& operator()(TupleT &axes) {
-            AxisStepper &m1 = _AxisStepper__getNextTime<TupleT, idx-1>()(axes);
-            AxisStepper &m2 = std::get<idx>(axes);
-            //assume that .time can be finite, infinite, or NaN.
-            //comparisons against NaN are ALWAYS false.
-            if (m1.time <= 0) { return m2; } //if one of the times is non-positive (ie no next step), return the other one.
-            if (m2.time <= 0) { return m1; }
-            //Now return the smallest of the two, discarding any NaNs:
-            //if m2.time == NaN, then (m1.time < m2.time || isnan(m2.time)) ? m1 : m2 will return m1.time
-            //elif m1.time == NaN, then (m1.time < m2.time || isnan(m2.time)) ? m1 : m2 will return m2.time
-            return (m1.time < m2.time || std::isnan(m2.time)) ? m1 : m2;
-        }
-    };
-
-    //TODO: re-implement with tupleutil
-    template <typename TupleT> struct _AxisStepper__getNextTime<TupleT, 0> {
-        AxisStepper& operator()(TupleT &axes) {
-            return std::get<0>(axes);
+    //Helper class for AxisStepper::atIndex
+    struct _AxisStepper__atIndex {
+        template <std::size_t MyIdx, typename T> AxisStepper& operator()(std::integral_constant<std::size_t, MyIdx>, T &stepper) {
+            return stepper;
         }
     };
 
@@ -128,6 +263,7 @@ namespace {
     struct _AxisStepper__initAxisSteppers {
         template <std::size_t MyIdx, typename TupleT, typename T, typename CoordMapT, std::size_t MechSize> void operator()(std::integral_constant<std::size_t, MyIdx> _myIdx, T &stepper, TupleT *steppers, bool useEndstops, const CoordMapT *map, std::array<int, MechSize>& curPos, const Vector4f &vel) {
             (void)_myIdx; (void)stepper; //unused
+            std::get<MyIdx>(*steppers).resetBatch();
             std::get<MyIdx>(*steppers).beginLine(*map, curPos, vel);
             std::get<MyIdx>(*steppers)._nextStep(useEndstops);
         }
@@ -137,6 +273,7 @@ namespace {
     struct _AxisStepper__initAxisArcSteppers {
         template <std::size_t MyIdx, typename TupleT, typename T, typename CoordMapT, std::size_t MechSize> void operator()(std::integral_constant<std::size_t, MyIdx> _myIdx, T &stepper, TupleT *steppers, bool useEndstops, const CoordMapT *map, std::array<int, MechSize>& curPos, const Vector3f &center, const Vector3f &u, const Vector3f &v, float arcRad, float arcVel, float extVel) {
             (void)_myIdx; (void)stepper; //unused
+            std::get<MyIdx>(*steppers).resetBatch();
             std::get<MyIdx>(*steppers).beginArc(*map, curPos, center, u, v, arcRad, arcVel, extVel);
             std::get<MyIdx>(*steppers)._nextStep(useEndstops);
         }
@@ -158,8 +295,8 @@ namespace {
 
 
 
-template <typename TupleT> AxisStepper& AxisStepper::getNextTime(TupleT &axes) {
-    return _AxisStepper__getNextTime<TupleT, std::tuple_size<TupleT>::value-1>()(axes);
+template <typename TupleT> AxisStepper& AxisStepper::atIndex(TupleT &axes, std::size_t idx) {
+    return tupleCallOnIndex(axes, _AxisStepper__atIndex(), idx);
 }
 template <typename TupleT, typename CoordMapT, std::size_t MechSize> void AxisStepper::initAxisSteppers(TupleT &steppers, bool useEndstops, const CoordMapT &map, const std::array<int, MechSize>& curPos, const Vector4f &vel) {
     callOnAll(steppers, _AxisStepper__initAxisSteppers(), &steppers, useEndstops, &map, curPos, vel);
@@ -0,0 +1,107 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "cartesiandda.h"
+#include "catch.hpp"
+
+#include <cmath> //for std::sqrt
+#include <vector>
+
+namespace {
+    //time (in ticks) of each step of an axis that accelerates uniformly from rest to a constant rate at step 400, then cruises.
+    struct AcceleratingRamp {
+        int64_t operator()(uint32_t step) const {
+            if (step < 400) {
+                return (int64_t)(100000*std::sqrt((float)step));
+            } else {
+                return 2000000 + (int64_t)(step - 400)*2500;
+            }
+        }
+    };
+    //time (in ticks) of each step of an axis that moves at a constant rate.
+    struct ConstantRamp {
+        int64_t operator()(uint32_t step) const {
+            return 1000 + (int64_t)step*2500;
+        }
+    };
+}
+
+TEST_CASE("CartesianDda steps each axis along the line", "[cartesiandda]") {
+    const int64_t tolerance = 1000;
+    motion::CartesianDda<4> dda;
+    std::array<int, 4> steps = {{ -300, 1000, 0, 17 }};
+    REQUIRE(motion::CartesianDda<4>::dominantAxis(steps) == 1);
+    AcceleratingRamp ramp;
+    REQUIRE(dda.begin(steps, ramp, tolerance));
+    REQUIRE(dda.numRampKnots() <= motion::CartesianDda<4>::MAX_RAMP_KNOTS);
+
+    std::array<int, 4> pos = {{ 0, 0, 0, 0 }};
+    int64_t lastTicks = 0;
+    int axis;
+    while ((axis = dda.nextStep()) >= 0) {
+        //steps never go backwards in time
+        REQUIRE(dda.ticks() >= lastTicks);
+        lastTicks = dda.ticks();
+        pos[axis] += dda.stepSign(axis);
+        if (axis == 1) {
+            //the dominant axis steps at its true time, to within the tolerance
+            REQUIRE(std::llabs(dda.ticks() - ramp(pos[1])) <= tolerance);
+        } else {
+            //every other axis is always at the step nearest its ideal position along the line.
+            //  Axes before the dominant one step before it during each tick.
+            int64_t dominantPos = pos[1] + (axis < 1 ? 1 : 0);
+            int64_t expected = (dominantPos*std::abs(steps[axis]) + 1000/2) / 1000;
+            REQUIRE(std::abs(pos[axis]) == expected);
+        }
+    }
+    REQUIRE(pos == steps);
+    //nothing more is output once the move is complete
+    REQUIRE(dda.nextStep() < 0);
+}
+
+TEST_CASE("CartesianDda needs few ramp knots at constant velocity", "[cartesiandda]") {
+    motion::CartesianDda<2> dda;
+    std::array<int, 2> steps = {{ 2000, 1999 }};
+    ConstantRamp ramp;
+    REQUIRE(dda.begin(steps, ramp, 1));
+    //the move is always split into quarters before checking the tolerance; linear interpolation is then exact.
+    REQUIRE(dda.numRampKnots() == 5);
+    std::vector<int64_t> dominantTicks;
+    int axis;
+    while ((axis = dda.nextStep()) >= 0) {
+        if (axis == 0) {
+            dominantTicks.push_back(dda.ticks());
+        }
+    }
+    REQUIRE(dominantTicks.size() == 2000);
+    for (std::size_t i=0; i<dominantTicks.size(); ++i) {
+        REQUIRE(dominantTicks[i] == ramp(i+1));
+    }
+}
+
+TEST_CASE("CartesianDda handles moves without any steps", "[cartesiandda]") {
+    motion::CartesianDda<3> dda;
+    std::array<int, 3> steps = {{ 0, 0, 0 }};
+    REQUIRE(dda.begin(steps, ConstantRamp(), 1));
+    REQUIRE(dda.nextStep() < 0);
+}
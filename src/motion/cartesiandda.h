@@ -0,0 +1,237 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MOTION_CARTESIANDDA_H
+#define MOTION_CARTESIANDDA_H
+
+#include <array>
+#include <cstdint> //for uint32_t, int64_t
+#include <cstdlib> //for std::abs, std::llabs
+
+namespace motion {
+
+/*
+ * CartesianDda generates the steps of a line on a machine whose axes each drive a single cartesian coordinate at a constant rate
+ *   (see LinearCoordMap), using only integer arithmetic per step. It's used by the MotionPlanner if built with CARTESIAN_DDA=1.
+ *
+ * The axis that takes the most steps (the dominant axis) steps on every tick of the DDA. Every other axis steps on the ticks at which
+ *   its Bresenham error term overflows, so each axis is always within half a step of the ideal straight line.
+ * The time of each tick comes from a ramp table: the times (in clock ticks, with acceleration already applied) of selected dominant-axis steps.
+ *   Knots are placed by bisection until linear interpolation between them is within a given tolerance of the true step times,
+ *   so the table is dense where the velocity changes quickly and a single segment covers any stretch of constant velocity.
+ *   Between two knots, the time advances by the quotient and remainder of their separation (another Bresenham term),
+ *   so no step needs a float operation or a division.
+ */
+template <std::size_t NumAxis> class CartesianDda {
+    public:
+        //Capacity of the ramp table. A move that needs more knots to meet the tolerance can't be stepped by the DDA.
+        static constexpr std::size_t MAX_RAMP_KNOTS = 512;
+    private:
+        struct RampKnot {
+            uint32_t step; //index of a dominant-axis step (0 is the start of the move)
+            int64_t ticks; //time of that step, relative to the start of the move
+        };
+        //state used on every step:
+        std::array<uint32_t, NumAxis> _error; //Bresenham error term of each axis
+        std::array<uint32_t, NumAxis> _numSteps; //number of steps each axis takes during the move
+        uint32_t _dominantSteps; //number of steps taken by the dominant axis (i.e. the number of ticks)
+        uint32_t _tick; //number of ticks that have begun
+        std::size_t _nextAxis; //the next axis to examine during the current tick (NumAxis once the tick is over)
+        std::size_t _dominantAxis;
+        int64_t _ticks; //time of the current tick
+        //interpolation between the knots on either side of the current tick:
+        int64_t _tickInterval; //quotient of the segment's duration / number of steps
+        uint32_t _tickRemainder; //remainder of the same
+        uint32_t _tickError;
+        uint32_t _segmentSteps, _segmentStepsLeft;
+        std::size_t _knot; //the knot at the end of the current segment
+        //state set once per move:
+        std::array<int, NumAxis> _stepSigns; //+1 or -1, the direction of each axis during the move
+        std::array<RampKnot, MAX_RAMP_KNOTS> _ramp;
+        std::size_t _numKnots;
+    public:
+        inline CartesianDda() : _error(), _numSteps(), _dominantSteps(0), _tick(0), _nextAxis(NumAxis), _dominantAxis(0), _ticks(0),
+          _tickInterval(0), _tickRemainder(0), _tickError(0), _segmentSteps(0), _segmentStepsLeft(0), _knot(0), _stepSigns(), _ramp(), _numKnots(0) {}
+        //Prepare a move.
+        //@steps the number of steps each axis takes, signed by their direction.
+        //@ticksAtStep a function object; ticksAtStep(k) must return the time (in clock ticks, relative to the start of the move)
+        //  at which the dominant axis takes its k'th step, for any k in [0, max(abs(steps))]. It must not decrease with k.
+        //@tolerance the largest error (in clock ticks) between the interpolated and true time of a dominant-axis step.
+        //@return false if the ramp table can't meet the tolerance, in which case the move must be stepped some other way.
+        template <typename TicksAtStep> bool begin(const std::array<int, NumAxis> &steps, TicksAtStep ticksAtStep, int64_t tolerance) {
+            for (std::size_t axis=0; axis<NumAxis; ++axis) {
+                _stepSigns[axis] = steps[axis] < 0 ? -1 : 1;
+                _numSteps[axis] = steps[axis] < 0 ? -steps[axis] : steps[axis];
+            }
+            _dominantAxis = dominantAxis(steps);
+            _dominantSteps = _numSteps[_dominantAxis];
+            for (std::size_t axis=0; axis<NumAxis; ++axis) {
+                //starting each error term at half a tick rounds every step to the nearest tick.
+                _error[axis] = _dominantSteps/2;
+            }
+            _tick = 0;
+            _nextAxis = NumAxis;
+            bool isRampComplete = _buildRamp(ticksAtStep, tolerance);
+            _ticks = _ramp[0].ticks;
+            _knot = 0;
+            _segmentStepsLeft = 0;
+            return isRampComplete;
+        }
+        //Advance to the next step. Steps that occur on the same tick are returned in order of their axis.
+        //@return the index of the axis to step, or -1 if the move is complete.
+        inline int nextStep() {
+            while (true) {
+                if (_nextAxis == NumAxis) {
+                    if (_tick == _dominantSteps) {
+                        return -1;
+                    }
+                    ++_tick;
+                    _advanceTime();
+                    _nextAxis = 0;
+                }
+                std::size_t axis = _nextAxis++;
+                if (axis == _dominantAxis) {
+                    return axis;
+                }
+                _error[axis] += _numSteps[axis];
+                if (_error[axis] >= _dominantSteps) {
+                    _error[axis] -= _dominantSteps;
+                    return axis;
+                }
+            }
+        }
+        //@return true if nextStep() has returned every step of the move (i.e. its next call will return -1).
+        inline bool isComplete() const {
+            if (_tick != _dominantSteps) {
+                return false;
+            }
+            //the rest of the final tick's axes may still need to step
+            for (std::size_t axis=_nextAxis; axis<NumAxis; ++axis) {
+                if (axis == _dominantAxis || _error[axis] + _numSteps[axis] >= _dominantSteps) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        //@return the index of the dominant axis: the first of the axes that take the most steps.
+        static inline std::size_t dominantAxis(const std::array<int, NumAxis> &steps) {
+            std::size_t dominant = 0;
+            for (std::size_t axis=1; axis<NumAxis; ++axis) {
+                if (std::abs(steps[axis]) > std::abs(steps[dominant])) {
+                    dominant = axis;
+                }
+            }
+            return dominant;
+        }
+        //@return the time of the step that was last returned by nextStep(), in clock ticks relative to the start of the move.
+        inline int64_t ticks() const {
+            return _ticks;
+        }
+        //@return +1 if the axis steps forward during this move, else -1.
+        inline int stepSign(std::size_t axis) const {
+            return _stepSigns[axis];
+        }
+        //@return the number of knots in the current move's ramp table.
+        inline std::size_t numRampKnots() const {
+            return _numKnots;
+        }
+    private:
+        //advance _ticks to the time of tick #_tick
+        inline void _advanceTime() {
+            if (_segmentStepsLeft == 0) {
+                //begin interpolating towards the next knot. This is the only division, and it occurs once per knot.
+                ++_knot;
+                _segmentSteps = _segmentStepsLeft = _ramp[_knot].step - _ramp[_knot-1].step;
+                int64_t duration = _ramp[_knot].ticks - _ramp[_knot-1].ticks;
+                _tickInterval = duration / _segmentSteps;
+                _tickRemainder = duration % _segmentSteps;
+                _tickError = 0;
+            }
+            _ticks += _tickInterval;
+            _tickError += _tickRemainder;
+            if (_tickError >= _segmentSteps) {
+                _tickError -= _segmentSteps;
+                ++_ticks;
+            }
+            --_segmentStepsLeft;
+        }
+        //fill the ramp table with knots for the current move, until they're within tolerance of ticksAtStep.
+        //@return false if the table ran out of space before meeting the tolerance.
+        template <typename TicksAtStep> bool _buildRamp(TicksAtStep &ticksAtStep, int64_t tolerance) {
+            RampKnot start = { 0, ticksAtStep(0) };
+            _ramp[0] = start;
+            _numKnots = 1;
+            if (_dominantSteps == 0) {
+                return true;
+            }
+            bool isRampComplete = true;
+            //Knots that have been evaluated, but still lie beyond segments that may need to be split, stored in order of decreasing step.
+            //Every segment at least halves the one before it, so the depth is bounded by the number of bits in a step index.
+            std::array<RampKnot, 33> pending;
+            RampKnot end = { _dominantSteps, ticksAtStep(_dominantSteps) };
+            pending[0] = end;
+            std::size_t numPending = 1;
+            //Always split the move into at least 4 segments before checking the tolerance.
+            //  Otherwise, a move that accelerates and then decelerates symmetrically would interpolate perfectly at its midpoint.
+            uint32_t maxUncheckedSpan = _dominantSteps / 4;
+            while (numPending != 0) {
+                const RampKnot &left = _ramp[_numKnots-1];
+                RampKnot right = pending[numPending-1];
+                //make sure the knots never go backwards in time, as the interpolation requires a non-negative remainder.
+                if (right.ticks < left.ticks) {
+                    right.ticks = left.ticks;
+                }
+                uint32_t span = right.step - left.step;
+                //a segment can only be split if there's a step between its ends
+                if (span > 1) {
+                    RampKnot mid = { left.step + span/2, ticksAtStep(left.step + span/2) };
+                    if (span > maxUncheckedSpan || !_isWithinTolerance(left, mid, right, tolerance, ticksAtStep)) {
+                        //there must be room for another knot (including all the pending ones).
+                        if (_numKnots + numPending < MAX_RAMP_KNOTS && numPending < pending.size()) {
+                            pending[numPending++] = mid;
+                            continue;
+                        }
+                        //leave the segment as-is, so the table is still usable (e.g. for tests).
+                        isRampComplete = false;
+                    }
+                }
+                _ramp[_numKnots++] = right;
+                --numPending;
+            }
+            return isRampComplete;
+        }
+        //@return true if interpolating linearly between left & right gives the time of the steps at 1/4, 1/2 and 3/4 of the way between them to within tolerance.
+        template <typename TicksAtStep> static bool _isWithinTolerance(const RampKnot &left, const RampKnot &mid, const RampKnot &right, int64_t tolerance, TicksAtStep &ticksAtStep) {
+            uint32_t span = right.step - left.step;
+            int64_t duration = right.ticks - left.ticks;
+            uint32_t quarter = left.step + span/4;
+            uint32_t threeQuarters = right.step - span/4;
+            return std::llabs(mid.ticks - (left.ticks + duration*(mid.step - left.step)/span)) <= tolerance
+                && std::llabs(ticksAtStep(quarter) - (left.ticks + duration*(quarter - left.step)/span)) <= tolerance
+                && std::llabs(ticksAtStep(threeQuarters) - (left.ticks + duration*(threeQuarters - left.step)/span)) <= tolerance;
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,97 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "constantacceleration.h"
+#include "catch.hpp"
+
+#include <algorithm> //for std::random_shuffle
+#include <cfloat> //for FLT_EPSILON
+#include <vector>
+#include "common/benchmark.h"
+
+//the step times of an axis moving at a constant rate for the whole of a move, as they'd be passed to the AccelerationProfile
+static std::vector<float> evenlySpacedTimes(float duration, int numSteps) {
+    std::vector<float> times;
+    for (int i=1; i<=numSteps; ++i) {
+        times.push_back(duration*i/numSteps);
+    }
+    return times;
+}
+
+//check that transformIncremental() agrees with transformExact() within the bound given in constantacceleration.h
+static void requireWithinErrorBound(motion::ConstantAcceleration &accel, float duration, const std::vector<float> &times) {
+    float endTime = accel.transformExact(duration);
+    for (float time : times) {
+        float exact = accel.transformExact(time);
+        float approx = accel.transformIncremental(time);
+        //the square root being approximated is the time since the start of the move while accelerating, or the time until its end while decelerating.
+        float root = std::min(exact, endTime - exact);
+        bool isWithinBound = std::fabs(approx - exact) <= 1e-6f*root + FLT_EPSILON*exact;
+        REQUIRE(isWithinBound);
+    }
+}
+
+TEST_CASE("ConstantAcceleration::transformIncremental agrees with the exact profile", "[constantacceleration]") {
+    motion::ConstantAcceleration accel(900);
+    SECTION("Moves long enough to reach Vmax") {
+        accel.begin(0.5, 120);
+        requireWithinErrorBound(accel, 0.5, evenlySpacedTimes(0.5, 5000));
+    }
+    SECTION("Short moves that never reach Vmax") {
+        accel.begin(0.05, 120);
+        requireWithinErrorBound(accel, 0.05, evenlySpacedTimes(0.05, 300));
+    }
+    SECTION("Slow moves with few steps") {
+        accel.begin(3, 10);
+        requireWithinErrorBound(accel, 3, evenlySpacedTimes(3, 20));
+    }
+    SECTION("Times that aren't in increasing order") {
+        accel.begin(0.5, 120);
+        std::vector<float> times = evenlySpacedTimes(0.5, 2000);
+        srand(1);
+        std::random_shuffle(times.begin(), times.end());
+        requireWithinErrorBound(accel, 0.5, times);
+    }
+}
+
+//transformIncremental() vs transformExact(), over a move that's mostly accelerating & decelerating.
+TEST_CASE("ConstantAcceleration::transformIncremental benchmark", "[.][benchmark][constantacceleration]") {
+    const float duration = 0.3;
+    const int numSteps = 100000, numMoves = 20;
+    std::vector<float> times = evenlySpacedTimes(duration, numSteps);
+    motion::ConstantAcceleration accel(900);
+    auto transformMoves = [&](bool incremental) {
+        double checksum = 0;
+        for (int move=0; move<numMoves; ++move) {
+            accel.begin(duration, 120);
+            for (float time : times) {
+                checksum += incremental ? accel.transformIncremental(time) : accel.transformExact(time);
+            }
+        }
+        return checksum;
+    };
+    benchmark::Timing incremental = benchmark::measure((long)numSteps*numMoves, [&]() { return transformMoves(true); });
+    benchmark::Timing exact = benchmark::measure((long)numSteps*numMoves, [&]() { return transformMoves(false); });
+    benchmark::logComparison("ConstantAcceleration", "step", "transformIncremental", incremental, "transformExact", exact);
+    REQUIRE(incremental.checksum == Approx(exact.checksum));
+}
@@ -25,9 +25,11 @@
 #ifndef MOTION_CONSTANTACCELERATION_H
 #define MOTION_CONSTANTACCELERATION_H
 
-#include <cmath> //for std::isnan
+#include <cmath> //for std::isnan, std::sqrt, std::fabs
 #include <algorithm> //for std::min
 #include "accelerationprofile.h"
+#include "steptime.h" //for ticksFromSeconds, secondsFromTicks
+#include "compileflags.h" //for USE_INCREMENTAL_ACCEL
 #include "common/logging.h"
 
 namespace motion {
@@ -37,28 +39,103 @@ namespace motion {
  *  v(t) = {at [if at < vmax], vmax [if t < duration-accelTime], vmax - a(t-t1) [if t > duration-accelTime] }
  *
  * Polynomial acceleration profiles turn out to be non-trivial, so only constant, linear, and quadratic acceleration have a closed-form solution (above that requires solving the roots of an n+1 degree polynomial. Event just linear acceleration requires solving a degree 3 polynomial.
+ *
+ * The accelerating & decelerating phases each need a square root of a term that changes only slightly from one step to the next.
+ *   transformExact() computes a sqrt for every step.
+ *   transformIncremental() instead keeps 1/sqrt of the previous step's term and refines it with a single Newton-Raphson (Goldschmidt) iteration,
+ *   which needs only multiplications. If the term has changed too much for that to be accurate (e.g. at the first step of each phase,
+ *   or if times aren't given in increasing order), it falls back to std::sqrt.
+ *   Its result differs from transformExact() by at most 1e-6 times the square root that's being approximated
+ *   (i.e. by < 1e-6 sec for any move that accelerates for less than 1 second), which is far below the resolution of the step timers.
+ * transform() uses transformIncremental() if built with INCREMENTAL_ACCEL=1, else transformExact().
+ *   The iteration is a chain of dependent multiplies, so it's only faster where sqrt is slow and unpipelined;
+ *   on x86 it takes about twice as long as sqrtss (see the benchmark in constantacceleration.cpp).
+ * Times given in EventClockT ticks are transformed likewise, but only the ramps pass through floats; the cruise phase is an integer offset.
  */
 class ConstantAcceleration : public AccelerationProfile {
+    //Largest initial correction accepted by _sqrtFromPrevious. A seed with relative error d gives a correction of about -d,
+    //  and one iteration then leaves a relative error of about 1.5*d^2 (< 4e-7, plus rounding).
+    static constexpr float MAX_SQRT_CORRECTION() { return 1.f/2048; }
     float _accel;
     float moveDuration;
     float tmax1, tmax2;
     float tbase3;
     float twiceVmax_a;
+    float _rsqrt; //approximately 1/sqrt of the most recent term passed to _sqrtFromPrevious
+    //tmax1, tmax2, tbase3 & moveDuration in EventClockT ticks
+    EventClockT::duration _tmax1Ticks, _tmax2Ticks, _tbase3Ticks, _durationTicks;
     inline float a() const { return _accel; }
+    //@return sqrt(x), refined from the reciprocal square root of the previous value of x.
+    inline float _sqrtFromPrevious(float x) {
+        float y = x*_rsqrt; //estimate of sqrt(x)
+        float e = 0.5f - 0.5f*y*_rsqrt; //relative correction to apply to the estimate
+        if (!(std::fabs(e) <= MAX_SQRT_CORRECTION())) { //x isn't close enough to the previous value (also catches NaN & inf)
+            y = std::sqrt(x);
+            _rsqrt = 1.f/y;
+            return y;
+        }
+        _rsqrt += _rsqrt*e;
+        return y + y*e;
+    }
+    //the square root used by transform()
+    inline float _rampSqrt(float x) {
+    #if USE_INCREMENTAL_ACCEL
+        return _sqrtFromPrevious(x);
+    #else
+        return std::sqrt(x);
+    #endif
+    }
     public:
         inline ConstantAcceleration(float accel) : _accel(accel) {}
-        inline void begin(float moveDuration, float Vmax) {
+        //Note: ConstantAcceleration always ramps from and to rest (it reports a junctionDeviation() of 0), so Vstart and Vend are ignored.
+        inline void begin(float moveDuration, float Vmax, float Vstart=0, float Vend=0) {
+            (void)Vstart; (void)Vend; //unused
             this->moveDuration = moveDuration;
             this->tmax1 = Vmax/2/a();
             this->tmax2 = std::isnan(moveDuration) ? INFINITY : moveDuration - Vmax/2/a();
             this->tmax1 = std::min(tmax1, tmax2); //for really short movements, we may not be able to fully accelerate.
             this->tbase3 = moveDuration + Vmax/a(); //TODO: is this the true tbase3 for short movements?
             this->twiceVmax_a = 2*Vmax/a();
+            this->_rsqrt = NAN; //no previous step
+            bool isUnbounded = std::isnan(moveDuration);
+            this->_durationTicks = ticksFromSeconds(moveDuration);
+            this->_tmax2Ticks = isUnbounded ? EventClockT::duration::max() : _durationTicks - ticksFromSeconds(Vmax/2/a());
+            this->_tmax1Ticks = std::min(ticksFromSeconds(Vmax/2/a()), _tmax2Ticks);
+            this->_tbase3Ticks = isUnbounded ? EventClockT::duration::max() : _durationTicks + ticksFromSeconds(Vmax/a());
             LOGD("Accel::begin dur, Vmax: %f, %f\n", moveDuration, Vmax);
             LOGD("Accel::begin tmax1, tmax2, tbase3, twiceVmax_a: %f, %f, %f, %f\n", tmax1, tmax2, tbase3, twiceVmax_a);
         }
-        //float transform(float time, float moveDuration, float Vmax) {
         inline float transform(float time) {
+            LOGV("Accel::transform: %f\n", time);
+        #if USE_INCREMENTAL_ACCEL
+            return transformIncremental(time);
+        #else
+            return transformExact(time);
+        #endif
+        }
+        //transform a time given in EventClockT ticks since the start of the move
+        inline EventClockT::duration transform(EventClockT::duration time) {
+            if (time < _tmax1Ticks) { //accelerating
+                return ticksFromSeconds(_rampSqrt(twiceVmax_a*secondsFromTicks(time)));
+            } else if (time < _tmax2Ticks) { //constant velocity
+                return time + _tmax1Ticks;
+            } else { //decelerating
+                return _tbase3Ticks - ticksFromSeconds(_rampSqrt(twiceVmax_a*secondsFromTicks(_durationTicks - time)));
+            }
+        }
+        //transform @time without a sqrt per step (see class comment). Most accurate when called with increasing times, as the MotionPlanner does.
+        inline float transformIncremental(float time) {
+            if (time < tmax1) { //accelerating
+                return _sqrtFromPrevious(twiceVmax_a*time);
+            } else if (time < tmax2) { //constant velocity
+                return time + tmax1; //convenient reuse of semi-constant.
+            } else { //decelerating. Should never be reached if moveDuration was NAN (ie in homing routine)
+                return tbase3 - _sqrtFromPrevious(twiceVmax_a*(moveDuration-time));
+            }
+        }
+        //reference implementation of transform(), which computes the square roots directly.
+        //float transform(float time, float moveDuration, float Vmax) {
+        inline float transformExact(float time) const {
             /*if (time < Vmax/2/a()) { //accelerating
                 return std::sqrt(2*Vmax/a()*time);
             } else if (time < moveDuration - Vmax/2/a() || std::isnan(moveDuration)) { //constant velocity
@@ -66,7 +143,6 @@ class ConstantAcceleration : public AccelerationProfile {
             } else { //decelerating. Should never be reached if moveDuration is NAN (ie in homing routine)
                 return moveDuration + Vmax/a() - std::sqrt(2*Vmax/a()*(moveDuration-time));
             }*/
-            LOGV("Accel::transform: %f\n", time);
             if (time < tmax1) { //accelerating
                 return std::sqrt(twiceVmax_a*time);
             } else if (time < tmax2) { //constant velocity
@@ -65,6 +65,11 @@ class CoordMap {
         inline static constexpr std::size_t numAxis() {
             return 0;
         }
+        //return true if each axis drives a single cartesian coordinate (axis i moves x, y, z or e, for i = 0, 1, 2, 3) at a constant rate during a line,
+        //  and its AxisSteppers are LinearSteppers. The MotionPlanner can then generate the steps of lines with a CartesianDda.
+        inline static constexpr bool isCartesian() {
+            return false;
+        }
         //Home the machine by sending commands to @interface
         template <typename Interface> void executeHomeRoutine(Interface &interface) {
             interface.resetAxisPositions(getHomePosition(interface.axisPositions()));
@@ -0,0 +1,198 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "cubicstepengine.h"
+#include "lineardeltacoordmap.h"
+#include "angulardeltacoordmap.h"
+#include "catch.hpp"
+
+#include <algorithm> //for std::min, std::max
+#include <cmath> //for std::fabs
+#include <string>
+#include <vector>
+
+#include "common/benchmark.h"
+#include "common/logging.h"
+#include "common/matrix.h"
+#include "iodrivers/a4988.h"
+#include "iodrivers/endstop.h"
+#include "iodrivers/iopin.h"
+
+namespace {
+    using iodrv::A4988;
+    using iodrv::Endstop;
+    using iodrv::IoPin;
+
+    //the kossel's & the firepick delta's coordinate systems, with no pins attached, so that their step streams can be compared for either engine.
+    template <typename StepEngineT> using KosselMap = motion::LinearDeltaCoordMap<A4988, A4988, A4988, A4988, Matrix3x3, motion::LinearDeltaGeometry, StepEngineT>;
+    template <typename StepEngineT> using FirepickMap = motion::AngularDeltaCoordMap<A4988, A4988, A4988, A4988, Matrix3x3, StepEngineT>;
+
+    template <typename StepEngineT> KosselMap<StepEngineT> makeKosselMap() {
+        return KosselMap<StepEngineT>(111.0, 221.0, 467.45, 85.0, 6.265*8, 30.0*16, 10,
+            A4988(IoPin::null(), IoPin::null(), IoPin::null()), A4988(IoPin::null(), IoPin::null(), IoPin::null()),
+            A4988(IoPin::null(), IoPin::null(), IoPin::null()), A4988(IoPin::null(), IoPin::null(), IoPin::null()),
+            Endstop(), Endstop(), Endstop(), Matrix3x3::identity());
+    }
+    template <typename StepEngineT> FirepickMap<StepEngineT> makeFirepickMap() {
+        return FirepickMap<StepEngineT>(131.636, 190.526, 270.0, 90.0, 268.0, 150.0, 200.0*32*150/16/360, 30.0*16, 10, -67.2,
+            A4988(IoPin::null(), IoPin::null(), IoPin::null()), A4988(IoPin::null(), IoPin::null(), IoPin::null()),
+            A4988(IoPin::null(), IoPin::null(), IoPin::null()), A4988(IoPin::null(), IoPin::null(), IoPin::null()),
+            Endstop(), Endstop(), Endstop(), Matrix3x3::identity());
+    }
+
+    struct Step {
+        float time;
+        motion::StepDirection direction;
+    };
+    //a path through cartesian space, beginning at the effector's position, which lasts for @duration seconds.
+    struct TestPath {
+        bool isArc;
+        Vector4f vel; //for lines
+        Vector3f centerOffset, u, v; //for arcs: center = start position + centerOffset
+        float arcRad, arcVel;
+        float duration;
+    };
+    inline TestPath line(const Vector4f &vel, float duration) {
+        return TestPath{ false, vel, Vector3f(), Vector3f(), Vector3f(), 0, 0, duration };
+    }
+    //an arc in the xy plane, beginning at angle 0 on a circle of radius @arcRad
+    inline TestPath arc(float arcRad, float arcVel, float duration) {
+        return TestPath{ true, Vector4f(), Vector3f(-arcRad, 0, 0), Vector3f(1, 0, 0), Vector3f(0, 1, 0), arcRad, arcVel, duration };
+    }
+
+    template <typename MapT, typename AxisSteppersT> void beginPath(const MapT &map, AxisSteppersT &steppers, const std::array<int, 4> &startPos, const TestPath &path) {
+        if (path.isArc) {
+            Vector3f center = map.xyzeFromMechanical(startPos).xyz() + path.centerOffset;
+            motion::AxisStepper::initAxisArcSteppers(steppers, false, map, startPos, center, path.u, path.v, path.arcRad, path.arcVel, 0);
+        } else {
+            motion::AxisStepper::initAxisSteppers(steppers, false, map, startPos, path.vel);
+        }
+    }
+    //all steps of one axis that occur up to @endTime
+    template <typename AxisStepperT> std::vector<Step> collectSteps(AxisStepperT &stepper, float endTime) {
+        std::vector<Step> steps;
+        while (stepper.time != motion::AxisStepper::NO_STEP() && motion::secondsFromTicks(stepper.time) <= endTime) {
+            steps.push_back(Step{ motion::secondsFromTicks(stepper.time), stepper.direction });
+            stepper._nextStep(false);
+        }
+        return steps;
+    }
+
+    //Accuracy checker: compares the step streams of the 3 delta axes when driven by the CubicStepEngine to those of the exact solver.
+    struct StreamComparison {
+        long numSteps;
+        //whether every step of the exact stream was matched by a step in the same direction from the cubic stream
+        bool sameSequence;
+        //the greatest error in any step time, as a fraction of the time between that step & the previous one (i.e. approximately in steps)
+        float maxError;
+    };
+    inline void compareAxis(const std::vector<Step> &exact, const std::vector<Step> &cubic, StreamComparison &result) {
+        //a step right at the end of the path may fall on either side of it, so only the exact stream's steps need to be matched.
+        if (cubic.size() < exact.size()) {
+            result.sameSequence = false;
+        }
+        for (std::size_t i=0; i<std::min(exact.size(), cubic.size()); ++i) {
+            float interval = exact[i].time - (i ? exact[i-1].time : 0.f);
+            result.sameSequence = result.sameSequence && exact[i].direction == cubic[i].direction;
+            result.maxError = std::max(result.maxError, std::fabs(cubic[i].time - exact[i].time) / interval);
+        }
+        result.numSteps += exact.size();
+    }
+    template <typename ExactMapT, typename CubicMapT> StreamComparison compareStepStreams(const ExactMapT &exactMap, const CubicMapT &cubicMap,
+      const std::array<int, 4> &startPos, const TestPath &path) {
+        auto exactSteppers = exactMap.getAxisSteppers();
+        auto cubicSteppers = cubicMap.getAxisSteppers();
+        beginPath(exactMap, exactSteppers, startPos, path);
+        beginPath(cubicMap, cubicSteppers, startPos, path);
+        float cubicEnd = path.duration*1.01f;
+        StreamComparison result = { 0, true, 0 };
+        compareAxis(collectSteps(std::get<0>(exactSteppers), path.duration), collectSteps(std::get<0>(cubicSteppers), cubicEnd), result);
+        compareAxis(collectSteps(std::get<1>(exactSteppers), path.duration), collectSteps(std::get<1>(cubicSteppers), cubicEnd), result);
+        compareAxis(collectSteps(std::get<2>(exactSteppers), path.duration), collectSteps(std::get<2>(cubicSteppers), cubicEnd), result);
+        return result;
+    }
+    //compute every step of the 3 delta axes over the path, @repetitions times.
+    //@return the number of steps
+    template <typename MapT> double countSteps(const MapT &map, const std::array<int, 4> &startPos, const TestPath &path, int repetitions) {
+        auto steppers = map.getAxisSteppers();
+        long numSteps = 0;
+        for (int i=0; i<repetitions; ++i) {
+            beginPath(map, steppers, startPos, path);
+            numSteps += collectSteps(std::get<0>(steppers), path.duration).size();
+            numSteps += collectSteps(std::get<1>(steppers), path.duration).size();
+            numSteps += collectSteps(std::get<2>(steppers), path.duration).size();
+        }
+        return numSteps;
+    }
+    template <typename ExactMapT, typename CubicMapT> void benchmarkStepEngines(const char *machine, const ExactMapT &exactMap, const CubicMapT &cubicMap,
+      const std::array<int, 4> &startPos, const TestPath &path) {
+        const int repetitions = 20;
+        long numSteps = (long)countSteps(exactMap, startPos, path, 1)*repetitions;
+        REQUIRE(numSteps > 0);
+        benchmark::Timing exact = benchmark::measure(numSteps, [&]() { return countSteps(exactMap, startPos, path, repetitions); });
+        benchmark::Timing cubic = benchmark::measure(numSteps, [&]() { return countSteps(cubicMap, startPos, path, repetitions); });
+        benchmark::logComparison(std::string("CubicStepEngine, ") + machine + (path.isArc ? " arc" : " line"), "step", "exact", exact, "cubic", cubic);
+        //a step right at the end of the path may fall on either side of it (for each of the 3 axes)
+        bool isSameCount = std::fabs(cubic.checksum - exact.checksum) <= 3*repetitions;
+        REQUIRE(isSameCount);
+    }
+
+    const TestPath testPaths[] = {
+        line(Vector4f(30, -20, -40, 0), 1.0), //a downward diagonal
+        line(Vector4f(0, 60, 0, 0), 2.0), //horizontally through the center & out again
+        arc(20, 2.5, 2.0), //most of a circle, at 50 mm/sec
+        arc(60, 0.5, 4.0) //a slower, wider arc
+    };
+}
+
+TEST_CASE("CubicStepEngine's step streams match the exact solver", "[cubicstepengine]") {
+    auto exactKossel = makeKosselMap<motion::ExactStepEngine>();
+    auto cubicKossel = makeKosselMap<motion::CubicStepEngine>();
+    auto exactFirepick = makeFirepickMap<motion::ExactStepEngine>();
+    auto cubicFirepick = makeFirepickMap<motion::CubicStepEngine>();
+    for (const TestPath &path : testPaths) {
+        //the kossel starts from its endstops, the firepick with its arms horizontal
+        StreamComparison kossel = compareStepStreams(exactKossel, cubicKossel, exactKossel.getHomePosition(std::array<int, 4>()), path);
+        StreamComparison firepick = compareStepStreams(exactFirepick, cubicFirepick, std::array<int, 4>(), path);
+        LOG("CubicStepEngine: kossel %ld steps, max error %f steps; firepick %ld steps, max error %f steps\n",
+            kossel.numSteps, kossel.maxError, firepick.numSteps, firepick.maxError);
+        for (const StreamComparison &result : { kossel, firepick }) {
+            REQUIRE(result.numSteps > 1000);
+            REQUIRE(result.sameSequence);
+            //the exact solver's own float rounding accounts for the rest
+            REQUIRE(result.maxError <= motion::CubicStepEngine::MAX_ERROR() + 1.f/256);
+        }
+    }
+}
+
+//The step rate of the two engines over lines & arcs.
+TEST_CASE("CubicStepEngine benchmark", "[.][benchmark][cubicstepengine]") {
+    auto exactKossel = makeKosselMap<motion::ExactStepEngine>();
+    auto cubicKossel = makeKosselMap<motion::CubicStepEngine>();
+    auto exactFirepick = makeFirepickMap<motion::ExactStepEngine>();
+    auto cubicFirepick = makeFirepickMap<motion::CubicStepEngine>();
+    for (const TestPath &path : testPaths) {
+        benchmarkStepEngines("kossel", exactKossel, cubicKossel, exactKossel.getHomePosition(std::array<int, 4>()), path);
+        benchmarkStepEngines("firepick", exactFirepick, cubicFirepick, std::array<int, 4>(), path);
+    }
+}
@@ -0,0 +1,210 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+ 
+#ifndef MOTION_CUBICSTEPENGINE_H
+#define MOTION_CUBICSTEPENGINE_H
+
+#include <cmath> //for std::fabs, std::sqrt, NAN
+#include <algorithm> //for std::swap
+#include "axisstepper.h" //for StepDirection
+
+namespace motion {
+
+/*
+ * The delta AxisSteppers (LinearDeltaStepper, AngularDeltaStepper) can find their step times in one of two ways, chosen per machine
+ *   via a template parameter of their CoordMap:
+ *
+ * ExactStepEngine solves the inverse kinematics exactly for every step position (a quadratic for lines, and a pair of atan2s for arcs).
+ */
+struct ExactStepEngine {};
+
+/*
+ * CubicStepEngine instead approximates the position of the axis over the move by a chain of cubic polynomials (cubic Hermite pieces),
+ *   and finds the times at which that crosses each step position with a few Newton iterations.
+ *   The exact kinematics are only evaluated at the ends & midpoint of each piece, and a piece typically spans dozens of steps.
+ *
+ * Each piece matches the exact position & velocity at both of its ends. The interpolation error of such a piece is
+ *   f''''(x)/4! * (t-t0)^2 * (t-t1)^2, which is greatest at the midpoint, so each piece is halved until the error there is below MAX_ERROR()/2
+ *   (the remaining margin covers variation in f'''' over the piece). Every step is therefore placed at a time when the axis is within
+ *   MAX_ERROR() steps of where it should be. Each successful piece is used to size the next one.
+ *
+ * The position is given by a function object, f(t, vel), which returns the exact position of the axis at time t (in steps, relative to its
+ *   position at the start of the move) and sets vel to its velocity (in steps/sec). It returns NAN if the axis can't reach that point.
+ * Note: the AxisSteppers aren't told the duration of the move (the MotionPlanner ends it); pieces are fit as far as the steps are requested.
+ */
+class CubicStepEngine {
+    //the current piece, p(tau) = c0 + c1*tau + c2*tau^2 + c3*tau^3, where tau = t - pieceStart is in [0, pieceLen]
+    float c0, c1, c2, c3;
+    float pieceStart, pieceLen;
+    //the piece is split into (up to 3) intervals over which it is monotonic, ending at segEnds[i], where p = segEndPos[i] and sign(p') = segDir[i]
+    float segEnds[3], segEndPos[3];
+    int segDir[3];
+    int numSegs, seg;
+    //exact position & velocity at the end of the piece (i.e. the start of the next one)
+    float endPos, endVel;
+    //length of the next piece to try
+    float nextLen;
+    public:
+        //maximum distance (in steps) between the axis' exact position & the cubic approximation
+        static constexpr float MAX_ERROR() { return 1.f/64; }
+        //a step is placed once the cubic is within this many steps of the step position
+        static constexpr float SOLVE_TOLERANCE() { return 1.f/1024; }
+        //the first piece is sized to cover this many steps
+        static constexpr float FIRST_PIECE_STEPS() { return 64; }
+        //no more steps are produced if a piece can't be fit within this length (e.g. the axis can't reach the path), or beyond this time (both in seconds)
+        static constexpr float MIN_PIECE_LEN() { return 1e-6f; }
+        static constexpr float MAX_TIME() { return 1e5f; }
+        //begin a move (the axis is at position 0, time 0)
+        template <typename PositionFuncT> void begin(PositionFuncT f) {
+            float vel;
+            float pos = f(0, vel);
+            nextLen = std::fabs(vel) > FIRST_PIECE_STEPS() ? FIRST_PIECE_STEPS()/std::fabs(vel) : 1.f;
+            _fitPiece(f, 0, pos, vel);
+        }
+        //find the step that follows the one at @time, where the axis was at @pos.
+        //@return the time of the step (or NAN if there are no more), and update pos & dir to the position & direction of that step.
+        template <typename PositionFuncT> float nextStep(PositionFuncT f, int &pos, float time, StepDirection &dir) {
+            float tau = time - pieceStart;
+            while (true) {
+                if (!(pieceLen > 0)) {
+                    return NAN; //couldn't fit the piece
+                }
+                while (seg < numSegs-1 && segEnds[seg] <= tau) {
+                    ++seg;
+                }
+                //the next step is either 1 ahead of the axis in the direction it's moving, or isn't in this interval.
+                int target = pos + segDir[seg];
+                if (segDir[seg] != 0 && segDir[seg]*(segEndPos[seg] - target) >= 0) {
+                    pos = target;
+                    dir = stepDirFromSign(segDir[seg]);
+                    return pieceStart + _solve(tau, segEnds[seg], target, segDir[seg]);
+                }
+                if (seg < numSegs-1) {
+                    tau = segEnds[seg];
+                    ++seg;
+                } else {
+                    _fitPiece(f, pieceStart + pieceLen, endPos, endVel);
+                    tau = 0;
+                }
+            }
+        }
+    private:
+        inline float _eval(float tau) const {
+            return c0 + tau*(c1 + tau*(c2 + tau*c3));
+        }
+        inline float _evalVel(float tau) const {
+            return c1 + tau*(2*c2 + tau*3*c3);
+        }
+        //fit the next piece, beginning at time t0 where the exact position & velocity are p0 & v0
+        template <typename PositionFuncT> void _fitPiece(PositionFuncT f, float t0, float p0, float v0) {
+            float h = nextLen;
+            pieceStart = t0;
+            pieceLen = NAN;
+            while (h >= MIN_PIECE_LEN() && t0 < MAX_TIME()) {
+                float v1;
+                float p1 = f(t0 + h, v1);
+                //Hermite interpolation: p(0) = p0, p'(0) = v0, p(h) = p1, p'(h) = v1
+                float dp = p1 - p0;
+                c0 = p0;
+                c1 = v0;
+                c2 = (3*dp - h*(2*v0 + v1))/(h*h);
+                c3 = (h*(v0 + v1) - 2*dp)/(h*h*h);
+                float vMid;
+                float err = std::fabs(f(t0 + 0.5f*h, vMid) - _eval(0.5f*h));
+                if (err <= 0.5f*MAX_ERROR()) { //false if any evaluation was NAN
+                    pieceLen = h;
+                    endPos = p1;
+                    endVel = v1;
+                    //the error scales with h^4, so doubling the piece is safe if the error is well below the limit.
+                    nextLen = err < MAX_ERROR()/64 ? 2*h : h;
+                    _findMonotonicSegments();
+                    return;
+                }
+                h *= 0.5f;
+            }
+        }
+        //split the piece at the roots of p'(tau) = c1 + 2*c2*tau + 3*c3*tau^2 within (0, pieceLen)
+        void _findMonotonicSegments() {
+            float a = 3*c3, b = 2*c2, c = c1;
+            float roots[2];
+            int numRoots = 0;
+            if (a == 0) {
+                if (b != 0) {
+                    roots[numRoots++] = -c/b;
+                }
+            } else {
+                float disc = b*b - 4*a*c;
+                if (disc > 0) {
+                    //numerically stable form of the quadratic formula
+                    float q = -0.5f*(b + (b < 0 ? -std::sqrt(disc) : std::sqrt(disc)));
+                    roots[numRoots++] = q/a;
+                    if (q != 0) {
+                        roots[numRoots++] = c/q;
+                    }
+                }
+            }
+            if (numRoots == 2 && roots[1] < roots[0]) {
+                std::swap(roots[0], roots[1]);
+            }
+            numSegs = 0;
+            for (int i=0; i<numRoots; ++i) {
+                if (roots[i] > 0 && roots[i] < pieceLen) {
+                    segEnds[numSegs++] = roots[i];
+                }
+            }
+            segEnds[numSegs++] = pieceLen;
+            for (int i=0; i<numSegs; ++i) {
+                float segStart = i ? segEnds[i-1] : 0.f;
+                float vMid = _evalVel(0.5f*(segStart + segEnds[i]));
+                segDir[i] = vMid > 0 ? 1 : (vMid < 0 ? -1 : 0);
+                segEndPos[i] = _eval(segEnds[i]);
+            }
+            seg = 0;
+        }
+        //find tau in (lo, hi] at which p(tau) == target, given that p is monotonic over [lo, hi] in the direction @dir, and reaches target by hi.
+        //Newton's method, falling back to bisection whenever it would leave the bracket.
+        inline float _solve(float lo, float hi, float target, int dir) const {
+            float x = lo;
+            float g = _eval(x) - target;
+            float dg = _evalVel(x);
+            for (int i=0; i<16; ++i) {
+                if (std::fabs(g) <= SOLVE_TOLERANCE()) {
+                    break;
+                }
+                if (g*dir < 0) {
+                    lo = x;
+                } else {
+                    hi = x;
+                }
+                float next = x - g/dg;
+                x = (next > lo && next < hi) ? next : 0.5f*(lo + hi);
+                g = _eval(x) - target;
+                dg = _evalVel(x);
+            }
+            return x;
+        }
+};
+
+}
+
+#endif
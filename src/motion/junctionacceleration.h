@@ -0,0 +1,163 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MOTION_JUNCTIONACCELERATION_H
+#define MOTION_JUNCTIONACCELERATION_H
+
+#include <cmath> //for std::isnan, std::sqrt
+#include <algorithm> //for std::min, std::max
+#include "accelerationprofile.h"
+#include "steptime.h" //for ticksFromSeconds, secondsFromTicks
+#include "common/logging.h"
+
+namespace motion {
+
+/* 
+ * JunctionAcceleration is an implementation of motion::AccelerationProfile with constant acceleration (a trapezoidal velocity profile),
+ *   but which may enter and exit a move at non-zero velocities (Vstart, Vend) as decided by the lookahead planner.
+ * This allows consecutive moves to be chained together without coming to a stop at each vertex.
+ *
+ *   v(t) = {Vstart + at [accelerating], Vmax [cruising], Vend + a(tend-t) [decelerating]}
+ *
+ * Short moves may not be able to reach Vmax, in which case the cruise phase is skipped and the peak velocity is
+ *   Vpeak = sqrt(a*L + (Vstart^2 + Vend^2)/2), where L is the length of the move.
+ *
+ * The step times given to transform() correspond to a path traversed at a constant Vmax, so a step at time t is at distance s = Vmax*t.
+ * We solve s(T) for the real time, T:
+ *   accelerating: s = Vstart*T + a/2*T^2           => T = (sqrt(Vstart^2 + 2as) - Vstart)/a
+ *   cruising:     s = s1 + Vmax*(T-T1)              => T = T1 + (s-s1)/Vmax
+ *   decelerating: L-s = Vend*(Tend-T) + a/2*(Tend-T)^2 => T = Tend - (sqrt(Vend^2 + 2a(L-s)) - Vend)/a
+ * When given EventClockT ticks, the cruise phase is just an integer offset, and the ramps are solved in float seconds
+ *   relative to their own start or end, so long moves keep the full resolution of the clock.
+ */
+class JunctionAcceleration : public AccelerationProfile {
+    float _accel;
+    float _junctionDeviation;
+    float moveDuration;
+    //if the move has no cartesian component (e.g. extrusion only), then there's nothing to accelerate.
+    bool isIdentity;
+    //boundaries of the accelerating and decelerating phases, in terms of the (untransformed) input time
+    float tmax1, tmax2;
+    //real time at which the acceleration phase ends, and at which the move completes
+    float T1, Tend;
+    float Vmax, VstartSq, VendSq;
+    float Vstart_a, Vend_a;
+    //2*a*Vmax, used to convert an input time into 2*a*distance
+    float twoAVmax;
+    float inv_a;
+    //tmax1, tmax2, T1, Tend & moveDuration in EventClockT ticks
+    EventClockT::duration _tmax1Ticks, _tmax2Ticks, _T1Ticks, _TendTicks, _durationTicks;
+    inline float a() const { return _accel; }
+    //@return the time since the start of the move at which the constant-velocity time @time is reached, for time < tmax1
+    inline float _rampUp(float time) const {
+        return std::sqrt(VstartSq + twoAVmax*time)*inv_a - Vstart_a;
+    }
+    //@return the time before the end of the move at which @remaining constant-velocity time is left, once past tmax2
+    inline float _rampDown(float remaining) const {
+        return std::sqrt(VendSq + twoAVmax*std::max(0.f, remaining))*inv_a - Vend_a;
+    }
+    public:
+        //@accel maximum cartesian acceleration, in mm/sec^2
+        //@junctionDeviation distance (mm) the effector may deviate from a sharp corner; larger values allow faster cornering.
+        //  See motion/lookaheadplanner.h for how this is used.
+        inline JunctionAcceleration(float accel, float junctionDeviation) 
+          : _accel(accel), _junctionDeviation(junctionDeviation) {}
+        inline float maxAcceleration() const {
+            return _accel;
+        }
+        inline float junctionDeviation() const {
+            return _junctionDeviation;
+        }
+        inline void begin(float moveDuration, float Vmax, float Vstart=0, float Vend=0) {
+            this->moveDuration = moveDuration;
+            this->isIdentity = !(Vmax > 0);
+            if (isIdentity) {
+                return;
+            }
+            //moves with a NAN duration (homing) never decelerate.
+            bool isUnbounded = std::isnan(moveDuration);
+            float length = Vmax*moveDuration;
+            Vend = isUnbounded ? Vmax : Vend;
+            float s1 = (Vmax*Vmax - Vstart*Vstart)/(2*a());
+            float s3 = (Vmax*Vmax - Vend*Vend)/(2*a());
+            float Vpeak = Vmax;
+            if (!isUnbounded && s1 + s3 > length) {
+                //for really short movements, we may not be able to fully accelerate.
+                //Note: the lookahead guarantees |Vend^2 - Vstart^2| <= 2aL, so Vpeak >= max(Vstart, Vend) except for rounding errors.
+                Vpeak = std::max(std::sqrt(a()*length + 0.5f*(Vstart*Vstart + Vend*Vend)), std::max(Vstart, Vend));
+                s1 = std::min(length, (Vpeak*Vpeak - Vstart*Vstart)/(2*a()));
+                s3 = length - s1;
+            }
+            this->Vmax = Vmax;
+            this->tmax1 = s1/Vmax;
+            this->tmax2 = isUnbounded ? INFINITY : (length - s3)/Vmax;
+            this->T1 = (Vpeak - Vstart)/a();
+            this->Tend = T1 + (tmax2 - tmax1) + (Vpeak - Vend)/a();
+            this->VstartSq = Vstart*Vstart;
+            this->VendSq = Vend*Vend;
+            this->Vstart_a = Vstart/a();
+            this->Vend_a = Vend/a();
+            this->twoAVmax = 2*a()*Vmax;
+            this->inv_a = 1.f/a();
+            this->_durationTicks = ticksFromSeconds(moveDuration);
+            this->_tmax1Ticks = ticksFromSeconds(tmax1);
+            this->_T1Ticks = ticksFromSeconds(T1);
+            if (isUnbounded) {
+                this->_tmax2Ticks = this->_TendTicks = EventClockT::duration::max();
+            } else {
+                this->_tmax2Ticks = std::max(_tmax1Ticks, _durationTicks - ticksFromSeconds(s3/Vmax));
+                this->_TendTicks = _T1Ticks + (_tmax2Ticks - _tmax1Ticks) + ticksFromSeconds((Vpeak - Vend)/a());
+            }
+            LOGD("JunctionAccel::begin dur, Vmax, Vstart, Vend: %f, %f, %f, %f\n", moveDuration, Vmax, Vstart, Vend);
+            LOGD("JunctionAccel::begin tmax1, tmax2, T1, Tend: %f, %f, %f, %f\n", tmax1, tmax2, T1, Tend);
+        }
+        inline float transform(float time) {
+            LOGV("JunctionAccel::transform: %f\n", time);
+            if (isIdentity) {
+                return time;
+            } else if (time < tmax1) { //accelerating
+                return _rampUp(time);
+            } else if (time < tmax2) { //constant velocity
+                return T1 + (time - tmax1);
+            } else { //decelerating. Should never be reached if moveDuration was NAN (ie in homing routine)
+                return Tend - _rampDown(moveDuration - time);
+            }
+        }
+        //transform a time given in EventClockT ticks since the start of the move
+        inline EventClockT::duration transform(EventClockT::duration time) {
+            if (isIdentity) {
+                return time;
+            } else if (time < _tmax1Ticks) { //accelerating
+                return ticksFromSeconds(_rampUp(secondsFromTicks(time)));
+            } else if (time < _tmax2Ticks) { //constant velocity
+                return _T1Ticks + (time - _tmax1Ticks);
+            } else { //decelerating
+                return _TendTicks - ticksFromSeconds(_rampDown(secondsFromTicks(_durationTicks - time)));
+            }
+        }
+};
+
+}
+
+#endif
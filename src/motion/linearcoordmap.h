@@ -102,6 +102,9 @@ template <typename Stepper1, typename Stepper2, typename Stepper3, typename Step
         inline static constexpr std::size_t numAxis() {
             return 4; //A, B, C + Extruder
         }
+        inline static constexpr bool isCartesian() {
+            return true;
+        }
         inline int getAxisPosition(const std::array<int, 4> &cur, std::size_t axis) const {
             return cur[axis];
         }
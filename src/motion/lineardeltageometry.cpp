@@ -0,0 +1,46 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "lineardeltageometry.h"
+#include "catch.hpp"
+
+//the kossel's dimensions, including a steps/mm that isn't exactly representable in thousandths before rounding.
+typedef motion::ConstLinearDeltaGeometry<motion::milli(111.0), motion::milli(221.0), motion::milli(467.45), motion::milli(85.0), 
+    motion::milli(6.265*8), motion::milli(30.0*16)> TestConstGeometry;
+
+//all dimensions must be usable in constant expressions
+static_assert(TestConstGeometry::L()*TestConstGeometry::L() == 221.f*221.f, "ConstLinearDeltaGeometry::L() must be constexpr");
+static_assert(motion::milli(-1.0005) == -1001 && motion::milli(0.0004) == 0, "milli() must round to the nearest thousandth");
+
+TEST_CASE("ConstLinearDeltaGeometry matches the equivalent runtime LinearDeltaGeometry", "[lineardeltageometry]") {
+    motion::LinearDeltaGeometry runtime(111.0, 221.0, 467.45, 85.0, 6.265*8, 30.0*16);
+    TestConstGeometry constant;
+    REQUIRE(constant.r() == runtime.r());
+    REQUIRE(constant.L() == runtime.L());
+    REQUIRE(constant.h() == runtime.h());
+    REQUIRE(constant.buildrad() == runtime.buildrad());
+    REQUIRE(constant.STEPS_MM() == runtime.STEPS_MM());
+    REQUIRE(constant.MM_STEPS() == runtime.MM_STEPS());
+    REQUIRE(constant.STEPS_MM_EXT() == runtime.STEPS_MM_EXT());
+    REQUIRE(constant.MM_STEPS_EXT() == runtime.MM_STEPS_EXT());
+}
@@ -0,0 +1,81 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MOTION_LINEARDELTAGEOMETRY_H
+#define MOTION_LINEARDELTAGEOMETRY_H
+
+namespace motion {
+
+/* 
+ * LinearDeltaGeometry holds the dimensions of a LinearDelta machine that the kinematics depend upon (see LinearDeltaCoordMap):
+ *   the distance r from the center of the bed to each tower, the rod length L, the endstop height h, the radius of the build plate,
+ *   and the steps/mm of the carriages & the extruder.
+ * These are ordinary runtime values, so they can be changed without recompiling (e.g. for machines that are calibrated at runtime).
+ * Machines whose dimensions are fixed in the machine header can use ConstLinearDeltaGeometry instead.
+ */
+class LinearDeltaGeometry {
+    float _r, _L, _h, _buildrad;
+    float _STEPS_MM, _MM_STEPS;
+    float _STEPS_MM_EXT, _MM_STEPS_EXT;
+    public:
+        inline LinearDeltaGeometry(float r, float L, float h, float buildrad, float STEPS_MM, float STEPS_MM_EXT)
+         : _r(r), _L(L), _h(h), _buildrad(buildrad),
+           _STEPS_MM(STEPS_MM), _MM_STEPS(1. / STEPS_MM),
+           _STEPS_MM_EXT(STEPS_MM_EXT), _MM_STEPS_EXT(1. / STEPS_MM_EXT) {}
+        inline float r() const { return _r; }
+        inline float L() const { return _L; }
+        inline float h() const { return _h; }
+        inline float buildrad() const { return _buildrad; }
+        inline float STEPS_MM() const { return _STEPS_MM; }
+        inline float MM_STEPS() const { return _MM_STEPS; }
+        inline float STEPS_MM_EXT() const { return _STEPS_MM_EXT; }
+        inline float MM_STEPS_EXT() const { return _MM_STEPS_EXT; }
+};
+
+/* 
+ * ConstLinearDeltaGeometry is the compile-time equivalent of LinearDeltaGeometry.
+ * All of its accessors are constexpr and it holds no state, so the kinematics math folds the machine's dimensions into constants
+ *   (e.g. L()*L() and the carriage height of each step position no longer need to be loaded from memory).
+ * Template parameters cannot be floats, so each dimension is given in thousandths of its unit:
+ *   R1000 is 'r' (in mm) multiplied by 1000, L1000 is 'L' (in mm) multiplied by 1000, etc.
+ *   milli() rounds a value from the machine header to this representation.
+ */
+template <long R1000, long L1000, long H1000, long BUILDRAD1000, long STEPS_MM1000, long STEPS_MM_EXT1000> struct ConstLinearDeltaGeometry {
+    static constexpr float r() { return R1000 / 1000.f; }
+    static constexpr float L() { return L1000 / 1000.f; }
+    static constexpr float h() { return H1000 / 1000.f; }
+    static constexpr float buildrad() { return BUILDRAD1000 / 1000.f; }
+    static constexpr float STEPS_MM() { return STEPS_MM1000 / 1000.f; }
+    static constexpr float MM_STEPS() { return 1. / STEPS_MM(); }
+    static constexpr float STEPS_MM_EXT() { return STEPS_MM_EXT1000 / 1000.f; }
+    static constexpr float MM_STEPS_EXT() { return 1. / STEPS_MM_EXT(); }
+};
+
+//round @x to the nearest thousandth, as used for the template parameters of ConstLinearDeltaGeometry.
+constexpr long milli(double x) {
+    return x < 0 ? (long)(x*1000 - 0.5) : (long)(x*1000 + 0.5);
+}
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "lineardeltasolver.h"
+#include "catch.hpp"
+#include "common/benchmark.h"
+#include <cmath>
+
+//a move on a kossel-sized delta that passes near the tower, so that some positions are never reached.
+static motion::LinearDeltaLineSolver makeTestSolver() {
+    return motion::LinearDeltaLineSolver(Vector3f(-20, -100, 5), Vector3f(30, 40, -10), 221, 200, 0.05);
+}
+
+TEST_CASE("LinearDeltaLineSolver's SIMD path matches the scalar path", "[lineardeltasolver]") {
+    auto solver = makeTestSolver();
+    //use an odd count to exercise the scalar tail of the SIMD path
+    const int numPos = 1003;
+    float scalar1[numPos], scalar2[numPos], simd1[numPos], simd2[numPos];
+    solver.solveScalar(-500, numPos, scalar1, scalar2);
+    solver.solve(-500, numPos, simd1, simd2);
+    int numInvalid = 0;
+    for (int i=0; i<numPos; ++i) {
+        REQUIRE(std::isnan(scalar1[i]) == std::isnan(simd1[i]));
+        REQUIRE(std::isnan(scalar2[i]) == std::isnan(simd2[i]));
+        if (std::isnan(scalar1[i])) {
+            ++numInvalid;
+        } else {
+            //ARMv7 NEON approximates the sqrt, so allow a small absolute error (in seconds)
+            bool isRoot1Close = std::fabs(scalar1[i] - simd1[i]) < 1e-5f;
+            bool isRoot2Close = std::fabs(scalar2[i] - simd2[i]) < 1e-5f;
+            REQUIRE(isRoot1Close);
+            REQUIRE(isRoot2Close);
+            REQUIRE(simd1[i] <= simd2[i]);
+        }
+    }
+    //make sure the test actually covers the positions the carriage never reaches
+    REQUIRE(numInvalid > 0);
+    REQUIRE(numInvalid < numPos);
+}
+
+//The SIMD path vs the scalar path.
+TEST_CASE("LinearDeltaLineSolver benchmark", "[.][benchmark][lineardeltasolver]") {
+    auto solver = makeTestSolver();
+    //solve batches of the size that LinearDeltaStepper uses, over positions that the carriage does reach
+    const int numPos = AXIS_STEPPER_BATCH_SIZE+2;
+    const int numIters = 1000000;
+    float root1[numPos], root2[numPos];
+    benchmark::Timing scalar = benchmark::measure((long)numIters*numPos, [&]() {
+        double checksum = 0;
+        for (int i=0; i<numIters; ++i) {
+            solver.solveScalar(-(i%200), numPos, root1, root2);
+            checksum += root2[i%numPos];
+        }
+        return checksum;
+    });
+    benchmark::Timing simd = benchmark::measure((long)numIters*numPos, [&]() {
+        double checksum = 0;
+        for (int i=0; i<numIters; ++i) {
+            solver.solve(-(i%200), numPos, root1, root2);
+            checksum += root2[i%numPos];
+        }
+        return checksum;
+    });
+    benchmark::logComparison("LinearDeltaLineSolver", "position", "scalar", scalar,
+        LINEARDELTASOLVER_NEON ? "NEON" : (LINEARDELTASOLVER_SSE ? "SSE" : "scalar"), simd);
+    //each root may differ by as much as in the test above
+    bool isSimdClose = std::fabs(simd.checksum - scalar.checksum) <= 1e-5*numIters;
+    REQUIRE(isSimdClose);
+}
@@ -0,0 +1,161 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MOTION_LINEARDELTASOLVER_H
+#define MOTION_LINEARDELTASOLVER_H
+
+#include <cmath> //for std::sqrt, NAN
+#include <algorithm> //for std::max
+#include "compileflags.h" //for USE_SIMD
+#include "common/vector3.h"
+
+//Choose the SIMD implementation, if any, at compile time. Pass USE_SIMD=0 to make to always use the scalar code.
+#if USE_SIMD && (defined(__ARM_NEON__) || defined(__ARM_NEON))
+    #include <arm_neon.h>
+    #define LINEARDELTASOLVER_NEON 1
+    #define LINEARDELTASOLVER_SSE 0
+#elif USE_SIMD && defined(__SSE2__)
+    #include <emmintrin.h>
+    #define LINEARDELTASOLVER_NEON 0
+    #define LINEARDELTASOLVER_SSE 1
+#else
+    #define LINEARDELTASOLVER_NEON 0
+    #define LINEARDELTASOLVER_SSE 0
+#endif
+
+namespace motion {
+
+/* 
+ * LinearDeltaLineSolver solves for the times at which a LinearDeltaStepper's carriage passes through each of several step positions during a linear move.
+ *   (see the derivation in LinearDeltaStepper::_solveLineRoots).
+ * For each position, the carriage height D determines dz = P0z - D, and then t solves a*t^2 + b*t + c == 0, where
+ *   b = bXY + bZ*dz
+ *   c = cXY + dz^2
+ * Everything but dz is constant over the move, so it's computed once in the constructor.
+ *
+ * solve() dispatches at compile-time to either a NEON (ARM) or SSE (x86) implementation that solves 4 positions at once,
+ *   or to the portable scalar implementation if neither is available (or if built with USE_SIMD=0).
+ * solveScalar() is always available, as a reference & for benchmarking (see lineardeltasolver.cpp).
+ */
+class LinearDeltaLineSolver {
+    float bXY, bZ, cXY;
+    float fourA, inv2a;
+    //dz at position 0, and the change in dz per step
+    float dz0, dzStep;
+    public:
+        inline LinearDeltaLineSolver() {}
+        //@P0_rel initial effector position, relative to the base of the carriage's tower, in mm
+        //@vel cartesian velocity of the effector, in mm/sec
+        //@L length of the rod connecting the effector to the carriage, in mm
+        //@M0 initial height of the carriage, in mm
+        //@mmPerStep carriage movement per step, in mm
+        inline LinearDeltaLineSolver(const Vector3f &P0_rel, const Vector3f &vel, float L, float M0, float mmPerStep) 
+          : bXY(2*(vel.x()*P0_rel.x() + vel.y()*P0_rel.y())),
+            bZ(2*vel.z()),
+            cXY(P0_rel.x()*P0_rel.x() + P0_rel.y()*P0_rel.y() - L*L),
+            fourA(4*vel.magSq()),
+            inv2a(1.f/(2*vel.magSq())),
+            dz0(P0_rel.z() - M0),
+            dzStep(mmPerStep) {}
+        //Solve for the (up to 2) times at which the carriage is at each of the positions firstPos, firstPos+1, ..., firstPos+numPos-1 (in steps, relative to M0),
+        //  storing the results in root1 and root2 (root1 <= root2, or NAN if the carriage never reaches that position).
+        inline void solve(int firstPos, int numPos, float *root1, float *root2) const {
+        #if LINEARDELTASOLVER_NEON || LINEARDELTASOLVER_SSE
+            solveSimd(firstPos, numPos, root1, root2);
+        #else
+            solveScalar(firstPos, numPos, root1, root2);
+        #endif
+        }
+        inline void solveScalar(int firstPos, int numPos, float *root1, float *root2) const {
+            for (int i=0; i<numPos; ++i) {
+                float dz = dz0 - (firstPos+i)*dzStep;
+                float b = bXY + bZ*dz;
+                float c = cXY + dz*dz;
+                //solve t = (-b +- sqrt(b*b-4*a*c))/(2a)
+                float rootParam = b*b - fourA*c;
+                float root = std::sqrt(std::max(0.f, rootParam));
+                root1[i] = rootParam < 0 ? NAN : (-b - root)*inv2a;
+                root2[i] = rootParam < 0 ? NAN : (-b + root)*inv2a;
+            }
+        }
+    #if LINEARDELTASOLVER_NEON
+        inline void solveSimd(int firstPos, int numPos, float *root1, float *root2) const {
+            const float32x4_t zero = vdupq_n_f32(0.f);
+            const float32x4_t nan = vdupq_n_f32(NAN);
+            const float laneOffsets[4] = {0, 1, 2, 3};
+            const float32x4_t lanes = vld1q_f32(laneOffsets);
+            int i = 0;
+            for (; i+4 <= numPos; i += 4) {
+                float32x4_t pos = vaddq_f32(vdupq_n_f32(firstPos+i), lanes);
+                float32x4_t dz = vmlsq_n_f32(vdupq_n_f32(dz0), pos, dzStep);
+                float32x4_t b = vmlaq_n_f32(vdupq_n_f32(bXY), dz, bZ);
+                float32x4_t c = vmlaq_f32(vdupq_n_f32(cXY), dz, dz);
+                float32x4_t rootParam = vmlsq_n_f32(vmulq_f32(b, b), c, fourA);
+                uint32x4_t isInvalid = vcltq_f32(rootParam, zero);
+                float32x4_t x = vmaxq_f32(rootParam, zero);
+            #if defined(__aarch64__)
+                float32x4_t root = vsqrtq_f32(x);
+            #else
+                //ARMv7 NEON has no sqrt; refine the reciprocal sqrt estimate with 2 Newton-Raphson steps & multiply by x.
+                float32x4_t invRoot = vrsqrteq_f32(x);
+                invRoot = vmulq_f32(invRoot, vrsqrtsq_f32(vmulq_f32(x, invRoot), invRoot));
+                invRoot = vmulq_f32(invRoot, vrsqrtsq_f32(vmulq_f32(x, invRoot), invRoot));
+                //x == 0 gives 0*inf; force the root to 0 in that case.
+                float32x4_t root = vbslq_f32(vcgtq_f32(x, zero), vmulq_f32(x, invRoot), zero);
+            #endif
+                float32x4_t t1 = vmulq_n_f32(vsubq_f32(vnegq_f32(b), root), inv2a);
+                float32x4_t t2 = vmulq_n_f32(vsubq_f32(root, b), inv2a);
+                vst1q_f32(root1+i, vbslq_f32(isInvalid, nan, t1));
+                vst1q_f32(root2+i, vbslq_f32(isInvalid, nan, t2));
+            }
+            solveScalar(firstPos+i, numPos-i, root1+i, root2+i);
+        }
+    #elif LINEARDELTASOLVER_SSE
+        inline void solveSimd(int firstPos, int numPos, float *root1, float *root2) const {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 nan = _mm_set1_ps(NAN);
+            const __m128 lanes = _mm_set_ps(3, 2, 1, 0);
+            int i = 0;
+            for (; i+4 <= numPos; i += 4) {
+                __m128 pos = _mm_add_ps(_mm_set1_ps(firstPos+i), lanes);
+                __m128 dz = _mm_sub_ps(_mm_set1_ps(dz0), _mm_mul_ps(pos, _mm_set1_ps(dzStep)));
+                __m128 b = _mm_add_ps(_mm_set1_ps(bXY), _mm_mul_ps(dz, _mm_set1_ps(bZ)));
+                __m128 c = _mm_add_ps(_mm_set1_ps(cXY), _mm_mul_ps(dz, dz));
+                __m128 rootParam = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(c, _mm_set1_ps(fourA)));
+                __m128 isInvalid = _mm_cmplt_ps(rootParam, zero);
+                __m128 root = _mm_sqrt_ps(_mm_max_ps(rootParam, zero));
+                __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(zero, b), root), _mm_set1_ps(inv2a));
+                __m128 t2 = _mm_mul_ps(_mm_sub_ps(root, b), _mm_set1_ps(inv2a));
+                //select NAN where the root is invalid (SSE2 has no blend instruction)
+                _mm_storeu_ps(root1+i, _mm_or_ps(_mm_and_ps(isInvalid, nan), _mm_andnot_ps(isInvalid, t1)));
+                _mm_storeu_ps(root2+i, _mm_or_ps(_mm_and_ps(isInvalid, nan), _mm_andnot_ps(isInvalid, t2)));
+            }
+            solveScalar(firstPos+i, numPos-i, root1+i, root2+i);
+        }
+    #endif
+};
+
+}
+
+#endif
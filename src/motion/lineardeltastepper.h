@@ -101,6 +101,9 @@
 
 #include "axisstepper.h"
 #include "linearstepper.h" //for LinearHomeStepper
+#include "lineardeltasolver.h"
+#include "lineardeltageometry.h"
+#include "cubicstepengine.h"
 #include "iodrivers/endstop.h"
 #include "common/logging.h"
 
@@ -116,37 +119,46 @@ enum DeltaAxis {
 /* 
  * LinearDeltaStepper implements the AxisStepper interface for (rail-based) Delta-style robots like the Kossel, 
  *   for linear (G0/G1) and arc movements (G2/G3)
+ * GeometryT is the LinearDeltaCoordMap's geometry; when it's a ConstLinearDeltaGeometry, L and the steps/mm are compile-time constants.
+ * StepEngineT chooses how the step times are found: ExactStepEngine or CubicStepEngine (see cubicstepengine.h).
  */
-template <typename StepperDriverT> class LinearDeltaStepper : public AxisStepperWithDriver<StepperDriverT> {
-    DeltaAxis axisIdx;
-    const iodrv::Endstop *endstop; //must be pointer, because cannot move a reference
-    float _r, _L, _MM_STEPS; //calibration settings which will be obtained from the CoordMap
-    float w; //angle of this axis, in radians
-    float M0; //initial coordinate of THIS axis. CW from +y axis
+template <typename StepperDriverT, typename GeometryT=LinearDeltaGeometry, typename StepEngineT=ExactStepEngine> class LinearDeltaStepper : public AxisStepperWithDriver<StepperDriverT> {
+    //members are ordered from most to least frequently accessed (see AxisStepper).
+    //state used to compute each batch of steps:
     int sTotal; //current step offset from M0
+    bool isArcMotion;
+    float M0; //initial coordinate of THIS axis. CW from +y axis
     
+    //coefficients computed once per move by beginLine/beginArc:
     //variables used during linear motion
-    Vector3f line_P0; //initial cartesian position, in mm
-    Vector3f line_v; //cartesian velocity vector, in mm/sec
-    
-    //variables used during arc motion
-    Vector3f arc_Pc; //arc centerpoint (cartesian)
-    Vector3f arc_u, arc_v; //u and v vectors (cartesian); P(t) = Pc + u*cos(mt) + v*sin(mt)
-    float arcRad; //radius of arc
+    LinearDeltaLineSolver line_solver; //solves for step times; precomputed from the initial cartesian position & velocity
+    //variables used during arc motion (see _solveArcRoots): the coefficients of {Sin[mt], Cos[mt], 1}, as functions of the carriage height D:
+    //  m = arc_m0 + arc_mD*D, n = arc_n0 + arc_nD*D, p = arc_p0 + (D-arc_zc)^2
+    float arc_m0, arc_mD;
+    float arc_n0, arc_nD;
+    float arc_p0, arc_zc;
     float arc_m; //angular velocity of the arc.
-    bool isArcMotion;
-    inline float r() const { return _r; }
-    inline float L() const { return _L; }
-    inline float MM_STEPS() const { return _MM_STEPS; }
+    //variables used by the CubicStepEngine (see _exactPosition). The effector's path, relative to the base of this axis' tower:
+    //  P(t) = path_P0 + path_vel*t for linear motion, or path_P0 + path_rad*(cos(path_m*t)*path_u + sin(path_m*t)*path_v) for arc motion.
+    StepEngineT engine;
+    Vector3f path_P0, path_vel, path_u, path_v;
+    float path_rad, path_m;
+
+    //machine configuration:
+    DeltaAxis axisIdx;
+    const iodrv::Endstop *endstop; //must be pointer, because cannot move a reference
+    GeometryT geometry; //calibration settings obtained from the CoordMap (empty if they're compile-time constants)
+    Vector3f towerPos; //(x, y) position of this axis' tower, i.e. <rsin(w), rcos(w), 0>, where w is the angle of this axis CW from +y
+    inline float L() const { return geometry.L(); }
+    inline float MM_STEPS() const { return geometry.MM_STEPS(); }
+    inline float STEPS_MM() const { return geometry.STEPS_MM(); }
     public:
         template <typename CoordMapT> LinearDeltaStepper(int idx, DeltaAxis axisIdx, const CoordMapT &map, const StepperDriverT &stepper, const iodrv::Endstop *endstop)
          : AxisStepperWithDriver<StepperDriverT>(idx, stepper),
            axisIdx(axisIdx),
            endstop(endstop),
-           _r(map.r()), 
-           _L(map.L()),
-           _MM_STEPS(map.MM_STEPS(axisIdx)),
-           w(axisIdx*2*M_PI/3) {
+           geometry(map.geometry()),
+           towerPos(geometry.r()*sin(axisIdx*2*M_PI/3), geometry.r()*cos(axisIdx*2*M_PI/3), 0) {
               //E axis has to be controlled using a LinearStepper (as if it were cartesian)
               assert(axisIdx == DELTA_AXIS_A || axisIdx == DELTA_AXIS_B || axisIdx == DELTA_AXIS_C);
         }
@@ -154,33 +166,49 @@ template <typename StepperDriverT> class LinearDeltaStepper : public AxisStepper
         //function to initiate a linear (through cartesian space) motion
         template <typename CoordMapT, std::size_t sz> void beginLine(const CoordMapT &map, const std::array<int, sz>& curPos, 
         const Vector4f &vel) {
-            this->M0 = map.getAxisPosition(curPos, axisIdx)*map.MM_STEPS(axisIdx); 
+            this->M0 = map.getAxisPosition(curPos, axisIdx)*MM_STEPS(); 
             this->sTotal = 0;
-            this->line_P0 = map.xyzeFromMechanical(curPos).xyz();
-            this->line_v = vel.xyz();
+            Vector3f line_P0 = map.xyzeFromMechanical(curPos).xyz();
+            this->line_solver = LinearDeltaLineSolver(line_P0 - towerPos, vel.xyz(), L(), M0, MM_STEPS());
             this->isArcMotion = false;
-            this->time = 0;
+            this->_beginTime();
+            this->path_P0 = line_P0 - towerPos;
+            this->path_vel = vel.xyz();
+            _beginEngine(engine);
         }
         //function to initiate a circular arc (through cartesian space) motion
         template <typename CoordMapT, std::size_t sz> void beginArc(const CoordMapT &map, const std::array<int, sz> &curPos, 
         const Vector3f &center, const Vector3f &u, const Vector3f &v,  
         float arcRad, float arcVel, float extVel) {
             (void)map, (void)extVel; //unused
-            this->M0 = map.getAxisPosition(curPos, axisIdx)*map.MM_STEPS(axisIdx);
+            this->M0 = map.getAxisPosition(curPos, axisIdx)*MM_STEPS();
             this->sTotal = 0;
-            this->arc_Pc = center;
-            this->arc_u = u;
-            this->arc_v = v;
-            this->arcRad = arcRad;
+            //Only the carriage height, D, varies within the move. Compute everything else once (see _solveArcRoots for the derivation):
+            //  p == (xc-r*Sin[w])^2 + (yc-r*Cos[w])^2 + s^2 - L^2 + (D-zc)^2
+            //  n == 2 s ({xc-r*Sin[w], yc-r*Cos[w], zc} . u - D uz)
+            //  m == 2 s ({xc-r*Sin[w], yc-r*Cos[w], zc} . v - D vz)
+            Vector3f rel = center - towerPos;
+            this->arc_p0 = rel.x()*rel.x() + rel.y()*rel.y() + arcRad*arcRad - L()*L();
+            this->arc_zc = center.z();
+            this->arc_n0 = 2*arcRad*u.dot(rel);
+            this->arc_nD = -2*arcRad*u.z();
+            this->arc_m0 = 2*arcRad*v.dot(rel);
+            this->arc_mD = -2*arcRad*v.z();
             this->arc_m = arcVel;
             this->isArcMotion = true;
-            this->time = 0;
+            this->_beginTime();
+            this->path_P0 = rel;
+            this->path_u = u;
+            this->path_v = v;
+            this->path_rad = arcRad;
+            this->path_m = arcVel;
+            _beginEngine(engine);
         }
     //protected:
-        inline float testDir(float s) {
-          	//returns the next time at which this axis should be at `s' mm above the initial position,
-          	//  or NAN if the axis should never be at that position during the motion.
-            if (isArcMotion) {
+        //Solve for the (up to 2) times at which this axis is at each of the positions firstPos, firstPos+1, ..., firstPos+numPos-1 (in steps, relative to M0),
+        //  storing the results in root1 and root2 (NAN if there is no solution).
+        //Each position is solved independently, so the loops below have no dependencies between iterations and can be vectorized.
+        inline void _solveArcRoots(int firstPos, int numPos, float *root1, float *root2) const {
             	/*
             	 * Let P = P(t) = <xc, yc, zc> + s*cos(m*t)u + s*sin(m*t)v where s is the radius of the curve
     			     *   Have the constraint equation: |P - <rsin(w), rcos(w), D>| = L, where <rsin(w), rcos(w), D> is the carriage position and P is the effector position
@@ -210,126 +238,99 @@ template <typename StepperDriverT> class LinearDeltaStepper : public AxisStepper
     			     *        mt = arctan((-n*p - m*sqrt(m*m+n*n-p*p))/(m*m+n*n),  (-m*p + n*sqrt(m*m+n*n-p*p))/(m*m + n*n)  )  where arctan(x, y) = atan(y/x)
     			     *     OR mt = arctan((-n*p + m*sqrt(m*m+n*n-p*p))/(m*m+n*n),  (-m*p - n*sqrt(m*m+n*n-p*p))/(m*m + n*n)  )
             	 */
-                auto Pc = arc_Pc;
-                auto u = arc_u;
-                auto v = arc_v;
-
-                float D = M0+s;
-                //        r^2      +s^2          +xc^2 +yc^2 +(D-zc)^2     -2 r   (yc Cos[w]+xc Sin[w]) - L^2
-                float p = r()*r()  +arcRad*arcRad+Pc.x()*Pc.x()+Pc.y()*Pc.y()+(D-Pc.z())*(D-Pc.z())-2*r()*(Pc.y()*cos(w)+Pc.x()*sin(w)) - L()*L();
-                //        2 s      (-D uz+ux xc+uy yc+uz zc-r   (uy Cos[w]+ux Sin[w]))
-                //float n = 2*arcRad*(-D*uz+ux*xc+uy*yc+uz*zc-r()*(uy*cos(w)+ux*sin(w)));
-                float n = 2*arcRad*(-D*u.z()+u.dot(Pc) - r()*(u.y()*cos(w)+u.x()*sin(w)));
-                //        2 s      (-D vz+vx xc+vy yc+vz zc-r   (vy Cos[w]+vx Sin[w]))
-                //float m = 2*arcRad*(-D*vz+vx*xc+vy*yc+vz*zc-r()*(vy*cos(w)+vx*sin(w)));
-                float m = 2*arcRad*(-D*v.z()+v.dot(Pc) - r()*(v.y()*cos(w)+v.x()*sin(w)));
+            //only D varies between positions; the remaining terms were computed in beginArc.
+            for (int i=0; i<numPos; ++i) {
+                float D = M0+(firstPos+i)*MM_STEPS();
+                float p = arc_p0 + (D-arc_zc)*(D-arc_zc);
+                float n = arc_n0 + arc_nD*D;
+                float m = arc_m0 + arc_mD*D;
 
                 float mt_1 = atan2((-m*p + n*sqrt(m*m+n*n-p*p))/(m*m + n*n), (-n*p - m*sqrt(m*m+n*n-p*p))/(m*m+n*n));
                 float mt_2 = atan2((-m*p - n*sqrt(m*m+n*n-p*p))/(m*m + n*n), (-n*p + m*sqrt(m*m+n*n-p*p))/(m*m+n*n));
-                float t1 = mt_1/this->arc_m;
-                float t2 = mt_2/this->arc_m;
-                //two possible solutions; choose the NEAREST one that is not in the past:
-                //TODO: are solutions to mt = x +/- c*2*pi?
-                if (t1 < this->time && t2 < this->time) { return NAN; }
-                else if (t1 < this->time) { return t2; }
-                else if (t2 < this->time) { return t1; }
-                else { return std::min(t1, t2); }
+                //atan2 gives angles in [-pi, pi], but an arc may sweep up to 2pi: the negative angles are reached in its second half.
+                root1[i] = (mt_1 < 0 ? mt_1 + (float)(2*M_PI) : mt_1)/this->arc_m;
+                root2[i] = (mt_2 < 0 ? mt_2 + (float)(2*M_PI) : mt_2)/this->arc_m;
+            }
+        }
+        inline void _solveLineRoots(int firstPos, int numPos, float *root1, float *root2) const {
+            /* For linear movement, we are given P(t) = P0 + v*t
+             * thus L^2 = |(P0+v*t) - {r*Sin[w], r*Cos[w], D}|^2
+             * manually expand based on property that |x|^2 = x . x:
+             *   L^2 = (P0+v*t) . (P0+v*t) - 2*(P0+v*t) . {r*Sin[w], r*Cos[w], D} + r^2*Sin[w]^2 + r^2*Cos[w]^2 + D^2
+             * manually simplify:
+             *   0 = (P0+v*t) . (P0+v*t) - 2*(P0+v*t) . {r*Sin[w], r*Cos[w], D} + r^2 + D^2 - L^2
+             *   0 = P0 . P0 + 2*t*P0 . v + t^2*v . v - 2*P0 . {r*Sin[w], r*Cos[w], D} - 2*t*v . {r*Sin[w], r*Cos[w], D} + r^2 + D^2 - L^2
+             * Collect t terms:
+             *   0 == P0 . P0 - 2*P0 . {r*Sin[w], r*Cos[w], D} + r^2 + D^2 - L^2
+                  + t*(2*P0 . v - 2*v . {r*Sin[w], r*Cos[w], D})
+                  + t^2*(v . v)
+             * Simplify the terms:
+             *   0 == |P0 - {r*Sin[w], r*Cos[w], D}|^2 - L^2
+                  + t*2*v . (P0 - {r*Sin[w], r*Cos[w], D})
+                  + t^2*(v . v)
+             * Apply quadratic equation to solve for t as a function of D.
+             * There are two solutions; both may be valid, but have different meanings. 
+             *   If one solution is at a time in the past, then it's just a projection of the current path into the past. 
+             *   If both solutions are in the future, then pick the nearest one; 
+             *   it means that there are two points in this path where the carriage should be at the same spot. 
+             *   This happens, for example, when the effector nears a tower for half of the line-segment, and 
+             *    then continues past the tower, so that the carriage movement is (pseudo) parabolic.
+             */
+            //Only D varies between positions, so the coefficients were computed at the start of the move.
+            //The quadratics are independent, and are solved several at a time where SIMD is available.
+            line_solver.solve(firstPos, numPos, root1, root2);
+        }
+        //the exact height of the carriage (in steps, relative to M0) at time t into the move, and its velocity (in steps/sec).
+        //The carriage is at D = Pz + sqrt(L^2 - Px^2 - Py^2), where P is the effector position relative to the tower. Differentiate that for the velocity.
+        inline float _exactPosition(float t, float &vel) const {
+            Vector3f P, Pvel;
+            if (isArcMotion) {
+                float cosMt = std::cos(path_m*t), sinMt = std::sin(path_m*t);
+                P = path_P0 + (path_u*cosMt + path_v*sinMt)*path_rad;
+                Pvel = (path_v*cosMt - path_u*sinMt)*(path_rad*path_m);
             } else {
-                /* For linear movement, we are given P(t) = P0 + v*t
-                 * thus L^2 = |(P0+v*t) - {r*Sin[w], r*Cos[w], D}|^2
-                 * manually expand based on property that |x|^2 = x . x:
-                 *   L^2 = (P0+v*t) . (P0+v*t) - 2*(P0+v*t) . {r*Sin[w], r*Cos[w], D} + r^2*Sin[w]^2 + r^2*Cos[w]^2 + D^2
-                 * manually simplify:
-                 *   0 = (P0+v*t) . (P0+v*t) - 2*(P0+v*t) . {r*Sin[w], r*Cos[w], D} + r^2 + D^2 - L^2
-                 *   0 = P0 . P0 + 2*t*P0 . v + t^2*v . v - 2*P0 . {r*Sin[w], r*Cos[w], D} - 2*t*v . {r*Sin[w], r*Cos[w], D} + r^2 + D^2 - L^2
-                 * Collect t terms:
-                 *   0 == P0 . P0 - 2*P0 . {r*Sin[w], r*Cos[w], D} + r^2 + D^2 - L^2
-                      + t*(2*P0 . v - 2*v . {r*Sin[w], r*Cos[w], D})
-                      + t^2*(v . v)
-                 * Simplify the terms:
-                 *   0 == |P0 - {r*Sin[w], r*Cos[w], D}|^2 - L^2
-                      + t*2*v . (P0 - {r*Sin[w], r*Cos[w], D})
-                      + t^2*(v . v)
-                 * Apply quadratic equation to solve for t as a function of D.
-                 * There are two solutions; both may be valid, but have different meanings. 
-                 *   If one solution is at a time in the past, then it's just a projection of the current path into the past. 
-                 *   If both solutions are in the future, then pick the nearest one; 
-                 *   it means that there are two points in this path where the carriage should be at the same spot. 
-                 *   This happens, for example, when the effector nears a tower for half of the line-segment, and 
-                 *    then continues past the tower, so that the carriage movement is (pseudo) parabolic.
-                 */
-                float D = M0 + s;
-                Vector3f carriagePos(r()*sin(w), r()*cos(w), D);
-                //obtain coefficients for t = a*x^2 + b*x + c
-                float a = line_v.magSq();
-                float b = 2*line_v.dot(line_P0 - carriagePos);
-                float c = (line_P0 - carriagePos).magSq() - L()*L();
-                //solve t = (-b +- sqrt(b*b-4*a*c))/(2a)
-                float term1 = -b;
-                float rootParam = (b*b-4*a*c);
-                float divisor = 2*a;
-                //check if the sqrt argument is negative
-                //TODO: can it ever be negative?
-                if (rootParam < 0) {
-                    return NAN;
-                }
-                float root = std::sqrt(rootParam);
-                float t1 = (term1 - root)/divisor;
-                float t2 = (term1 + root)/divisor;
-                //float t1 = term1 - root;
-                //float t2 = term1 + root;
-                //return the nearest of the two times that is > current time.
-                if (root > term1) { //if this is true, then t1 MUST be negative.
-                    //return t2 if t2 > last_step_time else None
-                    return t2 > this->time ? t2 : NAN;
-                } else {
-                    return t1 > this->time ? t1 : (t2 > this->time ? t2 : NAN); //ensure no value < time is returned.
-                }
+                P = path_P0 + path_vel*t;
+                Pvel = path_vel;
             }
+            float root = std::sqrt(L()*L() - P.x()*P.x() - P.y()*P.y()); //NAN if the carriage can't reach P
+            vel = (Pvel.z() - (P.x()*Pvel.x() + P.y()*Pvel.y())/root)*STEPS_MM();
+            return (P.z() + root - M0)*STEPS_MM();
+        }
+        inline void _beginEngine(ExactStepEngine &) {}
+        inline void _beginEngine(CubicStepEngine &engine) {
+            engine.begin([this](float t, float &vel) { return this->_exactPosition(t, vel); });
+        }
+        //Steps are computed in batches (see AxisStepper::_fillBatchFromRoots): we solve for the times at which the carriage passes through
+        //  each position near its current one, and then repeatedly choose the nearest of the backward & forward step.
+        inline void _fillBatch(ExactStepEngine &, unsigned maxSteps) {
+            int firstPos = this->_batchFirstPos(sTotal, maxSteps);
+            int numPos = maxSteps+2;
+            float root1[AXIS_STEPPER_BATCH_SIZE+2], root2[AXIS_STEPPER_BATCH_SIZE+2];
+            if (isArcMotion) {
+                _solveArcRoots(firstPos, numPos, root1, root2);
+                this->_fillBatchFromRoots(sTotal, firstPos, numPos, root1, root2, AxisStepper::_nearestRootAfter, maxSteps);
+            } else {
+                _solveLineRoots(firstPos, numPos, root1, root2);
+                this->_fillBatchFromRoots(sTotal, firstPos, numPos, root1, root2, AxisStepper::_firstRootAfter, maxSteps);
+            }
+        }
+        //Steps are found one after another from a piecewise-cubic approximation of the carriage height.
+        inline void _fillBatch(CubicStepEngine &engine, unsigned maxSteps) {
+            auto position = [this](float t, float &vel) { return this->_exactPosition(t, vel); };
+            this->_fillBatchSequentially([&](float &time, StepDirection &direction) {
+                time = engine.nextStep(position, sTotal, time, direction);
+            }, maxSteps);
         }
         inline void _nextStep(bool useEndstops) {
-            //called to set this->time and this->direction; the time (in seconds) and the direction at which the next step should occur for this axis
+            //called to set this->time and this->direction; the time (in ticks) and the direction at which the next step should occur for this axis
             //General formula is outlined in comments at the top of this file.
-            //First, we test the time at which a forward step (sTotal + 1) should occur given constant angular velocity.
-            //Then we test that time for a backward step (sTotal - 1).
-            //We choose the nearest resulting time as our next step.
-            //This is necessary because axis velocity can actually reverse direction during a circular cartesian movement.
             if (useEndstops && endstop->isEndstopTriggered()) {
-                this->time = NAN; //at endstop; no more steps.
-            } else {
-                float negTime = testDir((this->sTotal-1)*MM_STEPS()); //get the time at which next steps would occur.
-                float posTime = testDir((this->sTotal+1)*MM_STEPS());
-                if (negTime < this->time || std::isnan(negTime)) { //negTime is invalid
-                    if (posTime > this->time) {
-                        //LOGV("LinearDeltaStepper<%u>::chose %f (pos) vs %f (neg)\n", axisIdx, posTime, negTime);
-                        this->time = posTime;
-                        this->direction = StepForward;
-                        ++this->sTotal;
-                    } else {
-                        this->time = NAN;
-                    }
-                } else if (posTime < this->time || std::isnan(posTime)) { //posTime is invalid
-                    if (negTime > this->time) {
-                        //LOGV("LinearDeltaStepper<%u>::chose %f (neg) vs %f (pos)\n", axisIdx, negTime, posTime);
-                        this->time = negTime;
-                        this->direction = StepBackward;
-                        --this->sTotal;
-                    } else {
-                        this->time = NAN;
-                    }
-                } else { //neither time is invalid
-                    if (negTime < posTime) {
-                        //LOGV("LinearDeltaStepper<%u>::chose %f (neg) vs %f (pos)\n", axisIdx, negTime, posTime);
-                        this->time = negTime;
-                        this->direction = StepBackward;
-                        --this->sTotal;
-                    } else {
-                        //LOGV("LinearDeltaStepper<%u>::chose %f (pos) vs %f (neg)\n", axisIdx, posTime, negTime);
-                        this->time = posTime;
-                        this->direction = StepForward;
-                        ++this->sTotal;
-                    }
-                }
+                this->time = AxisStepper::NO_STEP(); //at endstop; no more steps.
+            } else if (!this->_popBatchedStep()) {
+                //when homing, the endstop must be checked before each step, so only compute one step at a time.
+                unsigned maxSteps = useEndstops ? 1 : AXIS_STEPPER_BATCH_SIZE;
+                _fillBatch(engine, maxSteps);
+                this->_popBatchedStep();
             }
         }
 };
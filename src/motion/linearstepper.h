@@ -26,10 +26,11 @@
 #define MOTION_LINEARSTEPPER_H
 
 #include "axisstepper.h"
+#include "steptime.h" //for StepInterval
 #include "iodrivers/endstop.h"
 #include "common/logging.h"
 #include <tuple>
-#include <cmath> //for fabs
+#include <cmath> //for fabs, M_PI
 #include <cassert>
 
 namespace motion {
@@ -45,24 +46,30 @@ enum CartesianAxis {
  * LinearStepper implements the AxisStepper interface for Cartesian-style robots.
  */
 template <typename StepperDriverT> class LinearStepper : public AxisStepperWithDriver<StepperDriverT> {
-    CartesianAxis coordType;
-    const iodrv::Endstop *endstop; //must be pointer, because cannot move a reference
-    float line_timePerStep;
+    //members are ordered from most to least frequently accessed (see AxisStepper).
+    //state used to compute each batch of steps:
+    bool isArcMotion;
+    int arc_sTotal;
+    //number of steps computed so far in the current linear move (including those still in the batch)
+    uint32_t line_numSteps;
+    float _MM_STEPS;
 
+    //coefficients computed once per move by beginLine/beginArc:
+    StepInterval line_interval;
     // for arc, x(t) = arc_center + cos(arc_m*t)*arc_su + sin(arc_m*t)*arc_sv;
     float arc_su, arc_sv;
     float arc_center, arc_m;
-    int arc_sTotal;
 
-    bool isArcMotion;
-    float _MM_STEPS;
+    //machine configuration:
+    CartesianAxis coordType;
+    const iodrv::Endstop *endstop; //must be pointer, because cannot move a reference
     float MM_STEPS() const { return _MM_STEPS; }
     public:
         template <typename CoordMapT> inline LinearStepper(int idx, CartesianAxis coordType, const CoordMapT &map, const StepperDriverT &stepper, const iodrv::Endstop *endstop)
          : AxisStepperWithDriver<StepperDriverT>(idx, stepper),
+           _MM_STEPS(map.MM_STEPS(coordType)),
            coordType(coordType),
-           endstop(endstop),
-           _MM_STEPS(map.MM_STEPS(coordType)) {
+           endstop(endstop) {
             (void)map;
             assert(coordType==CARTESIAN_AXIS_X || coordType==CARTESIAN_AXIS_Y || coordType==CARTESIAN_AXIS_Z || coordType==CARTESIAN_AXIS_E);
         }
@@ -74,8 +81,9 @@ template <typename StepperDriverT> class LinearStepper : public AxisStepperWithD
             //therefore v*STEPS_MM = steps/sec, so 1. / (v*STEPS_MM) is steps/sec
             float myVel = vel.array()[coordType];
             float signedTimePerStep = 1. / (myVel * map.STEPS_MM(coordType));
-            line_timePerStep = std::fabs(signedTimePerStep);
-            this->time = 0;
+            line_interval = StepInterval(std::fabs(signedTimePerStep));
+            line_numSteps = 0;
+            this->_beginTime();
             this->direction = stepDirFromSign(signedTimePerStep);
             this->isArcMotion = false;
         }
@@ -109,68 +117,62 @@ template <typename StepperDriverT> class LinearStepper : public AxisStepperWithD
                 this->arc_center = center.array()[coordType];
                 this->arc_m = arcVel;
                 this->arc_sTotal = map.getAxisPosition(curPos, coordType);
-                this->time = 0;
+                this->_beginTime();
             }
         }
-        inline float arcTestDir(float s) {
+        //@return the number of steps this axis takes during a line of the given duration (i.e. the number of steps whose time is <= duration),
+        //  negated if it steps backwards. Only valid after beginLine.
+        inline int lineSteps(EventClockT::duration duration) const {
+            return stepDirToSigned<int>(this->direction) * (int)line_interval.stepsUntil(duration);
+        }
+        //@return the interval between steps during a line. Only valid after beginLine.
+        inline StepInterval lineInterval() const {
+            return line_interval;
+        }
+        //Solve for the (up to 2) times at which this axis is at each of the positions firstPos, firstPos+1, ..., firstPos+numPos-1 (in steps) during an arc,
+        //  storing the results in root1 and root2 (NAN if there is no solution).
+        //Each position is solved independently, so the loop has no dependencies between iterations and can be vectorized.
+        inline void _solveArcRoots(int firstPos, int numPos, float *root1, float *root2) const {
             // for arc, x(t) = arc_center + cos(arc_m*t)*arc_su + sin(arc_m*t)*arc_sv;
             float m = arc_sv;
             float n = arc_su;
-            float p = arc_center - s;
-            // solve {m,n,p} . {Sin[q], Cos[q], 1} == 0:
-            float mt_1 = atan2f((-m*p + n*sqrtf(m*m+n*n-p*p))/(m*m + n*n), (-n*p - m*sqrtf(m*m+n*n-p*p))/(m*m+n*n));
-            float mt_2 = atan2f((-m*p - n*sqrtf(m*m+n*n-p*p))/(m*m + n*n), (-n*p + m*sqrtf(m*m+n*n-p*p))/(m*m+n*n));
-            float t1 = mt_1/this->arc_m;
-            float t2 = mt_2/this->arc_m;
-            //two possible solutions; choose the NEAREST one that is not in the past:
-            //TODO: are solutions to mt = x +/- c*2*pi?
-            if (t1 < this->time && t2 < this->time) { return NAN; }
-            else if (t1 < this->time) { return t2; }
-            else if (t2 < this->time) { return t1; }
-            else { return std::min(t1, t2); }
+            for (int i=0; i<numPos; ++i) {
+                float p = arc_center - (firstPos+i)*MM_STEPS();
+                // solve {m,n,p} . {Sin[q], Cos[q], 1} == 0:
+                float mt_1 = atan2f((-m*p + n*sqrtf(m*m+n*n-p*p))/(m*m + n*n), (-n*p - m*sqrtf(m*m+n*n-p*p))/(m*m+n*n));
+                float mt_2 = atan2f((-m*p - n*sqrtf(m*m+n*n-p*p))/(m*m + n*n), (-n*p + m*sqrtf(m*m+n*n-p*p))/(m*m+n*n));
+                //past half a turn, atan2 wraps around to negative angles
+                root1[i] = (mt_1 < 0 ? mt_1 + (float)(2*M_PI) : mt_1)/this->arc_m;
+                root2[i] = (mt_2 < 0 ? mt_2 + (float)(2*M_PI) : mt_2)/this->arc_m;
+            }
         }
     //protected:
         inline void _nextStep(bool useEndstops) {
             if (useEndstops && endstop->isEndstopTriggered()) {
-                this->time = NAN; //at endstop; no more steps.
-            } else {
+                this->time = AxisStepper::NO_STEP(); //at endstop; no more steps.
+            } else if (!this->_popBatchedStep()) {
+                //Steps are computed in batches (see AxisStepper).
+                //When homing, the endstop must be checked before each step, so only compute one step at a time.
+                unsigned maxSteps = useEndstops ? 1 : AXIS_STEPPER_BATCH_SIZE;
                 if (isArcMotion) {
-                    float negTime = arcTestDir((this->arc_sTotal-1)*MM_STEPS()); //get the time at which next steps would occur.
-                    float posTime = arcTestDir((this->arc_sTotal+1)*MM_STEPS());
-                    if (negTime < this->time || std::isnan(negTime)) { //negTime is invalid
-                        if (posTime > this->time) {
-                            //LOGV("LinearDeltaStepper<%u>::chose %f (pos) vs %f (neg)\n", axisIdx, posTime, negTime);
-                            this->time = posTime;
-                            this->direction = StepForward;
-                            ++this->arc_sTotal;
-                        } else {
-                            this->time = NAN;
-                        }
-                    } else if (posTime < this->time || std::isnan(posTime)) { //posTime is invalid
-                        if (negTime > this->time) {
-                            //LOGV("LinearDeltaStepper<%u>::chose %f (neg) vs %f (pos)\n", axisIdx, negTime, posTime);
-                            this->time = negTime;
-                            this->direction = StepBackward;
-                            --this->arc_sTotal;
-                        } else {
-                            this->time = NAN;
-                        }
-                    } else { //neither time is invalid
-                        if (negTime < posTime) {
-                            //LOGV("LinearDeltaStepper<%u>::chose %f (neg) vs %f (pos)\n", axisIdx, negTime, posTime);
-                            this->time = negTime;
-                            this->direction = StepBackward;
-                            --this->arc_sTotal;
-                        } else {
-                            //LOGV("LinearDeltaStepper<%u>::chose %f (pos) vs %f (neg)\n", axisIdx, posTime, negTime);
-                            this->time = posTime;
-                            this->direction = StepForward;
-                            ++this->arc_sTotal;
-                        }
-                    }
+                    int firstPos = this->_batchFirstPos(arc_sTotal, maxSteps);
+                    int numPos = maxSteps+2;
+                    float root1[AXIS_STEPPER_BATCH_SIZE+2], root2[AXIS_STEPPER_BATCH_SIZE+2];
+                    _solveArcRoots(firstPos, numPos, root1, root2);
+                    this->_fillBatchFromRoots(arc_sTotal, firstPos, numPos, root1, root2, AxisStepper::_nearestRootAfter, maxSteps);
                 } else {
-                    this->time += line_timePerStep;
+                    //linear motion has a constant step rate & direction.
+                    //Compute each time from the step count in integer ticks, so that long (e.g. extrusion-only or homing) moves
+                    //  are stepped as evenly at their end as at their start.
+                    for (unsigned i=0; i<maxSteps; ++i) {
+                        this->_batch.times[i] = line_interval.timeOfStep(line_numSteps+i+1);
+                        this->_batch.directions[i] = this->direction;
+                    }
+                    line_numSteps += maxSteps;
+                    this->_batch.count = maxSteps;
+                    this->_batch.next = 0;
                 }
+                this->_popBatchedStep();
             }
         }
 };
@@ -0,0 +1,115 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "lookaheadplanner.h"
+#include "junctionacceleration.h"
+#include "catch.hpp"
+
+TEST_CASE("LookaheadPlanner computes junction velocities", "[lookaheadplanner]") {
+    motion::LookaheadPlanner<int, 4> planner(1000, 0.05);
+    SECTION("Straight lines are limited only by the nominal velocity") {
+        REQUIRE(planner.junctionVelocity(Vector3f(1, 0, 0), Vector3f(1, 0, 0), 100) == Approx(100));
+    }
+    SECTION("Reversals require a full stop") {
+        REQUIRE(planner.junctionVelocity(Vector3f(1, 0, 0), Vector3f(-1, 0, 0), 100) == 0);
+    }
+    SECTION("Right angles are limited by the acceleration & junction deviation") {
+        //v^2 = a*d*sin(theta/2)/(1-sin(theta/2)), with theta = 90 degrees
+        REQUIRE(planner.junctionVelocity(Vector3f(1, 0, 0), Vector3f(0, 1, 0), 100) == Approx(std::sqrt(1000*0.05*(1+std::sqrt(2.f)))));
+    }
+    SECTION("A zero junction deviation forces a stop at every vertex") {
+        motion::LookaheadPlanner<int, 4> stopper(1000, 0);
+        REQUIRE(stopper.junctionVelocity(Vector3f(1, 0, 0), Vector3f(1, 0, 0), 100) == 0);
+    }
+}
+
+TEST_CASE("LookaheadPlanner plans feasible entry & exit velocities", "[lookaheadplanner]") {
+    motion::LookaheadPlanner<int, 4> planner(1000, 0.05);
+    //three long, collinear moves followed by a reversal
+    planner.push(0, Vector3f(50, 0, 0), 100);
+    planner.push(1, Vector3f(50, 0, 0), 100);
+    planner.push(2, Vector3f(50, 0, 0), 100);
+    planner.push(3, Vector3f(-50, 0, 0), 100);
+    REQUIRE(planner.full());
+    auto first = planner.pop();
+    REQUIRE(first.payload == 0);
+    //the first move starts from rest, but needn't stop at the collinear junction
+    REQUIRE(first.entryVel == 0);
+    REQUIRE(first.exitVel == Approx(100));
+    auto second = planner.pop();
+    REQUIRE(second.entryVel == Approx(first.exitVel));
+    REQUIRE(second.exitVel == Approx(100));
+    auto third = planner.pop();
+    //must stop before reversing
+    REQUIRE(third.exitVel == 0);
+    auto fourth = planner.pop();
+    REQUIRE(fourth.entryVel == 0);
+    REQUIRE(fourth.exitVel == 0);
+    REQUIRE(planner.empty());
+
+    SECTION("Short moves are limited by the acceleration") {
+        //a 1mm move can only gain sqrt(2*a*d) velocity
+        planner.push(0, Vector3f(1, 0, 0), 100);
+        planner.push(1, Vector3f(1, 0, 0), 100);
+        planner.push(2, Vector3f(1, 0, 0), 100);
+        auto a = planner.pop();
+        REQUIRE(a.exitVel == Approx(std::sqrt(2*1000*1.f)));
+        //once a move has begun, its exit velocity must be honored by the next move, even when more moves are queued.
+        planner.push(3, Vector3f(1, 0, 0), 100);
+        auto b = planner.pop();
+        REQUIRE(b.entryVel == Approx(a.exitVel));
+        float maxExitVel = std::sqrt(b.entryVel*b.entryVel + 2*1000*1.f);
+        REQUIRE(b.exitVel <= maxExitVel + 0.001f);
+    }
+}
+
+TEST_CASE("JunctionAcceleration honors the entry & exit velocities", "[junctionacceleration]") {
+    motion::JunctionAcceleration accel(1000, 0.05);
+    //100mm move at 100 mm/sec, entering at 20mm/sec and exiting at 50mm/sec
+    float Vmax=100, Vstart=20, Vend=50, duration=1;
+    accel.begin(duration, Vmax, Vstart, Vend);
+    //total time = accel time + cruise time + decel time
+    float s1 = (Vmax*Vmax - Vstart*Vstart)/2000, s3 = (Vmax*Vmax - Vend*Vend)/2000;
+    float expectedEnd = (Vmax-Vstart)/1000 + (100-s1-s3)/Vmax + (Vmax-Vend)/1000;
+    REQUIRE(accel.transform(duration) == Approx(expectedEnd));
+    //instantaneous velocities at the start & end of the move (ds/dT = Vmax*dt/dT)
+    float dt = 1e-4;
+    REQUIRE(std::fabs(Vmax*dt/(accel.transform(dt) - accel.transform(0)) - Vstart) < 0.5);
+    REQUIRE(std::fabs(Vmax*dt/(accel.transform(duration) - accel.transform(duration-dt)) - Vend) < 0.5);
+    //should cruise at Vmax halfway through
+    REQUIRE(std::fabs(Vmax*dt/(accel.transform(0.5+dt) - accel.transform(0.5)) - Vmax) < 0.5);
+}
+
+TEST_CASE("LookaheadPlanner joins curved moves using their tangents", "[lookaheadplanner]") {
+    motion::LookaheadPlanner<int, 4> planner(1000, 0.05);
+    //a line along +x, followed by a quarter circle that departs along +x and arrives travelling along +y, followed by a line along +y
+    planner.push(0, Vector3f(50, 0, 0), 100);
+    planner.push(1, Vector3f(1, 0, 0), Vector3f(0, 1, 0), 50*M_PI/2, 100);
+    planner.push(2, Vector3f(0, 50, 0), 100);
+    auto line = planner.pop();
+    auto arc = planner.pop();
+    //both junctions are tangent, so neither should limit the velocity
+    REQUIRE(line.exitVel == Approx(100));
+    REQUIRE(arc.entryVel == Approx(100));
+    REQUIRE(arc.exitVel == Approx(100));
+}
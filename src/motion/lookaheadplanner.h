@@ -0,0 +1,213 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MOTION_LOOKAHEADPLANNER_H
+#define MOTION_LOOKAHEADPLANNER_H
+
+#include <array>
+#include <cassert>
+#include <cmath> //for std::sqrt
+#include <algorithm> //for std::min
+#include "common/vector3.h"
+
+namespace motion {
+
+//data associated with one queued move in the LookaheadPlanner
+template <typename PayloadT> struct LookaheadSegment {
+    //arbitrary data needed by the user of the LookaheadPlanner to execute this move
+    PayloadT payload;
+    //unit vectors in the direction of (cartesian) travel at the start and at the end of the move.
+    //These are identical for linear moves, but differ for arcs.
+    Vector3f entryDir, exitDir;
+    //cartesian length of the move, in mm
+    float length;
+    //the desired (cruising) velocity of the move, in mm/sec
+    float nominalVel;
+    //the fastest we can pass through the junction between the previous move and this one, in mm/sec
+    float maxEntryVel;
+    //planned velocity at the start of this move
+    float entryVel;
+    //planned velocity at the end of this move
+    float exitVel;
+    //false if the move must begin and end at rest
+    bool isJoinable;
+};
+
+/* 
+ * LookaheadPlanner holds a fixed-capacity FIFO of moves that have been queued but not yet begun,
+ *   and decides at which velocity the effector should pass through each junction between them, 
+ *   so that consecutive moves can be chained together without stopping at every vertex.
+ *
+ * The maximum junction velocity is derived from the angle between consecutive segments and the acceleration limit
+ *   (the "junction deviation" approach): we pretend that the corner is rounded off by a circle which deviates at most
+ *   `junctionDeviation` mm from the sharp corner and take the velocity at which the centripetal acceleration equals `accel`.
+ *   v^2 = a*r, with r = junctionDeviation*sin(theta/2)/(1-sin(theta/2))
+ *
+ * Each time a move is added, the velocities are replanned in two passes:
+ *   a backward pass, assuming the last queued move must come to a complete stop, 
+ *   and a forward pass, limiting how quickly each move can accelerate from its entry velocity.
+ * The entry velocity of the oldest move is fixed once the move before it has begun (see pop()).
+ *
+ * @PayloadT data to be stored alongside each move.
+ * @Capacity maximum number of moves that can be queued. No heap allocations are made.
+ */
+template <typename PayloadT, std::size_t Capacity> class LookaheadPlanner {
+    static_assert(Capacity > 0, "LookaheadPlanner must be able to hold at least one move");
+    typedef LookaheadSegment<PayloadT> SegmentT;
+    std::array<SegmentT, Capacity> _segments;
+    //index of the oldest queued move
+    std::size_t _head;
+    //number of queued moves
+    std::size_t _size;
+    float _accel;
+    float _junctionDeviation;
+    //whether the entry velocity of the oldest queued move has been promised to the move that precedes it
+    bool _isHeadEntryLocked;
+    inline std::size_t physicalIdx(std::size_t logicalIdx) const {
+        return (_head + logicalIdx) % Capacity;
+    }
+    inline SegmentT& at(std::size_t logicalIdx) {
+        return _segments[physicalIdx(logicalIdx)];
+    }
+    public:
+        //@accel maximum cartesian acceleration, in mm/sec^2
+        //@junctionDeviation see class description. 0 forces a stop at every vertex.
+        LookaheadPlanner(float accel, float junctionDeviation)
+          : _segments(), _head(0), _size(0), _accel(accel), _junctionDeviation(junctionDeviation), _isHeadEntryLocked(false) {}
+        inline bool empty() const {
+            return _size == 0;
+        }
+        inline bool full() const {
+            return _size == Capacity;
+        }
+        inline std::size_t size() const {
+            return _size;
+        }
+        static constexpr std::size_t capacity() {
+            return Capacity;
+        }
+        //the oldest queued move (the one that pop() would return), whose velocities may yet change.
+        //Note: it is illegal to call this if empty() == true
+        inline const SegmentT& front() const {
+            assert(!empty());
+            return _segments[physicalIdx(0)];
+        }
+        //@return the fastest velocity at which the effector can travel from a segment with direction prevDir to one with nextDir
+        //  without exceeding the acceleration limit, capped at maxVel.
+        //Both directions must be unit vectors.
+        inline float junctionVelocity(const Vector3f &prevDir, const Vector3f &nextDir, float maxVel) const {
+            if (!(_junctionDeviation > 0)) {
+                return 0;
+            }
+            //theta is the angle between the two segments at the junction (theta=pi for a straight line, 0 for a reversal).
+            float cosTheta = -prevDir.dot(nextDir);
+            if (cosTheta > 0.999999f) { //reversal; must come to a stop
+                return 0;
+            }
+            if (cosTheta < -0.999999f) { //straight line; no limit imposed by the junction
+                return maxVel;
+            }
+            float sinHalfTheta = std::sqrt(0.5f*(1.f - cosTheta));
+            float vSq = _accel*_junctionDeviation*sinHalfTheta/(1.f - sinHalfTheta);
+            return std::min(maxVel, std::sqrt(vSq));
+        }
+        //queue a linear move that begins where the previous queued move ended.
+        //@payload data to be returned in the LookaheadSegment returned by pop()
+        //@displacement cartesian (x, y, z) displacement of the move, in mm
+        //@nominalVel the desired cruising velocity of the move, in mm/sec
+        //@isJoinable false if the move must begin and end at rest (e.g. it checks endstops). Moves with no cartesian component are never joinable.
+        //Note: it is illegal to call this if full() == true
+        void push(const PayloadT &payload, const Vector3f &displacement, float nominalVel, bool isJoinable=true) {
+            float length = displacement.mag();
+            Vector3f unitDir = length > 0 ? displacement/length : Vector3f();
+            push(payload, unitDir, unitDir, length, nominalVel, isJoinable);
+        }
+        //queue a (possibly curved) move that begins where the previous queued move ended.
+        //@entryDir, exitDir unit vectors tangent to the path at the start and at the end of the move
+        //@length the length of the path, in mm
+        void push(const PayloadT &payload, const Vector3f &entryDir, const Vector3f &exitDir, float length, float nominalVel, bool isJoinable=true) {
+            assert(!full());
+            SegmentT &seg = at(_size);
+            seg.payload = payload;
+            seg.length = length;
+            seg.entryDir = entryDir;
+            seg.exitDir = exitDir;
+            seg.nominalVel = nominalVel;
+            seg.entryVel = seg.exitVel = 0;
+            seg.isJoinable = isJoinable && seg.length > 0;
+            //If nothing else is queued, then the previous move (if any) has already begun and was planned to come to a stop.
+            if (_size == 0 || !seg.isJoinable || !at(_size-1).isJoinable) {
+                seg.maxEntryVel = 0;
+            } else {
+                const SegmentT &prev = at(_size-1);
+                seg.maxEntryVel = junctionVelocity(prev.exitDir, seg.entryDir, std::min(prev.nominalVel, nominalVel));
+            }
+            if (_size == 0) {
+                _isHeadEntryLocked = false;
+            }
+            ++_size;
+            replan();
+        }
+        //remove the oldest queued move & return it. Its entryVel and exitVel are final.
+        //The entry velocity of the next move becomes fixed, as the returned move is now planned to exit at that velocity.
+        //Note: it is illegal to call this if empty() == true
+        SegmentT pop() {
+            assert(!empty());
+            SegmentT seg = at(0);
+            _head = physicalIdx(1);
+            --_size;
+            if (_size) {
+                at(0).maxEntryVel = at(0).entryVel;
+                _isHeadEntryLocked = true;
+            }
+            return seg;
+        }
+        //recalculate the entry and exit velocities of all queued moves.
+        void replan() {
+            if (empty()) {
+                return;
+            }
+            //backward pass: the last move must be able to stop, and every move must be able to decelerate to the entry velocity of the next.
+            float nextEntryVel = 0;
+            for (std::size_t i=_size; i-- > 0; ) {
+                SegmentT &seg = at(i);
+                seg.exitVel = nextEntryVel;
+                seg.entryVel = std::min(seg.maxEntryVel, std::sqrt(seg.exitVel*seg.exitVel + 2*_accel*seg.length));
+                nextEntryVel = seg.entryVel;
+            }
+            //forward pass: every move must be able to accelerate from its entry velocity to its exit velocity.
+            //If the head's entry velocity is locked, then the backward pass has already left it at exactly its locked value.
+            float prevExitVel = _isHeadEntryLocked ? at(0).maxEntryVel : 0;
+            for (std::size_t i=0; i<_size; ++i) {
+                SegmentT &seg = at(i);
+                seg.entryVel = prevExitVel;
+                seg.exitVel = std::min(seg.exitVel, std::sqrt(seg.entryVel*seg.entryVel + 2*_accel*seg.length));
+                prevExitVel = seg.exitVel;
+            }
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,413 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "motionplanner.h"
+#include "catch.hpp"
+
+#include "common/benchmark.h"
+#include "common/logging.h"
+#include "platforms/auto/chronoclock.h" //for EventClockT
+#include <algorithm> //for std::max, std::max_element, std::min
+#include <cstdlib> //for std::abs
+#include <string> //for std::to_string
+#include <utility> //for std::move
+#include <vector>
+
+//MACHINE_PATH is calculated in the Makefile and then passed as a define through the make system (ie gcc -DMACHINEPATH='"path"')
+#include MACHINE_PATH
+
+namespace {
+    //the minimal Interface needed by the MotionPlanner (see State::MotionInterface), backed by the machine that's being built.
+    struct MachineInterface {
+        typedef decltype(std::declval<machines::MACHINE>().getCoordMap()) CoordMapT;
+        typedef decltype(std::declval<machines::MACHINE>().getAccelerationProfile()) AccelerationProfileT;
+        machines::MACHINE machine;
+        static constexpr std::size_t moveQueueCapacity() {
+            return machines::MACHINE::moveQueueCapacity();
+        }
+        static constexpr float arcChordTolerance() {
+            return machines::MACHINE::arcChordTolerance();
+        }
+        AccelerationProfileT getAccelerationProfile() const {
+            return machine.getAccelerationProfile();
+        }
+        CoordMapT getCoordMap() const {
+            return machine.getCoordMap();
+        }
+    };
+    //the machine's CoordMap, but never stepped by the CartesianDda.
+    struct FloatCoordMap : public MachineInterface::CoordMapT {
+        FloatCoordMap(MachineInterface::CoordMapT &&map) : MachineInterface::CoordMapT(std::move(map)) {}
+        inline static constexpr bool isCartesian() {
+            return false;
+        }
+    };
+    struct FloatInterface : public MachineInterface {
+        typedef FloatCoordMap CoordMapT;
+        CoordMapT getCoordMap() const {
+            return CoordMapT(machine.getCoordMap());
+        }
+    };
+    //the mechanical position of the machine immediately after an OutputEvent.
+    struct PositionSample {
+        long time; //ns since the start of the path
+        std::array<int, MachineInterface::CoordMapT::numAxis()> pos;
+    };
+    //queue a zig-zag path of extruding lines as quickly as the planner will accept them, and record the position after every OutputEvent.
+    template <typename Interface> std::vector<PositionSample> followPath(motion::MotionPlanner<Interface> &planner) {
+        std::vector<PositionSample> samples;
+        auto baseTime = EventClockT::now();
+        int move = 0;
+        while (move < 12 || !planner.isIdle()) {
+            if (move < 12 && planner.readyForNextMove()) {
+                Vector4f dest(move%2 ? 40 : -40, move%3 ? 30 : -30, move%4 ? 10 : 5, 2*move);
+                planner.moveTo(baseTime, dest, 100, -100, 100);
+                ++move;
+            } else {
+                PositionSample sample = { (long)std::chrono::duration_cast<std::chrono::nanoseconds>(planner.peekNextEvent().time() - baseTime).count(), planner.axisPositions() };
+                samples.push_back(sample);
+                planner.consumeNextEvent();
+            }
+        }
+        return samples;
+    }
+    //same as MachineInterface, but with the arc chord tolerance (in microns) overridden
+    template <int ChordToleranceMicrons> struct ChordInterface : MachineInterface {
+        static constexpr float arcChordTolerance() {
+            return 0.001f*ChordToleranceMicrons;
+        }
+    };
+    //the result of following an arc from (40, 0, 10) to (0, 40, 10) about (0, 0, 10) through to completion
+    struct ArcResult {
+        std::array<int, MachineInterface::CoordMapT::numAxis()> endPosition;
+        long numEvents;
+        //whether the planner could accept another move immediately after the arc was queued
+        bool readyAfterArc;
+    };
+    template <typename Interface> ArcResult followArc() {
+        Interface interface;
+        motion::MotionPlanner<Interface> planner(interface);
+        auto baseTime = EventClockT::now();
+        planner.moveTo(baseTime, Vector4f(40, 0, 10, 0), 50, -100, 100, motion::NO_LEVELING);
+        while (!planner.isIdle()) {
+            planner.consumeNextEvent();
+        }
+        ArcResult result = {{}, 0, false};
+        planner.arcTo(baseTime, Vector4f(0, 40, 10, 5), Vector3f(0, 0, 10), 50, -100, 100, false, motion::NO_LEVELING);
+        result.readyAfterArc = planner.readyForNextMove();
+        while (!planner.isIdle()) {
+            planner.consumeNextEvent();
+            ++result.numEvents;
+        }
+        result.endPosition = planner.axisPositions();
+        return result;
+    }
+    //the cartesian extents of the path traced by following an arc from (20, 0, 10) to (0, -20, 10) about (0, 0, 10)
+    struct ArcExtents {
+        float minX, maxX, minY, maxY;
+        Vector3f end;
+    };
+    template <typename Interface> ArcExtents traceArc(bool isCW) {
+        Interface interface;
+        motion::MotionPlanner<Interface> planner(interface);
+        auto baseTime = EventClockT::now();
+        planner.moveTo(baseTime, Vector4f(20, 0, 10, 0), 50, -100, 100, motion::NO_LEVELING);
+        while (!planner.isIdle()) {
+            planner.consumeNextEvent();
+        }
+        ArcExtents extents = { 20, 20, 0, 0, Vector3f() };
+        planner.arcTo(baseTime, Vector4f(0, -20, 10, 5), Vector3f(0, 0, 10), 50, -100, 100, isCW, motion::NO_LEVELING);
+        while (!planner.isIdle()) {
+            planner.consumeNextEvent();
+            Vector3f pos = planner.coordMap().xyzeFromMechanical(planner.axisPositions()).xyz();
+            extents.minX = std::min(extents.minX, pos.x());
+            extents.maxX = std::max(extents.maxX, pos.x());
+            extents.minY = std::min(extents.minY, pos.y());
+            extents.maxY = std::max(extents.maxY, pos.y());
+            extents.end = pos;
+        }
+        return extents;
+    }
+}
+
+//If the machine is stepped by the CartesianDda (i.e. it's built with CARTESIAN_DDA=1), its steps must match those of the AxisSteppers.
+//  At every step, each axis must be within 1 step of the position the AxisSteppers give it at nearly the same time:
+//  the DDA rounds the non-dominant axes to the nearest tick of the dominant one, and interpolates the step times to within 2 us.
+TEST_CASE("MotionPlanner steps lines identically with or without the CartesianDda", "[motionplanner]") {
+    MachineInterface interface;
+    motion::MotionPlanner<MachineInterface> planner(interface);
+    FloatInterface floatInterface;
+    motion::MotionPlanner<FloatInterface> floatPlanner(floatInterface);
+    std::vector<PositionSample> samples = followPath(planner);
+    std::vector<PositionSample> floatSamples = followPath(floatPlanner);
+    REQUIRE(!samples.empty());
+    REQUIRE(samples.back().pos == floatSamples.back().pos);
+
+    const long window = 2000; //ns; 1 us of interpolation error + truncation of each time to the clock
+    std::size_t floatIdx = 0;
+    for (const PositionSample &sample : samples) {
+        //find the last float sample at or before the start of the window
+        while (floatIdx+1 < floatSamples.size() && floatSamples[floatIdx+1].time <= sample.time - window) {
+            ++floatIdx;
+        }
+        for (std::size_t axis=0; axis<sample.pos.size(); ++axis) {
+            int minPos = floatSamples[floatIdx].pos[axis];
+            int maxPos = minPos;
+            for (std::size_t i=floatIdx; i<floatSamples.size() && floatSamples[i].time <= sample.time + window; ++i) {
+                minPos = std::min(minPos, floatSamples[i].pos[axis]);
+                maxPos = std::max(maxPos, floatSamples[i].pos[axis]);
+            }
+            INFO("axis " + std::to_string(axis) + " at " + std::to_string(sample.time) + " ns");
+            REQUIRE(sample.pos[axis] >= minPos-1);
+            REQUIRE(sample.pos[axis] <= maxPos+1);
+        }
+    }
+}
+
+//A straight line that's split into many short queued moves must end where the same line would in a single move.
+//  Each move ends up to a step short of its destination, so this fails if the next move is planned from that destination
+//  rather than from where the previous one actually ended.
+TEST_CASE("MotionPlanner doesn't accumulate error over many queued moves", "[motionplanner]") {
+    MachineInterface interface;
+    motion::MotionPlanner<MachineInterface> planner(interface);
+    motion::MotionPlanner<MachineInterface> splitPlanner(interface);
+    auto baseTime = EventClockT::now();
+    Vector4f start(-20, -10, 10, 0);
+    Vector4f end(20, 10, 12, 6);
+    const int numSplits = 400;
+    for (int move=0; move<2; ++move) {
+        planner.moveTo(baseTime, move ? end : start, 100, -100, 100);
+        while (!planner.isIdle()) {
+            planner.consumeNextEvent();
+        }
+    }
+    for (int move=0; move <= numSplits || !splitPlanner.isIdle(); ) {
+        if (move <= numSplits && splitPlanner.readyForNextMove()) {
+            splitPlanner.moveTo(baseTime, move ? start + (end-start)*((float)move/numSplits) : start, 100, -100, 100);
+            ++move;
+        } else {
+            splitPlanner.consumeNextEvent();
+        }
+    }
+    for (std::size_t axis=0; axis<planner.axisPositions().size(); ++axis) {
+        INFO("axis " + std::to_string(axis));
+        REQUIRE(std::abs(splitPlanner.axisPositions()[axis] - planner.axisPositions()[axis]) <= 1);
+    }
+}
+
+TEST_CASE("MotionPlanner only holds CartesianDdas if it may step lines with them", "[motionplanner]") {
+    //FloatInterface's CoordMap isn't cartesian, so it never uses a CartesianDda.
+    bool isSmallerThanOneDda = sizeof(motion::MotionPlanner<FloatInterface>) < sizeof(motion::CartesianDda<MachineInterface::CoordMapT::numAxis()>);
+    REQUIRE(isSmallerThanOneDda);
+}
+
+//A slow extrusion that lasts 2 minutes must step just as evenly at the end as at the start.
+//  Step times kept as float seconds can only resolve about 8 us by t=100 s, so their intervals would vary by that much.
+TEST_CASE("MotionPlanner steps evenly late into long moves", "[motionplanner]") {
+    MachineInterface interface;
+    motion::MotionPlanner<MachineInterface> planner(interface);
+    auto baseTime = EventClockT::now();
+    //about 7.3 steps per second, an interval that's not a whole number of ticks
+    float velE = interface.getCoordMap().MM_STEPS(3) * 7.3f;
+    Vector4f dest = planner.actualCartesianPosition() + Vector4f(0, 0, 0, velE*120);
+    planner.moveTo(baseTime, dest, 100, -velE, velE, motion::NO_LEVELING | motion::NO_BOUNDING);
+    //the time of the first OutputEvent of each extruder step after t=90 s
+    std::vector<EventClockT::duration> stepTimes;
+    int lastPos = planner.axisPositions()[3];
+    while (!planner.isIdle()) {
+        EventClockT::duration time = planner.peekNextEvent().time() - baseTime;
+        int pos = planner.axisPositions()[3];
+        if (pos != lastPos && time > std::chrono::seconds(90)) {
+            stepTimes.push_back(time);
+        }
+        lastPos = pos;
+        planner.consumeNextEvent();
+    }
+    REQUIRE(stepTimes.size() > 100);
+    EventClockT::duration minInterval = EventClockT::duration::max(), maxInterval = EventClockT::duration::zero();
+    for (std::size_t i=1; i<stepTimes.size(); ++i) {
+        minInterval = std::min(minInterval, stepTimes[i] - stepTimes[i-1]);
+        maxInterval = std::max(maxInterval, stepTimes[i] - stepTimes[i-1]);
+    }
+    INFO("intervals between " + std::to_string(minInterval.count()) + " and " + std::to_string(maxInterval.count()) + " ticks");
+    long variation = (long)(maxInterval - minInterval).count();
+    REQUIRE(variation <= 2);
+}
+
+//A counter-clockwise arc from +x to -y goes the long way round, through the -x side, whereas a clockwise one only passes through the 4th quadrant.
+//  This is so whether the arc is stepped exactly or split into chords.
+TEST_CASE("MotionPlanner follows arcs the long way round when directed to", "[motionplanner]") {
+    ArcExtents longWay[] = { traceArc<ChordInterface<0> >(false), traceArc<ChordInterface<10> >(false) };
+    ArcExtents shortWay[] = { traceArc<ChordInterface<0> >(true), traceArc<ChordInterface<10> >(true) };
+    for (const ArcExtents &extents : longWay) {
+        REQUIRE(extents.minX < -19);
+        REQUIRE(extents.maxY > 19);
+        REQUIRE(extents.end.distance(Vector3f(0, -20, 10)) < 0.5);
+    }
+    for (const ArcExtents &extents : shortWay) {
+        REQUIRE(extents.minX > -1);
+        REQUIRE(extents.maxY < 1);
+        REQUIRE(extents.end.distance(Vector3f(0, -20, 10)) < 0.5);
+    }
+}
+
+//Note: the geometry of the chords (i.e. that they stay within the tolerance of the arc) is tested with ArcChords.
+TEST_CASE("Arcs split into chords are queued as space frees up", "[motionplanner]") {
+    ArcResult exact = followArc<ChordInterface<0> >();
+    //0.01mm tolerance requires 36 chords for this arc, which is more than the lookahead queue can hold at once.
+    ArcResult chords = followArc<ChordInterface<10> >();
+    REQUIRE(exact.numEvents > 0);
+    REQUIRE(chords.numEvents > 0);
+    REQUIRE(exact.readyAfterArc);
+    //the remaining chords are queued as the earlier ones complete, so no other move may be queued in the meantime.
+    REQUIRE(!chords.readyAfterArc);
+    //both end at the destination
+    for (std::size_t axis=0; axis<exact.endPosition.size(); ++axis) {
+        REQUIRE(std::abs(chords.endPosition[axis] - exact.endPosition[axis]) <= 1);
+    }
+}
+
+namespace {
+    //the OutputEvents of a zig-zag of lines followed by an arc, queued as fast as the planner accepts them.
+    //If prepareMoves is set, then prepareNextMove() is called before each event is consumed, as State does with its idle time.
+    //  The time taken by each consumeNextEvent() is stored in latencies; it peaks where one move hands over to the next.
+    struct PlannedEvents {
+        std::vector<OutputEvent> events;
+        std::vector<EventClockT::duration> latencies;
+        int numPrepared;
+    };
+    PlannedEvents planZigZag(bool prepareMoves) {
+        MachineInterface interface;
+        motion::MotionPlanner<MachineInterface> planner(interface);
+        //the same for every call, so that the event times can be compared
+        EventClockT::time_point baseTime(std::chrono::seconds(1));
+        PlannedEvents result = { std::vector<OutputEvent>(), std::vector<EventClockT::duration>(), 0 };
+        int numQueued = 0;
+        const int numMoves = 12;
+        while (numQueued <= numMoves || !planner.isIdle()) {
+            if (numQueued <= numMoves && planner.readyForNextMove()) {
+                if (numQueued < numMoves) {
+                    planner.moveTo(baseTime, Vector4f(numQueued%2 ? 40 : 0, numQueued%3 ? 30 : -30, 10, numQueued), 100, -100, 100);
+                } else {
+                    planner.arcTo(baseTime, Vector4f(-40, 30, 10, numQueued), Vector3f(0, 0, 10), 50, -100, 100, false);
+                }
+                ++numQueued;
+                continue;
+            }
+            if (prepareMoves && planner.prepareNextMove()) {
+                ++result.numPrepared;
+            }
+            OutputEvent evt = planner.peekNextEvent();
+            if (!evt.isNull()) {
+                result.events.push_back(evt);
+            }
+            auto start = EventClockT::now();
+            planner.consumeNextEvent();
+            result.latencies.push_back(EventClockT::now() - start);
+        }
+        return result;
+    }
+}
+
+TEST_CASE("Moves set up in advance produce the same OutputEvents", "[motionplanner]") {
+    PlannedEvents onDemand = planZigZag(false);
+    PlannedEvents prepared = planZigZag(true);
+    REQUIRE(onDemand.numPrepared == 0);
+    REQUIRE(prepared.numPrepared > 0);
+    REQUIRE(onDemand.events.size() > 0);
+    REQUIRE(prepared.events.size() == onDemand.events.size());
+    bool isSame = true;
+    for (std::size_t i=0; i<onDemand.events.size(); ++i) {
+        isSame = isSame && prepared.events[i] == onDemand.events[i];
+    }
+    REQUIRE(isSame);
+}
+
+//The worst-case time taken to hand over from one move to the next, when the next move is set up on demand vs in advance.
+TEST_CASE("MotionPlanner move hand-over latency benchmark", "[.][benchmark][motionplanner]") {
+    //both produce the same sequence of events, so take the best latency of each consumeNextEvent() over several runs
+    //  to filter out preemption by the OS, and then the worst of those.
+    PlannedEvents onDemand = planZigZag(false);
+    PlannedEvents prepared = planZigZag(true);
+    REQUIRE(onDemand.latencies.size() == prepared.latencies.size());
+    REQUIRE(onDemand.events.size() == prepared.events.size());
+    bool isSame = true;
+    for (std::size_t i=0; i<onDemand.events.size(); ++i) {
+        isSame = isSame && prepared.events[i] == onDemand.events[i];
+    }
+    REQUIRE(isSame);
+    for (int run=1; run<10; ++run) {
+        std::vector<EventClockT::duration> a = planZigZag(false).latencies, b = planZigZag(true).latencies;
+        for (std::size_t i=0; i<onDemand.latencies.size(); ++i) {
+            onDemand.latencies[i] = std::min(onDemand.latencies[i], a[i]);
+            prepared.latencies[i] = std::min(prepared.latencies[i], b[i]);
+        }
+    }
+    EventClockT::duration onDemandWorst = *std::max_element(onDemand.latencies.begin(), onDemand.latencies.end());
+    EventClockT::duration preparedWorst = *std::max_element(prepared.latencies.begin(), prepared.latencies.end());
+    LOG("MotionPlanner: worst consumeNextEvent() latency %f us on demand, %f us with moves prepared in advance\n",
+        std::chrono::duration<float, std::micro>(onDemandWorst).count(), std::chrono::duration<float, std::micro>(preparedWorst).count());
+}
+
+namespace {
+    //zig-zag across the bed, extruding all the while, and consume every OutputEvent.
+    //@return the sum of the event times (ns), to detect changes in the output. The planner's final position is stored in endPosition.
+    template <typename Interface> double zigZagEvents(long &numEvents, std::array<int, MachineInterface::CoordMapT::numAxis()> &endPosition) {
+        Interface interface;
+        motion::MotionPlanner<Interface> planner(interface);
+        EventClockT::time_point baseTime(std::chrono::seconds(1));
+        double checksum = 0;
+        numEvents = 0;
+        for (int move=0; move<20; ++move) {
+            Vector4f dest(move%2 ? 40 : -40, move%2 ? 30 : -30, 10, 2*move);
+            planner.moveTo(baseTime, dest, 100, -100, 100);
+            while (!planner.isIdle()) {
+                checksum += std::chrono::duration<double, std::nano>(planner.peekNextEvent().time() - baseTime).count();
+                planner.consumeNextEvent();
+                ++numEvents;
+            }
+        }
+        endPosition = planner.axisPositions();
+        return checksum;
+    }
+}
+
+//The MotionPlanner's complete per-step path (selecting the next axis, computing its step, applying the acceleration profile,
+//  converting to clock ticks & generating the OutputEvents), for the machine that's being built.
+//  On cartesian machines built with CARTESIAN_DDA=1, this compares the CartesianDda with the AxisSteppers; otherwise both paths are the same.
+//  Compare with the AxisStepper step loop benchmark to see how much of the cost is due to the kinematics.
+TEST_CASE("MotionPlanner output event benchmark", "[.][benchmark][motionplanner]") {
+    long numEvents, numFloatEvents;
+    std::array<int, MachineInterface::CoordMapT::numAxis()> endPosition, floatEndPosition;
+    //the number of events is only known afterward, so measure the time per event from a first run.
+    zigZagEvents<MachineInterface>(numEvents, endPosition);
+    zigZagEvents<FloatInterface>(numFloatEvents, floatEndPosition);
+    REQUIRE(numEvents > 0);
+    benchmark::Timing timing = benchmark::measure(numEvents, [&]() { return zigZagEvents<MachineInterface>(numEvents, endPosition); });
+    benchmark::Timing floatTiming = benchmark::measure(numFloatEvents, [&]() { return zigZagEvents<FloatInterface>(numFloatEvents, floatEndPosition); });
+    benchmark::logComparison("MotionPlanner OutputEvents", "event", USE_CARTESIAN_DDA && MachineInterface::CoordMapT::isCartesian() ? "CartesianDda" : "AxisSteppers", timing,
+        "AxisSteppers (never the CartesianDda)", floatTiming);
+    //the two paths step identically (see the test above), so they must end in the same place.
+    bool isSameEnd = endPosition == floatEndPosition;
+    REQUIRE(isSameEnd);
+}
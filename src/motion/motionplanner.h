@@ -24,15 +24,22 @@
 #ifndef MOTION_MOTIONPLANNER_H
 #define MOTION_MOTIONPLANNER_H
 
+#include <algorithm> //for std::copy_if
 #include <array>
 #include <cassert>
+#include <cmath> //for std::cos, std::sin
 #include <stdexcept> //for runtime_error
-#include <utility> //for std::declval
+#include <utility> //for std::declval, std::swap
 #include "accelerationprofile.h"
+#include "arcchords.h"
 #include "axisstepper.h"
+#include "cartesiandda.h"
+#include "lookaheadplanner.h"
+#include "steptournament.h"
 #include "common/vector3.h"
 #include "common/vector4.h"
 #include "common/logging.h"
+#include "compileflags.h" //for USE_CARTESIAN_DDA
 
 namespace motion {
 
@@ -79,12 +86,43 @@ template <typename AxisStepperTypes> struct MaxOutputEventSequenceSize<AxisStepp
     }
 };
 
+//The 2 CartesianDdas of a MotionPlanner (one for the current move & one for the next), if lines may be stepped by them at all (@UseDda).
+//  Their ramp tables take up ~16 KB, so machines that never use them get the empty specialization below instead.
+template <std::size_t NumAxis, bool UseDda> struct CartesianDdaPair {
+    typedef CartesianDda<NumAxis> DdaT;
+    std::array<DdaT, 2> ddas;
+    inline DdaT& operator[](std::size_t idx) { return ddas[idx]; }
+    inline const DdaT& operator[](std::size_t idx) const { return ddas[idx]; }
+};
+
+template <std::size_t NumAxis> struct CartesianDdaPair<NumAxis, false> {
+    //stands in for a CartesianDda that's never begun.
+    struct DdaT {
+        inline bool isComplete() const { return true; }
+    };
+    inline DdaT& operator[](std::size_t) { return _none(); }
+    inline const DdaT& operator[](std::size_t) const { return _none(); }
+    private:
+        static inline DdaT& _none() {
+            static DdaT none;
+            return none;
+        }
+};
+
 
 /* 
  * MotionPlanner takes commands from the State (mainly those caused by G1 and G28) and resolves the move into a path via interfacing with a CoordMap, AxisSteppers, and an AccelerationProfile.
  * Once a path is planned, State can call MotionPlanner.nextStep() and be given data in the form of an Event, which can be passed on to a Scheduler.
+ * Moves may be queued while another move is in progress. Each queued move is fully planned (leveled, bounded, velocities calculated)
+ *   at the time it is queued, and stored in a fixed-capacity ring buffer (the LookaheadPlanner) so that step generation can roll
+ *   from one move into the next without any gap, and without the effector coming to a stop between them (if the AccelerationProfile allows it).
+ * The AxisSteppers & AccelerationProfile of the next move can also be set up during idle time, before the current move ends (see prepareNextMove()).
  * 
  * @Interface must have 2 public typedefs: CoordMapT and AccelerationProfileT. These are often provided by the machine driver.
+ *   It must also have a static constexpr function, moveQueueCapacity(), which returns the maximum number of moves that can be queued
+ *   behind the one currently being executed.
+ *   It must also have a static constexpr function, arcChordTolerance(). If this is non-zero, arcs are split into linear chords
+ *   that stray no further than arcChordTolerance() mm from the true arc. The chords are fed to the lookahead queue as space frees up.
  */
 template <typename Interface> class MotionPlanner {
     private:
@@ -93,15 +131,59 @@ template <typename Interface> class MotionPlanner {
               MotionPlanner<Interface> *_this, EventClockT::time_point baseTime) {
                 (void)myIdx; //unused
                 auto sequence = stepper.getStepOutputEventSequence(baseTime);
-                std::copy(sequence.begin(), sequence.end(), _this->outputEventBuffer.begin());
+                //the sequence may contain null events (e.g. the direction pin needn't be written if it hasn't changed)
                 _this->curOutputEvent = _this->outputEventBuffer.begin();
-                _this->endOutputEvent = _this->outputEventBuffer.begin() + sequence.size();
+                _this->endOutputEvent = std::copy_if(sequence.begin(), sequence.end(), _this->outputEventBuffer.begin(), [](const OutputEvent &evt) {
+                    return !evt.isNull();
+                });
+            }
+        };
+        struct ContinueFrom {
+            template <std::size_t MyIdx, typename T, typename TupleT> void operator()(std::integral_constant<std::size_t, MyIdx> myIdx, T &stepper, const TupleT *from) {
+                (void)myIdx; //unused
+                stepper.continueFrom(std::get<MyIdx>(*from));
             }
         };
         typedef typename Interface::CoordMapT CoordMapT;
         typedef typename Interface::AccelerationProfileT AccelerationProfileT;
         typedef decltype(std::declval<CoordMapT>().getAxisSteppers()) AxisStepperTypes;
         typedef std::array<OutputEvent, MaxOutputEventSequenceSize<AxisStepperTypes, std::tuple_size<AxisStepperTypes>::value>::maxSize()> OutputEventBufferT;
+        typedef StepTournament<std::tuple_size<AxisStepperTypes>::value> StepTournamentT;
+        //whether lines (other than homing moves) are stepped by a CartesianDda instead of the AxisSteppers
+        static constexpr bool USE_DDA = USE_CARTESIAN_DDA && CoordMapT::isCartesian();
+        typedef CartesianDdaPair<CoordMapT::numAxis(), USE_DDA> DdaPairT;
+        typedef typename DdaPairT::DdaT DdaT;
+        //gathers the number of steps & time between steps of each LinearStepper, once a line has begun.
+        struct GetLineSteps {
+            template <std::size_t MyIdx, typename T> void operator()(std::integral_constant<std::size_t, MyIdx> myIdx, const T &stepper, 
+              EventClockT::duration duration, std::array<int, CoordMapT::numAxis()> *steps, std::array<StepInterval, CoordMapT::numAxis()> *intervals) {
+                (void)myIdx; //unused
+                (*steps)[MyIdx] = stepper.lineSteps(duration);
+                (*intervals)[MyIdx] = stepper.lineInterval();
+            }
+        };
+        //information needed to begin a move that has been queued behind the current one
+        struct PlannedSegment {
+            //linear moves are described by dest (their velocity is determined when they begin). Arc moves are described by center, u, v, arcRad, arcVel & vel.e().
+            bool isArc;
+            //cartesian destination (x, y, z, e) of a linear move (already leveled & bounded)
+            Vector4f dest;
+            //cartesian velocity (x, y, z, e), not taking into account acceleration
+            Vector4f vel;
+            Vector3f center, u, v;
+            float arcRad, arcVel;
+            //the estimated duration of the move, not taking into account acceleration
+            float duration;
+            float maxVelXyz;
+            bool useEndstops;
+        };
+        //an arc that is being approximated by linear chords, not all of which have been pushed to the lookahead queue yet.
+        struct PendingArc {
+            ArcChords chords;
+            unsigned nextChord;
+            float maxVelXyz, minVelE, maxVelE;
+            bool useEndstops;
+        };
 
         //Interface _interface;
         //object that maps from (x, y, z) to mechanical coords (eg A, B, C for a kossel)
@@ -112,10 +194,33 @@ template <typename Interface> class MotionPlanner {
         std::array<int, CoordMapT::numAxis()> _destMechanicalPos;
         //Each axis iterator reports the next time it needs to be stepped. _iters is for linear or arc movement
         AxisStepperTypes _iters; 
+        //tracks which of _iters has the earliest next step. Must be updated whenever an AxisStepper's time changes.
+        StepTournamentT _nextStepper;
+        //_ddas[_ddaIdx] generates the steps of the current move instead of _iters, if _isDdaMove (only possible if USE_DDA, else _ddas is empty).
+        //  _iters are still prepared for each move, as they output the events of each step.
+        //  The other one is set up by prepareNextMove(), so that neither ramp table needs to be copied at the hand-over.
+        DdaPairT _ddas;
+        std::size_t _ddaIdx;
+        bool _isDdaMove;
+        //The oldest queued move, already popped from the lookahead queue & set up by prepareNextMove() while the current move completes.
+        //  When the current move ends, these are swapped with the above (see _beginQueuedMove), rather than the move being set up then.
+        AxisStepperTypes _preparedIters;
+        StepTournamentT _preparedNextStepper;
+        AccelerationProfileT _preparedAccel;
+        EventClockT::duration _preparedDuration;
+        bool _preparedUseEndstops;
+        bool _preparedIsDdaMove;
+        bool _hasPreparedMove;
+        //moves waiting for the current move to complete
+        LookaheadPlanner<PlannedSegment, Interface::moveQueueCapacity()> _lookahead;
+        //the cartesian destination of the most recently queued move (already leveled & bounded)
+        Vector4f _queuedDest;
+        //the chords of an arc that remain to be queued (only used if Interface::arcChordTolerance() is non-zero)
+        PendingArc _pendingArc;
         //The time at which the current path segment began (this will be a fraction of a second before the time which the first step in this path is scheduled for)
         EventClockT::time_point _baseTime;
-        //the estimated duration of the current piece, not taking into account acceleration
-        float _duration; 
+        //the estimated duration of the current piece (in ticks), not taking into account acceleration
+        EventClockT::duration _duration;
         bool _isInMotion;
         //whether or not to check endstops before each step (typically only useful in homing/autocalibration)
         bool _useEndstops;
@@ -132,8 +237,22 @@ template <typename Interface> class MotionPlanner {
             _accel(interface.getAccelerationProfile()), 
             _destMechanicalPos(), 
             _iters(_coordMapper.getAxisSteppers()),
+            _nextStepper(),
+            _ddas(),
+            _ddaIdx(0),
+            _isDdaMove(false),
+            _preparedIters(_coordMapper.getAxisSteppers()),
+            _preparedNextStepper(),
+            _preparedAccel(_accel),
+            _preparedDuration(EventClockT::duration::max()),
+            _preparedUseEndstops(false),
+            _preparedIsDdaMove(false),
+            _hasPreparedMove(false),
+            _lookahead(_accel.maxAcceleration(), _accel.junctionDeviation()),
+            _queuedDest(),
+            _pendingArc(),
             _baseTime(), 
-            _duration(NAN),
+            _duration(EventClockT::duration::max()),
             _isInMotion(false),
             _useEndstops(false),
             outputEventBuffer(),
@@ -145,9 +264,14 @@ template <typename Interface> class MotionPlanner {
         CoordMapT& coordMap() {
             return _coordMapper;
         }
-        //readForNextMove returns true if a call to moveTo() or homeEndstops() wouldn't hang, false if it would hang (or cause other problems)
+        //readForNextMove returns true if a call to moveTo() wouldn't hang, false if it would hang (or cause other problems)
         bool readyForNextMove() const {
-            return !_isInMotion;
+            return !_lookahead.full() && !_hasPendingChords();
+        }
+        //isIdle returns true if there is no move in progress or queued.
+        //Homing can only be performed when idle.
+        bool isIdle() const {
+            return !_isInMotion && _lookahead.empty() && !_hasPendingChords();
         }
         bool doHomeBeforeFirstMovement() const {
             return _coordMapper.doHomeBeforeFirstMovement();
@@ -165,39 +289,198 @@ template <typename Interface> class MotionPlanner {
         void resetAxisPositions(const std::array<int, CoordMapT::numAxis()> &pos) {
             _destMechanicalPos = pos;
         }
+        //Set up the next queued move in advance, so that the hand-over from the current move is just a swap, rather than a burst of
+        //  kinematics (forward kinematics, AxisStepper coefficients, the first batch of steps & the acceleration profile).
+        //The next move begins wherever the current one ends, so this can only be done once every step of the current move has been computed
+        //  (e.g. while its last OutputEvents wait to be consumed). Call it whenever there's spare CPU time; it does nothing otherwise.
+        //Moves that check endstops are always set up as they begin, as that reads the endstops.
+        //@return true if the next move was set up by this call.
+        bool prepareNextMove() {
+            if (_isInMotion && !_hasPreparedMove && !_lookahead.empty() && !_lookahead.front().payload.useEndstops && _hasComputedAllSteps()) {
+                callOnAll(_preparedIters, ContinueFrom(), &_iters);
+                _setUpQueuedMove(_preparedIters, _preparedNextStepper, _preparedAccel, _preparedDuration, _preparedUseEndstops,
+                    _ddas[_ddaIdx ^ 1], _preparedIsDdaMove);
+                _hasPreparedMove = true;
+                return true;
+            }
+            return false;
+        }
     private:
+        //@return true if an AxisStepper's next step time lies within the current move.
+        //  Note: NO_STEP() is the duration's max() & so is never within it, but homing moves last for max() too.
+        bool _isWithinMove(EventClockT::duration time) const {
+            return time != AxisStepper::NO_STEP() && time >= EventClockT::duration::zero() && time <= _duration;
+        }
         template <typename StepperTypes> void _nextStep(StepperTypes &steppers, AxisStepper &s) {
-            LOGV("MotionPlanner::nextStep() is: %i at %g of %g\n", s.index(), s.time, _duration);
-            if (s.time > _duration || s.time <= 0 || std::isnan(s.time)) { //if the next time the given axis wants to step is invalid or past the movement length, then end the motion
-                //Note: don't combine s.time <= 0 || isnan(s.time) to !(s.time > 0) because that might be broken during optimizations.
+            LOGV("MotionPlanner::nextStep() is: %i at %lli of %lli\n", s.index(), (long long)s.time.count(), (long long)_duration.count());
+            if (!_isWithinMove(s.time)) { //if the next time the given axis wants to step is invalid or past the movement length, then end the motion
                 //Note: This conditional causes the MotionPlanner to always undershoot the desired position, when it may be desireable to overshoot some of them - see https://github.com/Wallacoloo/printipi/issues/15
-                //log debug info:
-                Vector4f pos = _coordMapper.xyzeFromMechanical(_destMechanicalPos);
-                LOGD("MotionPlanner::moveTo Got: %s\n", pos.str().c_str());
-                LOGD("MotionPlanner _destMechanicalPos: (%i, %i, %i, %i)\n", _destMechanicalPos[0], _destMechanicalPos[1], _destMechanicalPos[2], _destMechanicalPos[3]);
-                _isInMotion = false;
+                _endMove();
                 return;
             }
-            float transformedTime = _accel.transform(s.time); //transform the step time according to acceleration profile
-            EventClockT::duration transformedChronoTime = std::chrono::duration_cast<EventClockT::duration>(std::chrono::duration<float>(transformedTime));
-            LOGV("Step transformed time: %f\n", transformedTime);
+            EventClockT::duration transformedTime = _accel.transform(s.time); //transform the step time according to acceleration profile
+            LOGV("Step transformed time: %lli\n", (long long)transformedTime.count());
             //update outputEventBuffer member variable:
-            tupleCallOnIndex(steppers, UpdateOutputEvents(), s.index(), this, _baseTime + transformedChronoTime);            
+            tupleCallOnIndex(steppers, UpdateOutputEvents(), s.index(), this, _baseTime + transformedTime);
             //Event e = s.getEvent(transformedTime);
             //e.offset(_baseTime); //AxisSteppers report times relative to the start of motion; transform to absolute.
             _destMechanicalPos[s.index()] += stepDirToSigned<int>(s.direction); //update the mechanical position tracked in software
             //advance the respective AxisStepper to its next step:
             s.nextStep(steppers, _useEndstops);
+            _nextStepper.set(s.index(), s.time);
             LOGV("MotionPlanner::nextStep() generated %zu OutputEvents\n", (endOutputEvent-curOutputEvent));
         }
+        //the current move has output all its steps.
+        void _endMove() {
+            //log debug info:
+            Vector4f pos = _coordMapper.xyzeFromMechanical(_destMechanicalPos);
+            LOGD("MotionPlanner::moveTo Got: %s\n", pos.str().c_str());
+            LOGD("MotionPlanner _destMechanicalPos: (%i, %i, %i, %i)\n", _destMechanicalPos[0], _destMechanicalPos[1], _destMechanicalPos[2], _destMechanicalPos[3]);
+            _isInMotion = false;
+            if (_hasPreparedMove || !_lookahead.empty()) {
+                //roll directly into the next queued move, beginning at the instant the current one completes.
+                //Note: the time at which the move completes is found by transforming the end of the un-accelerated move.
+                _baseTime += _accel.transform(_duration);
+                _beginQueuedMove();
+            }
+        }
+        //take the next step of a move that's generated by the CartesianDda.
+        void _nextDdaStep(std::true_type) {
+            DdaT &dda = _ddas[_ddaIdx];
+            int axis = dda.nextStep();
+            if (axis < 0) {
+                _endMove();
+                return;
+            }
+            tupleCallOnIndex(_iters, UpdateOutputEvents(), axis, this, _baseTime + EventClockT::duration(dda.ticks()));
+            _destMechanicalPos[axis] += dda.stepSign(axis);
+        }
+        void _nextDdaStep(std::false_type) {
+        }
+        //set up a CartesianDda to generate the steps of a line. iters & accel must already have begun the line.
+        //@return false if the line can't be stepped by the CartesianDda (in which case iters are used as usual).
+        bool _beginDdaMove(AxisStepperTypes &iters, AccelerationProfileT &accel, DdaT &dda, EventClockT::duration duration, std::true_type) {
+            std::array<int, CoordMapT::numAxis()> steps;
+            std::array<StepInterval, CoordMapT::numAxis()> intervals;
+            callOnAll(iters, GetLineSteps(), duration, &steps, &intervals);
+            //The ramp table is built from the times that the AxisSteppers would have given the dominant axis' steps, transformed by the acceleration profile.
+            //  Interpolating them to within 2 us keeps every axis within a step of its path, even at high step rates.
+            StepInterval dominantInterval = intervals[CartesianDda<CoordMapT::numAxis()>::dominantAxis(steps)];
+            return dda.begin(steps, [&accel, dominantInterval](uint32_t step) {
+                return (int64_t)accel.transform(dominantInterval.timeOfStep(step)).count();
+            }, (int64_t)ticksFromSeconds(2e-6f).count());
+        }
+        bool _beginDdaMove(AxisStepperTypes &, AccelerationProfileT &, DdaT &, EventClockT::duration, std::false_type) {
+            return false;
+        }
+        //@return true if every step of the current move has been computed (though its OutputEvents may not all have been consumed).
+        bool _hasComputedAllSteps() const {
+            return _isDdaMove ? _ddas[_ddaIdx].isComplete() : !_isWithinMove(_nextStepper.winnerTime());
+        }
         //black magic to get nextStep to work when either AxisStepperTypes or HomeStepperTypes have length 0:
         //If they are length zero, then _nextStep* just returns an empty event and a compilation error is avoided.
         //Otherwise, the templated function is called, and _nextStep is run as usual:
         template <bool T> void _nextStepIfHaveSteppers(std::integral_constant<bool, T> ) {
-            _nextStep(_iters, AxisStepper::getNextTime(_iters));
+            if (USE_DDA && _isDdaMove) {
+                _nextDdaStep(std::integral_constant<bool, USE_DDA>());
+            } else {
+                _nextStep(_iters, AxisStepper::atIndex(_iters, _nextStepper.winner()));
+            }
         }
         void _nextStepIfHaveSteppers(std::false_type ) {
         }
+        //pop the oldest move from the lookahead queue and set up the given AxisSteppers, tournament, AccelerationProfile & CartesianDda to execute it,
+        //  beginning from _destMechanicalPos (which must be where the current move ends).
+        void _setUpQueuedMove(AxisStepperTypes &iters, StepTournamentT &nextStepper, AccelerationProfileT &accel, EventClockT::duration &duration, bool &useEndstops,
+          DdaT &dda, bool &isDdaMove) {
+            auto seg = _lookahead.pop();
+            const PlannedSegment &move = seg.payload;
+            useEndstops = move.useEndstops;
+            if (move.isArc) {
+                AxisStepper::initAxisArcSteppers(iters, useEndstops, _coordMapper, _destMechanicalPos, move.center, move.u, move.v, move.arcRad, move.arcVel, move.vel.e());
+            } else {
+                //Head for dest from where the effector actually is, which differs from where the previous move was meant to end by up to a step.
+                //  Otherwise that error would accumulate over a long run of queued moves (e.g. the chords of an arc).
+                Vector4f vel = (move.dest - actualCartesianPosition())/move.duration;
+                AxisStepper::initAxisSteppers(iters, useEndstops, _coordMapper, _destMechanicalPos, vel);
+            }
+            nextStepper.reset(iters);
+            duration = ticksFromSeconds(move.duration);
+            accel.begin(move.duration, move.maxVelXyz, seg.entryVel, seg.exitVel);
+            //homing moves check the endstops before every step, which the CartesianDda doesn't do.
+            //  Note: the DDA's ramp table is built from the acceleration profile, so it must have already begun the move.
+            isDdaMove = USE_DDA && !move.isArc && !useEndstops
+                && _beginDdaMove(iters, accel, dda, duration, std::integral_constant<bool, USE_DDA>());
+            //the pop() freed a slot in the queue; if an arc is being split into chords, fill it.
+            _pushPendingChords();
+        }
+        //begin the oldest queued move at _baseTime, swapping in its state if prepareNextMove() has already set it up.
+        void _beginQueuedMove() {
+            if (_hasPreparedMove) {
+                std::swap(_iters, _preparedIters);
+                std::swap(_nextStepper, _preparedNextStepper);
+                std::swap(_accel, _preparedAccel);
+                this->_ddaIdx ^= 1;
+                this->_duration = _preparedDuration;
+                this->_useEndstops = _preparedUseEndstops;
+                this->_isDdaMove = _preparedIsDdaMove;
+                this->_hasPreparedMove = false;
+            } else {
+                _setUpQueuedMove(_iters, _nextStepper, _accel, _duration, _useEndstops, _ddas[_ddaIdx], _isDdaMove);
+            }
+            this->_isInMotion = true;
+        }
+        bool _hasPendingChords() const {
+            return _pendingArc.nextChord < _pendingArc.chords.numChords();
+        }
+        //push as many of the pending arc's chords to the lookahead queue as there is room for.
+        //The chords are not begun here; that's left to _queue() or to the completion of the current move.
+        void _pushPendingChords() {
+            while (_hasPendingChords() && !_lookahead.full()) {
+                const PendingArc &arc = _pendingArc;
+                Vector4f chordEnd = arc.chords.chordEnd(++_pendingArc.nextChord);
+                _pushLine(_queuedDest, chordEnd, arc.maxVelXyz, arc.minVelE, arc.maxVelE, arc.useEndstops);
+                _queuedDest = chordEnd;
+            }
+        }
+        //plan a linear move from cur to dest (both already leveled & bounded) and push it to the lookahead queue
+        void _pushLine(const Vector4f &cur, const Vector4f &dest, float maxVelXyz, float minVelE, float maxVelE, bool useEndstops) {
+            //Calculate velocities in x, y, z, e directions, and the duration of the linear movement:
+            float dist = cur.xyz().distance(dest.xyz());
+            float minDuration = dist/maxVelXyz; //duration, should there be no acceleration
+            float velE = (dest.e() - cur.e())/minDuration;
+            float newVelE = std::max(minVelE, std::min(maxVelE, velE));
+
+            //in the case that newXYZ = currentXYZ, but extrusion is different, regulate that.
+            if (velE != newVelE) { 
+                velE = newVelE;
+                minDuration = (dest.e()-cur.e())/newVelE;
+                maxVelXyz = dist/minDuration;
+            }
+            
+            LOGD("MotionPlanner line %s -> %s\n", cur.str().c_str(), dest.str().c_str());
+            LOGD("MotionPlanner line _destMechanicalPos: (%i, %i, %i, %i)\n", _destMechanicalPos[0], _destMechanicalPos[1], _destMechanicalPos[2], _destMechanicalPos[3]);
+            PlannedSegment move;
+            move.isArc = false;
+            move.dest = dest;
+            move.duration = minDuration;
+            move.maxVelXyz = maxVelXyz;
+            move.useEndstops = useEndstops;
+            //moves that check endstops must begin and end at rest, as they may be cut short.
+            _lookahead.push(move, dest.xyz()-cur.xyz(), maxVelXyz, !useEndstops);
+        }
+
+        //called after a move has been pushed to the lookahead queue.
+        //If no move is in progress, then begin the move now (at baseTime).
+        void _queue(EventClockT::time_point baseTime, const Vector4f &dest) {
+            this->_queuedDest = dest;
+            if (!_isInMotion) {
+                this->_baseTime = baseTime;
+                _beginQueuedMove();
+                //prepare the move buffer so that peekNextEvent() is valid
+                consumeNextEvent();
+            }
+        }
 
     public:
         OutputEvent peekNextEvent() {
@@ -222,14 +505,14 @@ template <typename Interface> class MotionPlanner {
             }
         }
         void moveTo(EventClockT::time_point baseTime, const Vector4f &dest_, float maxVelXyz, float minVelE, float maxVelE, MotionFlags flags=MOTIONFLAGS_DEFAULT) {
-            //called by State to queue a movement from the current destination to a new one at (x, y, z, e), with the desired motion beginning at baseTime
+            //called by State to queue a movement from the last queued destination to a new one at (x, y, z, e).
+            //If no other move is in progress, the desired motion begins at baseTime. Otherwise it begins as soon as the preceding moves complete.
             //Note: it is illegal to call this if readyForNextMove() != true
             if (std::tuple_size<AxisStepperTypes>::value == 0) {
                 return; //Prevents hanging on machines with 0 axes
             }
-            this->_baseTime = baseTime;
-            this->_useEndstops = flags & USE_ENDSTOPS;
-            Vector4f cur = _coordMapper.xyzeFromMechanical(_destMechanicalPos);
+            bool useEndstops = flags & USE_ENDSTOPS;
+            Vector4f cur = isIdle() ? _coordMapper.xyzeFromMechanical(_destMechanicalPos) : _queuedDest;
             Vector4f dest = dest_;
             if (! (flags & NO_LEVELING)) {
                 //get the REAL destination, after leveling is applied
@@ -239,40 +522,19 @@ template <typename Interface> class MotionPlanner {
                 //fix impossible coordinates
                 dest = _coordMapper.bound(dest);
             }
-            
-            //Calculate velocities in x, y, z, e directions, and the duration of the linear movement:
-            float dist = cur.xyz().distance(dest.xyz());
-            float minDuration = dist/maxVelXyz; //duration, should there be no acceleration
-            float velE = (dest.e() - cur.e())/minDuration;
-            float newVelE = std::max(minVelE, std::min(maxVelE, velE));
-
-            //in the case that newXYZ = currentXYZ, but extrusion is different, regulate that.
-            if (velE != newVelE) { 
-                velE = newVelE;
-                minDuration = (dest.e()-cur.e())/newVelE;
-                maxVelXyz = dist/minDuration;
-            }
-            
-            Vector3f vel = (dest.xyz()-cur.xyz())/minDuration;
-            LOGD("MotionPlanner::moveTo %s -> %s\n", cur.str().c_str(), dest.str().c_str());
-            LOGD("MotionPlanner::moveTo _destMechanicalPos: (%i, %i, %i, %i)\n", _destMechanicalPos[0], _destMechanicalPos[1], _destMechanicalPos[2], _destMechanicalPos[3]);
-            AxisStepper::initAxisSteppers(_iters, _useEndstops, _coordMapper, _destMechanicalPos, Vector4f(vel, velE));
-            this->_duration = minDuration;
-            this->_isInMotion = true;
-            this->_accel.begin(minDuration, maxVelXyz);
-            //prepare the move buffer so that peekNextEvent() is valid
-            consumeNextEvent();
+            _pushLine(cur, dest, maxVelXyz, minVelE, maxVelE, useEndstops);
+            _queue(baseTime, dest);
         }
 
         void arcTo(EventClockT::time_point baseTime, const Vector4f &dest_, const Vector3f &center_, float maxVelXyz, float minVelE, float maxVelE, bool isCW, MotionFlags flags=MOTIONFLAGS_DEFAULT) {
-            //called by State to queue a movement from the current destination to a new one at (x, y, z, e), with the desired motion beginning at baseTime
+            //called by State to queue an arc from the last queued destination to a new one at (x, y, z, e).
+            //If no other move is in progress, the desired motion begins at baseTime. Otherwise it begins as soon as the preceding moves complete.
             //Note: it is illegal to call this if readyForNextMove() != true
             if (std::tuple_size<AxisStepperTypes>::value == 0) {
                 return; //Prevents hanging on machines with 0 axes
             }
-            this->_baseTime = baseTime;
-            this->_useEndstops = flags & USE_ENDSTOPS;
-            Vector4f cur = _coordMapper.xyzeFromMechanical(_destMechanicalPos);
+            bool useEndstops = flags & USE_ENDSTOPS;
+            Vector4f cur = isIdle() ? _coordMapper.xyzeFromMechanical(_destMechanicalPos) : _queuedDest;
             Vector4f dest = dest_;
             if (! (flags & NO_LEVELING)) {
                 //get the REAL destination, after leveling is applied
@@ -305,32 +567,19 @@ template <typename Interface> class MotionPlanner {
             //  (that is, the projection of the line from c to the midpoint of a and b, onto n; the component of mc parallel to n)
             //Note: proj(c->n) = (c . n / |n|^2)n
             Vector3f n = b - a;
-            Vector3f mp = (b+center + a+center)*0.5;
-            Vector3f projcmpn = (mp-center).proj(n);
-            center += projcmpn;
+            //an arc that ends where it begins is a full circle. Then there's no plane of points equidistant from a and b, so the center is used as-is.
+            bool isFullCircle = n.magSq() < 1e-6f;
+            if (!isFullCircle) {
+                Vector3f mp = (b+center + a+center)*0.5;
+                Vector3f projcmpn = (mp-center).proj(n);
+                center += projcmpn;
+            }
             
             //recalculate our a and b vectors, relative to this new center-point:
             a = cur.xyz() - center; //relative *current* coordinates
             b = dest.xyz() - center; //relative *desired* coordinates
-            //now solve for the arcLength and arcAngle
-            //To get the arclength, we take the arcangle * arcRad.
-            //a . b = |a| |b| cos(theta), so we can find the arcangle with arccos(a . b / |a| / |b|).
             //Note: |a| == |b| == arcRad, as these points are defined to be equi-distant from the center-point.
-
             float arcRad = a.mag();
-            float arcAngle = acos(a.dot(b)/a.magSq()); //a . b = (r)*(r)*cos(theta)
-            float arcLength = arcAngle*arcRad; //s = r*theta
-            
-            //Now that we have the arcLength, we can determine the optimal velocity:
-            float minDuration = arcLength/maxVelXyz; //duration, should there be no acceleration
-            float velE = (dest.e()-cur.e())/minDuration;
-            float newVelE = std::max(minVelE, std::min(maxVelE, velE));
-            if (velE != newVelE) { //limit cartesian velocity if it forces extrusion velocity to exceed a doable value
-                velE = newVelE;
-                minDuration = (dest.e()-cur.e())/newVelE;
-                maxVelXyz = arcLength/minDuration;
-            }
-            float arcVel = maxVelXyz / arcRad;
                         
             //Want two perpindicular vectors such that <x, y, z> = P(t) = <xc, yc, zc> + r*cos(m*t)*u + r*sin(m*t)*v
             //Thus, u is the unit vector parallel to <x0, y0, z0> - <xc, yc, zc>
@@ -346,7 +595,12 @@ template <typename Interface> class MotionPlanner {
             // To create a unit vector v that is perpidicular to u
             // v is proportional to b - proj(b->u)
             // Therefore: v = (b - b.proj(b->u)).norm() 
-            Vector3f v = (b-b.proj(u)).norm();
+            //If b is parallel to u (a full or a half circle), that doesn't determine the plane of the arc, so take it to be the xy plane.
+            Vector3f v = b-b.proj(u);
+            if (v.magSq() < 1e-6f*arcRad*arcRad) {
+                v = Vector3f(0, 0, 1).cross(u);
+            }
+            v = v.norm();
 
             //Given <x, y, z> = u*cos(t) + v*sin(t)
             //  if we are CCW, then u x v should be out of the page (+z)
@@ -356,6 +610,40 @@ template <typename Interface> class MotionPlanner {
             if ((isCW && uCrossV_z > 0) || (!isCW && uCrossV_z < 0)) { //fix direction:
                 v = -v;
             }
+
+            //now solve for the arcLength and arcAngle
+            //To get the arclength, we take the arcangle * arcRad.
+            //The arc sweeps from u towards v, so the arcangle is the angle of b in the (u, v) plane, which may be the long way round.
+            float arcAngle = arcSweep(b, u, v, isFullCircle);
+            float arcLength = arcAngle*arcRad; //s = r*theta
+            
+            //Now that we have the arcLength, we can determine the optimal velocity:
+            float minDuration = arcLength/maxVelXyz; //duration, should there be no acceleration
+            float velE = (dest.e()-cur.e())/minDuration;
+            float newVelE = std::max(minVelE, std::min(maxVelE, velE));
+            if (velE != newVelE) { //limit cartesian velocity if it forces extrusion velocity to exceed a doable value
+                velE = newVelE;
+                minDuration = (dest.e()-cur.e())/newVelE;
+                maxVelXyz = arcLength/minDuration;
+            }
+            float arcVel = maxVelXyz / arcRad;
+
+            if (Interface::arcChordTolerance() > 0) {
+                //Rather than stepping along the arc, step along a series of chords, which are ordinary linear moves and far cheaper to step.
+                _pendingArc.chords = ArcChords(center, u, v, arcRad, arcAngle, cur.e(), dest, Interface::arcChordTolerance());
+                LOGD("MotionPlanner::arcTo splitting arc of radius %f, angle %f into %u chords\n", arcRad, arcAngle, _pendingArc.chords.numChords());
+                _pendingArc.nextChord = 0;
+                //the velocity was already limited to respect the extrusion rate over the whole arc
+                _pendingArc.maxVelXyz = maxVelXyz;
+                _pendingArc.minVelE = minVelE;
+                _pendingArc.maxVelE = maxVelE;
+                _pendingArc.useEndstops = useEndstops;
+                //chords are planned relative to the previous chord's end
+                _queuedDest = cur;
+                _pushPendingChords();
+                _queue(baseTime, _queuedDest);
+                return;
+            }
             
             /*LOGD("MotionPlanner arc center (%f,%f,%f) current (%f,%f,%f) desired (%f,%f,%f) u (%f,%f,%f) v (%f,%f,%f) rad %f vel %f velE %f dur %f\n", 
                   center.x(), center.y(), center.z(), curX, curY, curZ, x, y, z, 
@@ -363,15 +651,22 @@ template <typename Interface> class MotionPlanner {
             LOGD("MotionPlanner arc orig center (%f,%f,%f), proj (%f,%f,%f) n(%f,%f,%f), mp(%f,%f,%f)\n", 
                 centerX_, centerY_, centerZ_, projcmpn.x(), projcmpn.y(), projcmpn.z(),
                 n.x(), n.y(), n.z(), mp.x(), mp.y(), mp.z());*/
-            AxisStepper::initAxisArcSteppers(_iters, _useEndstops, _coordMapper, _destMechanicalPos, center, u, v, arcRad, arcVel, velE);
-            /*if (std::tuple_size<ArcStepperTypes>::value == 0) {
-                return; //Prevents hanging on machines with 0 axes. Place this as far along as possible so one can test most algorithms on the Example machine.
-            }*/
-            this->_duration = minDuration;
-            this->_isInMotion = true;
-            this->_accel.begin(minDuration, maxVelXyz);
-            //prepare the move buffer so that peekNextEvent() is valid
-            consumeNextEvent();
+            PlannedSegment move;
+            move.isArc = true;
+            move.vel = Vector4f(Vector3f(), velE);
+            move.center = center;
+            move.u = u;
+            move.v = v;
+            move.arcRad = arcRad;
+            move.arcVel = arcVel;
+            move.duration = minDuration;
+            move.maxVelXyz = maxVelXyz;
+            move.useEndstops = useEndstops;
+            //The path is P(t) = center + r*cos(m*t)*u + r*sin(m*t)*v, so the direction of travel is -sin(m*t)*u + cos(m*t)*v
+            Vector3f entryDir = v;
+            Vector3f exitDir = u*(-std::sin(arcAngle)) + v*std::cos(arcAngle);
+            _lookahead.push(move, entryDir, exitDir, arcLength, maxVelXyz, !useEndstops);
+            _queue(baseTime, dest);
         }
 };
 
@@ -0,0 +1,137 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "scurveacceleration.h"
+#include "junctionacceleration.h"
+#include "catch.hpp"
+#include <cmath>
+#include <vector>
+
+namespace {
+    //sample the real time at evenly spaced distances along a move that's already begun, and differentiate to find the velocity & acceleration.
+    //Near rest, the samples are too far apart in time to differentiate accurately, so skip the first & last few.
+    //  Differentiating twice amplifies the rounding of each float time, so the acceleration of short moves is only accurate to a few %.
+    struct SampledMotion {
+        float maxVel, maxAccel, maxAccelChange;
+        bool isMonotonic;
+    };
+    SampledMotion sampleMotion(motion::SCurveAcceleration &scurve, float duration, float Vmax) {
+        const int numSamples = 500, numSkipped = 5;
+        std::vector<float> times;
+        for (int i=0; i<=numSamples; ++i) {
+            times.push_back(scurve.transform(duration*i/numSamples));
+        }
+        float dist = Vmax*duration/numSamples;
+        SampledMotion result = { 0, 0, 0, true };
+        float prevVel = NAN, prevAccel = NAN;
+        for (int i=numSkipped; i<numSamples-numSkipped; ++i) {
+            float dt = times[i+1] - times[i];
+            result.isMonotonic = result.isMonotonic && dt > 0;
+            float vel = dist/dt;
+            result.maxVel = std::max(result.maxVel, vel);
+            float curAccel = (vel - prevVel)/(0.5f*(dt + times[i] - times[i-1]));
+            if (!std::isnan(curAccel)) {
+                result.maxAccel = std::max(result.maxAccel, std::fabs(curAccel));
+                if (!std::isnan(prevAccel)) {
+                    result.maxAccelChange = std::max(result.maxAccelChange, std::fabs(curAccel - prevAccel));
+                }
+            }
+            prevVel = vel;
+            prevAccel = curAccel;
+        }
+        return result;
+    }
+}
+
+TEST_CASE("SCurveAcceleration lengthens each ramp instead of exceeding the acceleration", "[scurveacceleration]") {
+    const float accel = 1000, jerk = 100000;
+    motion::SCurveAcceleration scurve(accel, jerk, 0.05);
+    motion::JunctionAcceleration trapezoid(accel, 0.05);
+    //A ramp from v0 to Vmax takes accel/jerk longer than a trapezoidal one, but also covers (v0+Vmax)/2 * accel/jerk more distance,
+    //  which would otherwise have been covered at Vmax.
+    auto rampDelay = [&](float v0, float Vmax) {
+        return accel/jerk*(1 - 0.5f*(v0 + Vmax)/Vmax);
+    };
+    //50 mm at 100 mm/sec, entering at 10 mm/sec and exiting at 20 mm/sec
+    scurve.begin(0.5, 100, 10, 20);
+    trapezoid.begin(0.5, 100, 10, 20);
+    REQUIRE(scurve.transform(0) == Approx(0));
+    REQUIRE(scurve.transform(0.25) == Approx(trapezoid.transform(0.25) + rampDelay(10, 100)));
+    REQUIRE(scurve.transform(0.5) == Approx(trapezoid.transform(0.5) + rampDelay(10, 100) + rampDelay(20, 100)));
+}
+
+TEST_CASE("SCurveAcceleration limits acceleration & jerk", "[scurveacceleration]") {
+    const float accel = 1000, jerk = 100000;
+    motion::SCurveAcceleration scurve(accel, jerk, 0.05);
+    SECTION("The move starts with bounded jerk") {
+        scurve.begin(0.5, 100, 0, 0);
+        //starting from rest, a constant jerk covers jerk/6*T^3 in time T. A trapezoid would instead cover accel/2*T^2.
+        for (float t=0.0001f; t<0.002f; t += 0.0001f) {
+            float T = scurve.transform(t);
+            float maxDist = jerk/6*T*T*T;
+            bool isJerkBounded = 100*t <= maxDist*1.001f;
+            REQUIRE(isJerkBounded);
+        }
+    }
+    SECTION("Long moves accelerate continuously and never beyond the limit") {
+        scurve.begin(0.5, 100, 0, 0);
+        SampledMotion motion = sampleMotion(scurve, 0.5, 100);
+        REQUIRE(motion.isMonotonic);
+        bool isVelBounded = motion.maxVel <= 100*1.001f;
+        REQUIRE(isVelBounded);
+        bool isAccelBounded = motion.maxAccel <= 1.05f*accel;
+        REQUIRE(isAccelBounded);
+        //unlike a trapezoid, the acceleration never jumps by a large fraction of its value between adjacent samples
+        bool isAccelContinuous = motion.maxAccelChange < 0.25f*accel;
+        REQUIRE(isAccelContinuous);
+    }
+    SECTION("Short moves that never reach Vmax still respect the limit") {
+        scurve.begin(0.02, 100, 0, 0);
+        SampledMotion motion = sampleMotion(scurve, 0.02, 100);
+        REQUIRE(motion.isMonotonic);
+        bool isAccelBounded = motion.maxAccel <= 1.05f*accel;
+        REQUIRE(isAccelBounded);
+    }
+}
+
+TEST_CASE("SCurveAcceleration fits any change in velocity that the lookahead planner allows", "[scurveacceleration]") {
+    const float accel = 1000, jerk = 100000;
+    motion::SCurveAcceleration scurve(accel, jerk, 0.05);
+    const float Vmax = 100;
+    //changes in velocity both smaller & larger than accel^2/jerk, the smallest that reaches the peak acceleration
+    const float exitVelocities[] = { 3, 8, 30 };
+    for (float Vend : exitVelocities) {
+        //the shortest move in which the planner lets the effector accelerate from rest to Vend
+        float length = Vend*Vend/(2*scurve.maxAcceleration());
+        float duration = length/Vmax;
+        scurve.begin(duration, Vmax, 0, Vend);
+        SampledMotion motion = sampleMotion(scurve, duration, Vmax);
+        REQUIRE(motion.isMonotonic);
+        bool isAccelBounded = motion.maxAccel <= 1.05f*accel;
+        REQUIRE(isAccelBounded);
+        //the move ends at Vend: the average velocity over its last 1% is within 1% of Vend
+        float finalVel = 0.01f*length/(scurve.transform(duration) - scurve.transform(0.99f*duration));
+        bool isAtVend = std::fabs(finalVel - Vend) <= 0.01f*Vend;
+        REQUIRE(isAtVend);
+    }
+}
@@ -0,0 +1,262 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MOTION_SCURVEACCELERATION_H
+#define MOTION_SCURVEACCELERATION_H
+
+#include <cmath> //for std::isnan, std::sqrt, std::cbrt, std::fabs
+#include <algorithm> //for std::min, std::max
+#include "accelerationprofile.h"
+#include "steptime.h" //for ticksFromSeconds, secondsFromTicks
+#include "common/logging.h"
+
+namespace motion {
+
+/* 
+ * SCurveAcceleration is an implementation of motion::AccelerationProfile with a jerk-limited (S-curve) velocity profile.
+ * Where JunctionAcceleration changes velocity along a straight ramp (so the acceleration jumps from 0 to a instantly),
+ *   each velocity ramp here is split into 3 phases: the acceleration increases at a constant jerk, holds, and then decreases at the same jerk.
+ *   Together with the cruise phase, a move has 7 phases in total.
+ *
+ * The acceleration never exceeds @accel. Instead, each ramp takes accel/jerk longer than the trapezoidal ramp that JunctionAcceleration
+ *   would use, as the acceleration takes that long to rise to @accel and fall back to 0. Ramps that change the velocity by less than accel^2/jerk
+ *   never reach @accel, and use a triangular acceleration profile instead.
+ *   A ramp that's symmetric about its midpoint covers (v0+v1)/2 * duration, regardless of its shape, so the lengthened ramps cover more distance.
+ *   The lookahead planner is therefore told that the acceleration is accel/2 (see maxAcceleration()): at that average,
+ *   any change in velocity of at least accel^2/jerk fits in the distance that the planner allows for it.
+ *   Smaller changes may not, in which case the jerk phases are shortened to fit, exceeding the jerk limit but never @accel.
+ *
+ * As with JunctionAcceleration, the input times correspond to a constant velocity of Vmax, so we know the distance, s, and need to solve s(T) for T.
+ *   In the constant-acceleration & cruise phases, this has a closed-form solution.
+ *   In the jerk phases, s(T) is a cubic. But it's also monotonic & convex over the phase (the acceleration is never negative during a ramp),
+ *   so Newton's method started from an upper bound on T converges monotonically (& quadratically). Each jerk phase is only a small
+ *   fraction of the move, so the velocity changes little within it and 1-3 iterations are typically sufficient.
+ * Deceleration is handled by symmetry: viewed backwards in time, the deceleration ramp is just an acceleration from Vend up to the peak velocity.
+ * As with JunctionAcceleration, times given in EventClockT ticks only pass through floats within the ramps.
+ */
+class SCurveAcceleration : public AccelerationProfile {
+    //A single jerk-limited velocity ramp from v0 up to v1 (v1 >= v0).
+    //Provides the inverse mapping from distance travelled since the start of the ramp to time since the start of the ramp.
+    struct Ramp {
+        //duration of the ramp & of each of its jerk phases
+        float Tr, tj;
+        //jerk & (peak) acceleration
+        float jerk, Apeak;
+        //velocity at the start of each phase
+        float v0, vB, vC;
+        //distance at the start of each phase
+        float sB, sC;
+        //distance covered by the whole ramp
+        float length;
+        //@maxDuration if the jerk-limited ramp would take longer than this, then the jerk phases are shortened to fit.
+        //  It must be at least (v1-v0)/accel.
+        inline void begin(float v0, float v1, float accel, float maxJerk, float maxDuration=INFINITY) {
+            this->v0 = v0;
+            float dv = std::max(0.f, v1 - v0);
+            if (dv >= accel*accel/maxJerk) {
+                //the acceleration rises to accel, holds, and falls back to 0.
+                this->tj = accel/maxJerk;
+                this->Apeak = accel;
+                this->Tr = dv/accel + tj;
+            } else {
+                //the acceleration falls back to 0 as soon as it's risen to its peak.
+                this->tj = std::sqrt(dv/maxJerk);
+                this->Apeak = maxJerk*tj;
+                this->Tr = 2*tj;
+            }
+            if (Tr > maxDuration) {
+                //use all of the available time, with the smoothest profile that keeps Apeak*(Tr-tj) == dv and Apeak <= accel.
+                this->Tr = std::max(maxDuration, dv/accel);
+                if (Tr >= 2*dv/accel) {
+                    this->tj = 0.5f*Tr;
+                    this->Apeak = 2*dv/Tr;
+                } else {
+                    this->tj = Tr - dv/accel;
+                    this->Apeak = accel;
+                }
+            }
+            this->jerk = tj > 0 ? Apeak/tj : INFINITY;
+            this->length = 0.5f*(v0 + v1)*Tr;
+            this->vB = v0 + 0.5f*Apeak*tj;
+            this->vC = v1 - 0.5f*Apeak*tj;
+            this->sB = v0*tj + Apeak*tj*tj/6;
+            this->sC = 0.5f*(v0 + v1)*Tr - (v1*tj - Apeak*tj*tj/6);
+        }
+        //@return the time at which the ramp has covered a distance of s
+        inline float time(float s) const {
+            if (s < sB) { //acceleration increasing: s = v0*t + jerk/6*t^3
+                //both v0*t <= s and jerk/6*t^3 <= s, so each gives an upper bound on t
+                float guess = std::min(tj, std::cbrt(6*s/jerk));
+                if (v0 > 0) {
+                    guess = std::min(guess, s/v0);
+                }
+                return solveJerkPhase(s, v0, 0, jerk, guess);
+            } else if (s < sC) { //constant acceleration: s-sB = vB*t + Apeak/2*t^2
+                return tj + (std::sqrt(vB*vB + 2*Apeak*(s - sB)) - vB)/Apeak;
+            } else { //acceleration decreasing: s-sC = vC*t + Apeak/2*t^2 - jerk/6*t^3
+                if (!(tj > 0)) {
+                    return Tr;
+                }
+                float ds = s - sC;
+                float guess = vC > 0 ? std::min(tj, ds/vC) : tj;
+                return Tr - tj + solveJerkPhase(ds, vC, Apeak, -jerk, guess);
+            }
+        }
+        //solve s == v*t + a/2*t^2 + j/6*t^3 for t, given an initial guess that's >= the true t.
+        static inline float solveJerkPhase(float s, float v, float a, float j, float t) {
+            for (int i=0; i<8; ++i) {
+                float f = t*(v + t*(0.5f*a + t*(j/6))) - s;
+                float df = v + t*(a + 0.5f*j*t);
+                if (!(df > 0)) {
+                    break;
+                }
+                float dt = f/df;
+                t -= dt;
+                if (std::fabs(dt) < 1e-7f) {
+                    break;
+                }
+            }
+            return std::max(0.f, t);
+        }
+    };
+    float _accel;
+    float _jerk;
+    float _junctionDeviation;
+    float moveDuration;
+    //if the move has no cartesian component (e.g. extrusion only), then there's nothing to accelerate.
+    bool isIdentity;
+    //boundaries of the accelerating and decelerating phases, in terms of the (untransformed) input time
+    float tmax1, tmax2;
+    //real time at which the acceleration phase ends, and at which the move completes
+    float T1, Tend;
+    float Vmax;
+    //ratio of Vmax to the velocity at which the move actually cruises, which is less than Vmax if the move is too short to fully accelerate.
+    float cruiseScale;
+    Ramp up, down;
+    //tmax1, tmax2, T1, Tend & moveDuration in EventClockT ticks
+    EventClockT::duration _tmax1Ticks, _tmax2Ticks, _T1Ticks, _TendTicks, _durationTicks;
+    inline float a() const { return _accel; }
+    //@return the real duration of @elapsed ticks of the cruise phase.
+    //  Unless the move is too short to reach Vmax (in which case the cruise phase is negligible), this is exact.
+    inline EventClockT::duration _cruiseTicks(EventClockT::duration elapsed) const {
+        return cruiseScale == 1 ? elapsed : ticksFromSeconds(secondsFromTicks(elapsed)*cruiseScale);
+    }
+    public:
+        //@accel maximum cartesian acceleration, in mm/sec^2
+        //@jerk maximum rate of change of the acceleration, in mm/sec^3
+        //@junctionDeviation distance (mm) the effector may deviate from a sharp corner; larger values allow faster cornering.
+        //  See motion/lookaheadplanner.h for how this is used.
+        inline SCurveAcceleration(float accel, float jerk, float junctionDeviation) 
+          : _accel(accel), _jerk(jerk), _junctionDeviation(junctionDeviation) {}
+        //the acceleration used by the lookahead planner. See the class description.
+        inline float maxAcceleration() const {
+            return 0.5f*_accel;
+        }
+        inline float junctionDeviation() const {
+            return _junctionDeviation;
+        }
+        inline void begin(float moveDuration, float Vmax, float Vstart=0, float Vend=0) {
+            this->moveDuration = moveDuration;
+            this->isIdentity = !(Vmax > 0);
+            if (isIdentity) {
+                return;
+            }
+            //moves with a NAN duration (homing) never decelerate.
+            bool isUnbounded = std::isnan(moveDuration);
+            float length = Vmax*moveDuration;
+            Vend = isUnbounded ? Vmax : Vend;
+            float Vpeak = Vmax;
+            up.begin(Vstart, Vpeak, a(), _jerk);
+            down.begin(Vend, Vpeak, a(), _jerk);
+            if (!isUnbounded && up.length + down.length > length) {
+                //for really short movements, we may not be able to fully accelerate.
+                //  The ramps' lengths increase with Vpeak, so bisect for the greatest Vpeak at which they fit.
+                float lo = std::max(Vstart, Vend), hi = Vmax;
+                for (int i=0; i<20; ++i) {
+                    Vpeak = 0.5f*(lo + hi);
+                    up.begin(Vstart, Vpeak, a(), _jerk);
+                    down.begin(Vend, Vpeak, a(), _jerk);
+                    if (up.length + down.length > length) {
+                        hi = Vpeak;
+                    } else {
+                        lo = Vpeak;
+                    }
+                }
+                Vpeak = lo;
+                up.begin(Vstart, Vpeak, a(), _jerk);
+                down.begin(Vend, Vpeak, a(), _jerk);
+                if (up.length + down.length > length) {
+                    //even the ramp between Vstart & Vend doesn't fit at the jerk limit (the other ramp is empty). Shorten its jerk phases instead.
+                    Ramp &ramp = Vstart < Vend ? up : down;
+                    float v0 = std::min(Vstart, Vend);
+                    ramp.begin(v0, Vpeak, a(), _jerk, length/(0.5f*(v0 + Vpeak)));
+                }
+            }
+            this->Vmax = Vmax;
+            this->cruiseScale = Vpeak > 0 ? Vmax/Vpeak : 0;
+            this->tmax1 = up.length/Vmax;
+            this->tmax2 = isUnbounded ? INFINITY : std::max(tmax1, (length - down.length)/Vmax);
+            this->T1 = up.Tr;
+            this->Tend = T1 + (tmax2 - tmax1)*cruiseScale + down.Tr;
+            this->_durationTicks = ticksFromSeconds(moveDuration);
+            this->_tmax1Ticks = ticksFromSeconds(tmax1);
+            this->_T1Ticks = ticksFromSeconds(T1);
+            if (isUnbounded) {
+                this->_tmax2Ticks = this->_TendTicks = EventClockT::duration::max();
+            } else {
+                this->_tmax2Ticks = std::max(_tmax1Ticks, _durationTicks - ticksFromSeconds(down.length/Vmax));
+                this->_TendTicks = _T1Ticks + _cruiseTicks(_tmax2Ticks - _tmax1Ticks) + ticksFromSeconds(down.Tr);
+            }
+            LOGD("SCurveAccel::begin dur, Vmax, Vstart, Vend: %f, %f, %f, %f\n", moveDuration, Vmax, Vstart, Vend);
+            LOGD("SCurveAccel::begin tmax1, tmax2, T1, Tend, Apeak: %f, %f, %f, %f, %f\n", tmax1, tmax2, T1, Tend, std::max(up.Apeak, down.Apeak));
+        }
+        inline float transform(float time) {
+            LOGV("SCurveAccel::transform: %f\n", time);
+            if (isIdentity) {
+                return time;
+            } else if (time < tmax1) { //accelerating
+                return up.time(Vmax*time);
+            } else if (time < tmax2) { //constant velocity
+                return T1 + (time - tmax1)*cruiseScale;
+            } else { //decelerating. Should never be reached if moveDuration was NAN (ie in homing routine)
+                return Tend - down.time(Vmax*std::max(0.f, moveDuration - time));
+            }
+        }
+        //transform a time given in EventClockT ticks since the start of the move
+        inline EventClockT::duration transform(EventClockT::duration time) {
+            if (isIdentity) {
+                return time;
+            } else if (time < _tmax1Ticks) { //accelerating
+                return ticksFromSeconds(up.time(Vmax*secondsFromTicks(time)));
+            } else if (time < _tmax2Ticks) { //constant velocity
+                return _T1Ticks + _cruiseTicks(time - _tmax1Ticks);
+            } else { //decelerating
+                return _TendTicks - ticksFromSeconds(down.time(Vmax*std::max(0.f, secondsFromTicks(_durationTicks - time))));
+            }
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,114 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MOTION_STEPTIME_H
+#define MOTION_STEPTIME_H
+
+#include <cmath> //for std::fabs
+#include <cstdint> //for int32_t, int64_t, uint32_t
+
+#include "platforms/auto/chronoclock.h" //for EventClockT
+
+/*
+ * Step times are carried from the AxisSteppers, through the AccelerationProfile, to the OutputEvents as EventClockT ticks since the start of their move.
+ * A float only resolves about 8 us at 100 s, so float seconds are confined to quantities that stay small,
+ *   such as the kinematic solves and the time spent within an acceleration ramp. These functions convert between the two.
+ */
+namespace motion {
+
+namespace steptime {
+    constexpr float ticksPerSecond() {
+        return (float)EventClockT::period::den / EventClockT::period::num;
+    }
+    //longest time (in seconds) that's converted through an int32_t: 18 minutes for microsecond ticks, 1 second for nanosecond ticks.
+    constexpr float maxInt32Seconds() {
+        return (float)(1 << 30) / ticksPerSecond();
+    }
+    //longest time (in seconds) that's converted at all
+    constexpr float maxSeconds() {
+        return (float)(1ll << 62) / ticksPerSecond();
+    }
+}
+
+//@return the number of EventClockT ticks in @seconds, truncated as std::chrono::duration_cast would,
+//  or EventClockT::duration::max() if @seconds is NaN or too large to represent.
+//Times up to steptime::maxInt32Seconds() are converted through an int32_t, which is a single instruction on ARMv6,
+//  whereas a conversion to the clock's 64-bit rep is a library call.
+inline EventClockT::duration ticksFromSeconds(float seconds) {
+    if (std::fabs(seconds) < steptime::maxInt32Seconds()) {
+        return EventClockT::duration((int32_t)(seconds*steptime::ticksPerSecond()));
+    } else if (std::fabs(seconds) < steptime::maxSeconds()) {
+        return EventClockT::duration((EventClockT::rep)(seconds*steptime::ticksPerSecond()));
+    } else {
+        return EventClockT::duration::max();
+    }
+}
+
+//@return @ticks in seconds. Likewise, short times are converted from an int32_t.
+inline float secondsFromTicks(EventClockT::duration ticks) {
+    if (ticks.count() < (1 << 30) && ticks.count() > -(1 << 30)) {
+        return (int32_t)ticks.count() / steptime::ticksPerSecond();
+    } else {
+        return ticks.count() / steptime::ticksPerSecond();
+    }
+}
+
+/*
+ * StepInterval is a constant time between steps, kept in EventClockT ticks with 16 fractional bits.
+ * The time of step #n is found by a single integer multiplication, so it's exact to within a tick however many steps precede it,
+ *   and the interval between consecutive steps never varies by more than a tick.
+ * Intervals longer than 2^40 ticks (over 12 days of microseconds, or 18 minutes of nanoseconds) are never reached (e.g. the axis doesn't move).
+ */
+class StepInterval {
+    static constexpr int FRAC_BITS = 16;
+    static constexpr int64_t NEVER = -1;
+    int64_t _fixed; //ticks * 2^FRAC_BITS, or NEVER
+    public:
+        inline StepInterval() : _fixed(NEVER) {}
+        //@seconds the interval, which may be infinite or NaN (in which case no step is ever reached)
+        inline explicit StepInterval(float seconds) {
+            float fixed = seconds*steptime::ticksPerSecond()*(1 << FRAC_BITS);
+            _fixed = fixed > 0 && fixed < (float)(1ll << (40+FRAC_BITS)) ? (int64_t)fixed : NEVER;
+        }
+        inline bool isNever() const {
+            return _fixed == NEVER;
+        }
+        //@return the time of step #step, where step #0 is at time 0, or EventClockT::duration::max() if it's never reached.
+        inline EventClockT::duration timeOfStep(uint32_t step) const {
+            return isNever() ? EventClockT::duration::max() : EventClockT::duration((step*_fixed) >> FRAC_BITS);
+        }
+        //@return the number of steps (after step #0) whose time is <= @time.
+        inline uint32_t stepsUntil(EventClockT::duration time) const {
+            if (isNever() || time.count() < 0) {
+                return 0;
+            }
+            //timeOfStep(n) <= time  <=>  n*_fixed < (time+1) * 2^FRAC_BITS
+            int64_t limit = time.count() < (1ll << 46) ? time.count()+1 : (1ll << 46);
+            int64_t steps = ((limit << FRAC_BITS) - 1) / _fixed;
+            return steps < UINT32_MAX ? (uint32_t)steps : UINT32_MAX;
+        }
+};
+
+}
+
+#endif
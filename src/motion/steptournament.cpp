@@ -0,0 +1,116 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "steptournament.h"
+#include "catch.hpp"
+
+#include <cstdlib> //for rand
+#include <string> //for std::to_string
+#include "common/benchmark.h"
+
+namespace {
+    const EventClockT::duration NO_STEP = EventClockT::duration::max();
+}
+
+//the selection that StepTournament replaces: a pairwise scan over all axes.
+template <std::size_t N> static std::size_t linearScanNextTime(const EventClockT::duration *times) {
+    std::size_t best = 0;
+    for (std::size_t i=1; i<N; ++i) {
+        best = times[best] <= times[i] ? best : i;
+    }
+    return best;
+}
+
+TEST_CASE("StepTournament always yields the first, earliest step time", "[steptournament]") {
+    const std::size_t numAxes = 7;
+    motion::StepTournament<numAxes> tournament;
+    EventClockT::duration times[numAxes];
+    for (std::size_t i=0; i<numAxes; ++i) {
+        times[i] = NO_STEP;
+        tournament.set(i, times[i]);
+    }
+    srand(1);
+    for (int iter=0; iter<2000; ++iter) {
+        //replace a random axis's time with a random one, or with no step at all. Use few distinct times, so there are plenty of ties.
+        std::size_t idx = rand() % numAxes;
+        int r = rand() % 20;
+        times[idx] = r == 0 ? NO_STEP : EventClockT::duration(r*250);
+        tournament.set(idx, times[idx]);
+        std::size_t expectedIdx = numAxes;
+        for (std::size_t i=0; i<numAxes; ++i) {
+            if (times[i] != NO_STEP && (expectedIdx == numAxes || times[i] < times[expectedIdx])) {
+                expectedIdx = i;
+            }
+        }
+        std::size_t winner = tournament.winner();
+        REQUIRE(winner < numAxes);
+        if (expectedIdx == numAxes) {
+            //no axis has a next step, so the winner mustn't either
+            bool isNoStep = times[winner] == NO_STEP && tournament.winnerTime() == NO_STEP;
+            REQUIRE(isNoStep);
+        } else {
+            REQUIRE(winner == expectedIdx);
+            //the linear scan agrees on the time
+            bool isSameTime = times[linearScanNextTime<numAxes>(times)] == times[winner];
+            REQUIRE(isSameTime);
+        }
+    }
+}
+
+//Simulate N axes stepping at different, constant rates,
+//  selecting the next axis with either a StepTournament or a linear scan.
+//@return the sum of the selected step times. The two may break ties differently, but then they only swap the order of equal times, so the sums are identical.
+template <std::size_t N, bool UseTournament> static double simulateSteps(int numSteps) {
+    EventClockT::duration times[N], intervals[N];
+    motion::StepTournament<N> tournament;
+    for (std::size_t i=0; i<N; ++i) {
+        intervals[i] = EventClockT::duration(1000000 / (100*(i+1) + 37*i*i));
+        times[i] = intervals[i];
+        tournament.set(i, times[i]);
+    }
+    double checksum = 0;
+    for (int step=0; step<numSteps; ++step) {
+        std::size_t idx = UseTournament ? tournament.winner() : linearScanNextTime<N>(times);
+        checksum += times[idx].count();
+        times[idx] += intervals[idx];
+        if (UseTournament) {
+            tournament.set(idx, times[idx]);
+        }
+    }
+    return checksum;
+}
+
+template <std::size_t N> static void benchmarkStepTournament() {
+    const int numSteps = 20000000;
+    benchmark::Timing scan = benchmark::measure(numSteps, [&]() { return simulateSteps<N, false>(numSteps); });
+    benchmark::Timing tournament = benchmark::measure(numSteps, [&]() { return simulateSteps<N, true>(numSteps); });
+    benchmark::logComparison("StepTournament, " + std::to_string(N) + " axes", "step", "linear scan", scan, "tournament", tournament);
+    REQUIRE(scan.checksum == tournament.checksum);
+}
+
+//StepTournament vs a linear scan over the axes' step times.
+TEST_CASE("StepTournament benchmark", "[.][benchmark][steptournament]") {
+    benchmarkStepTournament<4>();
+    benchmarkStepTournament<6>();
+    benchmarkStepTournament<8>();
+}
@@ -0,0 +1,111 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+ 
+
+#ifndef MOTION_STEPTOURNAMENT_H
+#define MOTION_STEPTOURNAMENT_H
+
+#include <array>
+#include <cstddef> //for std::size_t
+#include <tuple>
+
+#include "compileflags.h" //for CACHE_LINE_SIZE
+#include "common/tupleutil.h"
+#include "platforms/auto/chronoclock.h" //for EventClockT
+
+namespace motion {
+
+/* 
+ * Tournament tree (winner tree) over the next step times of N AxisSteppers.
+ * The index of the axis with the earliest step is available in O(1),
+ *   and after one axis advances, only the log2(N) matches on the path from its leaf to the root are replayed.
+ * This replaces a linear scan over every axis for every step, which becomes significant on machines with 6-8 steppers.
+ *
+ * An axis with no next step has a time of EventClockT::duration::max() (i.e. AxisStepper::NO_STEP()), which is later than any other,
+ *   so each match is a single branch-free comparison.
+ * When times are equal, the axis with the lower index wins.
+ *
+ * @N number of axes. The tree is padded to a power of 2 with leaves that never win.
+ *   N may be 0 (machines without steppers), in which case winner() is meaningless.
+ */
+template <std::size_t N> class StepTournament {
+    static constexpr std::size_t _roundUpPow2(std::size_t n, std::size_t p=1) {
+        return p >= n ? p : _roundUpPow2(n, 2*p);
+    }
+    static constexpr std::size_t numLeaves = _roundUpPow2(N);
+    //_times[i] is the time of axis #i (or EventClockT::duration::max() for padding leaves).
+    //These are read by every match, so keep them together on as few cache lines as possible.
+    alignas(CACHE_LINE_SIZE) std::array<EventClockT::duration, numLeaves> _times;
+    //_winners[k] is the index of the axis that won the match at node k. Node 1 is the root, the children of node k are 2k & 2k+1,
+    //  and the leaf of axis #i is node numLeaves+i.
+    std::array<std::size_t, 2*numLeaves> _winners;
+    public:
+        //initially, no axis has a next step.
+        StepTournament() {
+            for (std::size_t i=0; i<numLeaves; ++i) {
+                _times[i] = EventClockT::duration::max();
+                _winners[numLeaves+i] = i;
+            }
+            for (std::size_t k=numLeaves-1; k>0; --k) {
+                _replay(k);
+            }
+        }
+        //@return the index of the axis with the earliest step time.
+        //  If no axis has a next step, then neither does the returned axis.
+        std::size_t winner() const {
+            return _winners[1];
+        }
+        //@return the time of the winner's next step, or EventClockT::duration::max() if no axis has a next step.
+        EventClockT::duration winnerTime() const {
+            return _times[_winners[1]];
+        }
+        //update the time of axis #idx and replay the matches along its path to the root.
+        void set(std::size_t idx, EventClockT::duration time) {
+            _times[idx] = time;
+            for (std::size_t k=(numLeaves+idx)/2; k>0; k/=2) {
+                _replay(k);
+            }
+        }
+        //rebuild the whole tree from the .time attribute of each AxisStepper in the tuple (e.g. when a new move begins)
+        template <typename TupleT> void reset(const TupleT &axes) {
+            static_assert(std::tuple_size<TupleT>::value == N, "StepTournament size must match the number of axes");
+            callOnAll(axes, _ReadTime(), this);
+            for (std::size_t k=numLeaves-1; k>0; --k) {
+                _replay(k);
+            }
+        }
+    private:
+        inline void _replay(std::size_t k) {
+            std::size_t left = _winners[2*k], right = _winners[2*k+1];
+            _winners[k] = _times[right] < _times[left] ? right : left;
+        }
+        struct _ReadTime {
+            template <std::size_t MyIdx, typename T> void operator()(std::integral_constant<std::size_t, MyIdx>, const T &stepper, StepTournament *self) {
+                self->_times[MyIdx] = stepper.time;
+            }
+        };
+};
+
+}
+
+#endif
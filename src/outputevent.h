@@ -32,25 +32,34 @@
 /* 
  * An OutputEvent encapsulates information about the desired state for a GPIO pin at a given time.
  *   Eg, "set pin (2) (high) at t=(1234567) uS", or "set pin (44) (low) at t=(887766) uS"
+ * It may also describe a pulse, in which case the pin is returned to the opposite state after a given width.
+ *   Eg, "set pin (3) (low) at t=(1234567) uS, and then (high) at t=(1234575) uS"
+ *   This allows a step pulse to pass through the scheduler as a single event.
  */
 class OutputEvent {
     EventClockT::time_point _time;
     PrimitiveIoPin _pin;
     IoLevel _state;
+    //zero if this isn't a pulse
+    EventClockT::duration _pulseWidth;
     public:
         //default constructor. Creates an OutputEvent where isNull() will return true
         inline OutputEvent()
-        : _time(std::chrono::seconds(0)), _pin(PrimitiveIoPin::null()), _state(IoLow) {
+        : _time(std::chrono::seconds(0)), _pin(PrimitiveIoPin::null()), _state(IoLow), _pulseWidth(0) {
         }
         //Construct from a time point, a pin and a state.
         //@time the time at which the pin state should be altered.
         //@state the logical state the pin should be put in *before* any inversions have been processed.
         //  so if @state is IoHigh, pin.areWritesInverted() == true, then the physical hardware pin will output LOW (0V / Ground)
         inline OutputEvent(EventClockT::time_point time, const iodrv::IoPin &pin, bool state) 
-        : _time(time), _pin(pin.primitiveIoPin()), _state(pin.translateWriteToPrimitive(state)) {
+        : _time(time), _pin(pin.primitiveIoPin()), _state(pin.translateWriteToPrimitive(state)), _pulseWidth(0) {
+        }
+        //Construct a pulse: the pin is put in @state at @time, and then returned to the opposite state at @time + @pulseWidth.
+        inline OutputEvent(EventClockT::time_point time, const iodrv::IoPin &pin, bool state, EventClockT::duration pulseWidth) 
+        : _time(time), _pin(pin.primitiveIoPin()), _state(pin.translateWriteToPrimitive(state)), _pulseWidth(pulseWidth) {
         }
         inline bool operator==(const OutputEvent &other) {
-            return _time == other._time && _pin.id() == other._pin.id() && _state == other._state;
+            return _time == other._time && _pin.id() == other._pin.id() && _state == other._state && _pulseWidth == other._pulseWidth;
         }
         //@return the time at which the pin state should be altered.
         inline EventClockT::time_point time() const {
@@ -71,6 +80,14 @@ class OutputEvent {
         inline bool state() const {
             return _state;
         }
+        //@return true if the pin should be returned to !state() after pulseWidth()
+        inline bool isPulse() const {
+            return _pulseWidth != EventClockT::duration(0);
+        }
+        //@return the time between setting the pin to state() and returning it to !state(), or 0 if this isn't a pulse.
+        inline EventClockT::duration pulseWidth() const {
+            return _pulseWidth;
+        }
         //@return true if the OutputEvent was default-constructed.
         inline bool isNull() const {
             return _time == EventClockT::time_point(std::chrono::seconds(0));
@@ -25,29 +25,66 @@
 #define PLATFORMS_GENERIC_HARDWARESCHEDULER_H
 
 #include <cassert> //for assert
+#include <cstddef> //for std::size_t
+#include <array>
 
 #include "platforms/auto/chronoclock.h" //for EventClockT
 #include "platforms/auto/primitiveiopin.h"
+#include "platforms/auto/thisthreadsleep.h" //for SleepT
+#include "outputevent.h" //for OutputEvent (the trailing edges of pulses are held by value)
 #include "schedulerbase.h" //for OnIdleCpuIntervalT (cannot forward-declare an enum)
 #include "common/logging.h"
 
-//forward declare for class defined in outputevent.h
-class OutputEvent; 
-
 
 namespace plat {
 namespace generic {
 
 struct HardwareScheduler {
-    //add this event to the hardware queue, waiting until schedTime(evt.time()) if necessary
-    inline void queue(OutputEvent evt) {
+    inline HardwareScheduler() : _pendingPulses(), _numPendingPulses(0) {}
+    //number of OutputEvents that the Scheduler should hold until their time comes.
+    //Events are executed right as they're due, so there's nothing to be gained by seeing far ahead.
+    static constexpr std::size_t queueCapacity() {
+        return 64;
+    }
+    //add this event to the hardware queue. The Scheduler only passes events on once their time has come, so it's output immediately.
+    //@return false if the event isn't yet within the writable window (never the case here).
+    inline bool queue(OutputEvent evt) {
+        //a pin's previous pulse must be ended before the pin is written again.
+        endPulses(EventClockT::now(), &evt);
         evt.primitiveIoPin().digitalWrite(evt.state());
+        if (evt.isPulse()) {
+            //Don't block the event thread for the width of the pulse: the trailing edge is written by a later call to queue() or onIdleCpu().
+            //  In the unlikely case that too many pulses are in flight, sleep (rather than spin) until the earliest one ends.
+            if (_numPendingPulses == MAX_PENDING_PULSES) {
+                SleepT::sleep_until(pulseEnd(false));
+                endPulses(EventClockT::now());
+            }
+            PendingPulse pending = { EventClockT::now() + evt.pulseWidth(), evt };
+            _pendingPulses[_numPendingPulses++] = pending;
+        }
+        return true;
+    }
+    //add a span of events (sorted by time) to the hardware queue
+    //@return pointer to the first event that couldn't be queued yet (or end, if all were queued)
+    inline const OutputEvent* queue(const OutputEvent *begin, const OutputEvent *end) {
+        for (; begin != end; ++begin) {
+            queue(*begin);
+        }
+        //the span may have taken longer to output than the pulses it started.
+        endPulses(EventClockT::now());
+        return end;
     }
-    //Set the given pin to a pwm duty-cycle of `ratio` using a maximum period of maxPeriod (irrelevant if using PCM algorithm). 
+    //Set the given pin to a pwm duty-cycle of `ratio` using a period of idealPeriod (or a sensible default, if 0).
     //E.g. queuePwm(5, 0.4) sets pin #5 to a 40% duty cycle.
-    inline void queuePwm(const PrimitiveIoPin &pin, float ratio, float idealPeriod) {
+    //The generic PrimitiveIoPin has no outputs, so there's nothing to drive yet.
+    //  A platform with real pins can generate the pwm in software with a SoftPwm (platforms/generic/softpwm.h) and its own PinWriter.
+    inline void queuePwm(const PrimitiveIoPin &pin, float ratio, EventClockT::duration idealPeriod) {
         (void)pin; (void)ratio; (void)idealPeriod; //unused
-        LOGW("Warning: default platforms/generic/hardwarescheduler.h cannot queuePwm()\n");
+        LOGW_ONCE("Warning: default platforms/generic/hardwarescheduler.h cannot queuePwm()\n");
+    }
+    //@return the latest event time that can be queued right now without being refused.
+    inline EventClockT::time_point writableUntil() const {
+        return EventClockT::now();
     }
     //If an event needs to occur at evtTime, this function should return the earliest time at which it can be scheduled.
     inline EventClockT::time_point schedTime(EventClockT::time_point evtTime) const {
@@ -58,7 +95,47 @@ struct HardwareScheduler {
     //@return true if we request more cpu time.
     inline bool onIdleCpu(OnIdleCpuIntervalT interval) {
         (void)interval; //unused
-        return false; //no more cpu needed
+        //The Scheduler is about to sleep until the next event, which could be far later than the end of the pending pulses.
+        //  Requesting more cpu instead would spin the event loop, so wait out the pulses here: they began at most one pulse width ago.
+        if (_numPendingPulses != 0) {
+            SleepT::sleep_until(pulseEnd(true));
+            endPulses(EventClockT::now());
+        }
+        return false;
+    }
+    private:
+    //Pulses that have been started, but whose trailing edge hasn't yet been written.
+    //  Each step pulse passes through here, so this only needs to hold about one pulse per axis.
+    static constexpr std::size_t MAX_PENDING_PULSES = 16;
+    struct PendingPulse {
+        EventClockT::time_point endTime; //when the pin may be returned to !pulse.state()
+        OutputEvent pulse;
+    };
+    std::array<PendingPulse, MAX_PENDING_PULSES> _pendingPulses;
+    std::size_t _numPendingPulses;
+    //@return the time at which the earliest (or latest, if @latest) pending pulse ends. Requires _numPendingPulses != 0.
+    inline EventClockT::time_point pulseEnd(bool latest) const {
+        assert(_numPendingPulses != 0);
+        EventClockT::time_point end = _pendingPulses[0].endTime;
+        for (std::size_t idx = 1; idx < _numPendingPulses; ++idx) {
+            if (latest ? _pendingPulses[idx].endTime > end : _pendingPulses[idx].endTime < end) {
+                end = _pendingPulses[idx].endTime;
+            }
+        }
+        return end;
+    }
+    //write the trailing edge of every pending pulse that is due by @time, or that is on the same pin as @next.
+    inline void endPulses(EventClockT::time_point time, const OutputEvent *next=nullptr) {
+        std::size_t idx = 0;
+        while (idx < _numPendingPulses) {
+            OutputEvent &pulse = _pendingPulses[idx].pulse;
+            if (_pendingPulses[idx].endTime <= time || (next && pulse.primitiveIoPin().id() == next->primitiveIoPin().id())) {
+                pulse.primitiveIoPin().digitalWrite(!pulse.state());
+                _pendingPulses[idx] = _pendingPulses[--_numPendingPulses];
+            } else {
+                ++idx;
+            }
+        }
     }
 };
 }
@@ -76,6 +76,16 @@ class PrimitiveIoPin {
             (void)duty; (void)desiredPeriod;
             LOGW_ONCE("Attempt to pwmWrite() the generic PrimitiveIoPin interface\n");
         }
+        //configure the pin to output a pulse (at level pulseLevel) of length onTime every period, without software intervention (if supported by the platform)
+        inline void makePulseOutput(EventClockT::duration onTime, EventClockT::duration period, IoLevel pulseLevel) {
+            (void)onTime; (void)period; (void)pulseLevel;
+            LOGW_ONCE("Attempt to makePulseOutput() the generic PrimitiveIoPin interface\n");
+        }
+        //set pulse length & period. Must call makePulseOutput beforehand.
+        inline void pulseWrite(EventClockT::duration onTime, EventClockT::duration period, IoLevel pulseLevel) {
+            (void)onTime; (void)period; (void)pulseLevel;
+            LOGW_ONCE("Attempt to pulseWrite() the generic PrimitiveIoPin interface\n");
+        }
 };
 
 }
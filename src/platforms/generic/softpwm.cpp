@@ -0,0 +1,221 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "softpwm.h"
+
+#include <cassert>
+#include <algorithm> //for std::max, std::min
+#include <pthread.h> //for pthread_setschedparam
+
+#include "platforms/auto/thisthreadsleep.h" //for SleepT
+#include "schedulerbase.h" //for SCHED_PRIORITY
+#include "common/logging.h"
+#include "catch.hpp"
+
+namespace plat {
+namespace generic {
+
+void MockPinWriter::write(EventClockT::time_point deadline, const PinWrite *begin, const PinWrite *end) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    Batch batch = { deadline, EventClockT::now(), std::vector<PinWrite>(begin, end) };
+    _batches.push_back(std::move(batch));
+    _written.notify_all();
+}
+
+std::vector<MockPinWriter::Batch> MockPinWriter::batches(std::size_t count, EventClockT::duration timeout) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _written.wait_for(lock, timeout, [&]() { return _batches.size() >= count; });
+    return _batches;
+}
+
+SoftPwm::SoftPwm(PinWriter &writer) : _writer(writer), _epoch(EventClockT::now()), _sleepingUntil(_epoch), _doStop(false) {}
+
+SoftPwm::~SoftPwm() {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _doStop = true;
+    }
+    _wake.notify_one();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+void SoftPwm::queuePwm(int pinId, float duty, EventClockT::duration period) {
+    if (period == EventClockT::duration(0)) {
+        period = SOFTPWM_DEFAULT_PERIOD;
+    }
+    period = std::max<EventClockT::duration>(period, SOFTPWM_MIN_PERIOD);
+    duty = std::max(0.f, std::min(1.f, duty));
+    EventClockT::duration onTime((EventClockT::rep)(period.count()*(double)duty));
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (Channel &ch : _channels) {
+        if (ch.pinId == pinId) {
+            //takes effect at the start of the channel's next period
+            ch.nextOnTime = onTime;
+            ch.nextPeriod = period;
+            return;
+        }
+    }
+    Channel ch = { pinId, IoLow, false, onTime, period, onTime, period };
+    _channels.push_back(ch);
+    //start on the first period boundary that's at or after the deadline the thread is sleeping until (so it needn't be woken early).
+    EventClockT::time_point earliest = std::max(EventClockT::now(), _sleepingUntil) - EventClockT::duration(1);
+    Edge start = { _channels.size()-1, true };
+    _deadlines[nextPeriodStart(earliest, period)].push_back(start);
+    if (!_thread.joinable()) {
+        _thread = std::thread([this]() {
+            this->threadLoop();
+        });
+    }
+    _wake.notify_one();
+}
+
+void SoftPwm::threadLoop() {
+    #if USE_PTHREAD
+        struct sched_param sp;
+        sp.sched_priority = SCHED_PRIORITY;
+        if (int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp)) {
+            LOGW("Warning: SoftPwm: pthread_setschedparam (increase thread priority) returned non-zero: %i\n", ret);
+        }
+    #endif
+    std::vector<Edge> edges;
+    std::vector<PinWrite> writes;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_doStop) {
+        if (_deadlines.empty()) {
+            _wake.wait(lock);
+            continue;
+        }
+        _sleepingUntil = _deadlines.begin()->first;
+        lock.unlock();
+        SleepT::sleep_until(_sleepingUntil);
+        lock.lock();
+        if (_doStop) {
+            break;
+        }
+        //edges may have been added at _sleepingUntil (but never before it) while we slept; they belong to this batch.
+        auto due = _deadlines.begin();
+        assert(due->first == _sleepingUntil);
+        edges.swap(due->second);
+        _deadlines.erase(due);
+        writes.clear();
+        for (const Edge &edge : edges) {
+            fire(edge, _sleepingUntil, writes);
+        }
+        edges.clear();
+        if (!writes.empty()) {
+            _writer.write(_sleepingUntil, writes.data(), writes.data() + writes.size());
+        }
+    }
+}
+
+void SoftPwm::fire(const Edge &edge, EventClockT::time_point time, std::vector<PinWrite> &writes) {
+    Channel &ch = _channels[edge.channelIdx];
+    IoLevel level = IoLow;
+    if (edge.isPeriodStart) {
+        ch.onTime = ch.nextOnTime;
+        ch.period = ch.nextPeriod;
+        EventClockT::time_point nextStart = nextPeriodStart(time, ch.period);
+        //if the period has just changed, this time mightn't be on one of its boundaries. Then stay low until the first one.
+        bool isWholePeriod = nextStart - time == ch.period;
+        level = isWholePeriod && ch.onTime > EventClockT::duration(0);
+        if (level && ch.onTime < ch.period) {
+            Edge fall = { edge.channelIdx, false };
+            _deadlines[time + ch.onTime].push_back(fall);
+        }
+        Edge start = { edge.channelIdx, true };
+        _deadlines[nextStart].push_back(start);
+    }
+    if (level != ch.level || !ch.isLevelKnown) {
+        ch.level = level;
+        ch.isLevelKnown = true;
+        PinWrite write = { ch.pinId, level };
+        writes.push_back(write);
+    }
+}
+
+EventClockT::time_point SoftPwm::nextPeriodStart(EventClockT::time_point after, EventClockT::duration period) const {
+    //periods are aligned to the engine's creation, so that channels with equal periods share their deadlines.
+    return _epoch + ((after - _epoch)/period + 1)*period;
+}
+
+}
+}
+
+//Only the deadlines that SoftPwm schedules are checked, as the OS may wake its thread arbitrarily late when the test machine is busy.
+TEST_CASE("SoftPwm outputs the requested duty cycle & period", "[softpwm]") {
+    plat::generic::MockPinWriter mock;
+    std::vector<plat::generic::MockPinWriter::Batch> batches;
+    {
+        plat::generic::SoftPwm pwm(mock);
+        pwm.queuePwm(3, 0.25, std::chrono::milliseconds(10));
+        batches = mock.batches(20);
+    }
+    REQUIRE(batches.size() >= 20);
+    std::vector<EventClockT::time_point> riseDeadlines, fallDeadlines;
+    for (const plat::generic::MockPinWriter::Batch &batch : batches) {
+        REQUIRE(batch.writes.size() == 1);
+        REQUIRE(batch.writes[0].pinId == 3);
+        //the OS may wake the thread late, but never early.
+        REQUIRE(batch.time >= batch.deadline);
+        if (batch.writes[0].level == IoHigh) {
+            riseDeadlines.push_back(batch.deadline);
+        } else if (!riseDeadlines.empty()) {
+            fallDeadlines.push_back(batch.deadline);
+        }
+    }
+    //the edges must alternate, and each must be scheduled exactly, regardless of how late the previous wake-ups were.
+    REQUIRE(riseDeadlines.size() >= fallDeadlines.size());
+    REQUIRE(riseDeadlines.size() <= fallDeadlines.size() + 1);
+    for (std::size_t i=1; i<riseDeadlines.size(); ++i) {
+        long period = std::chrono::duration_cast<std::chrono::nanoseconds>(riseDeadlines[i] - riseDeadlines[i-1]).count();
+        REQUIRE(period == 10000000);
+    }
+    for (std::size_t i=0; i<fallDeadlines.size(); ++i) {
+        long onTime = std::chrono::duration_cast<std::chrono::nanoseconds>(fallDeadlines[i] - riseDeadlines[i]).count();
+        REQUIRE(onTime == 2500000);
+    }
+}
+
+TEST_CASE("SoftPwm handles channels that share a period with a single wake-up per edge", "[softpwm]") {
+    plat::generic::MockPinWriter mock;
+    std::vector<plat::generic::MockPinWriter::Batch> batches;
+    {
+        plat::generic::SoftPwm pwm(mock);
+        for (int pin=0; pin<12; ++pin) {
+            pwm.queuePwm(pin, 0.5, std::chrono::milliseconds(5));
+        }
+        //2 edges per 5 ms period
+        batches = mock.batches(16);
+    }
+    REQUIRE(batches.size() >= 16);
+    for (std::size_t i=0; i<batches.size(); ++i) {
+        REQUIRE(batches[i].writes.size() == 12);
+        if (i != 0) {
+            long interval = std::chrono::duration_cast<std::chrono::nanoseconds>(batches[i].deadline - batches[i-1].deadline).count();
+            REQUIRE(interval == 2500000);
+        }
+    }
+}
@@ -0,0 +1,123 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2014 Colin Wallace
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PLATFORMS_GENERIC_SOFTPWM_H
+#define PLATFORMS_GENERIC_SOFTPWM_H
+
+#include <map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "platforms/auto/chronoclock.h" //for EventClockT
+#include "compileflags.h" //for IoLevel
+
+//Software PWM is limited by the OS's wake-up latency, so PWM periods shorter than this are lengthened to it.
+#define SOFTPWM_MIN_PERIOD std::chrono::milliseconds(1)
+//Period to use when the caller doesn't care (passes a period of 0).
+#define SOFTPWM_DEFAULT_PERIOD std::chrono::milliseconds(10)
+
+namespace plat {
+namespace generic {
+
+//a single pin write issued by the SoftPwm engine.
+struct PinWrite {
+    int pinId;
+    IoLevel level;
+};
+
+/*
+ * Backend through which the SoftPwm engine drives its pins.
+ * All the writes that are due at the same time are passed in one call, so a backend that can write several pins at once (e.g. a whole GPIO bank) may do so.
+ */
+class PinWriter {
+    public:
+        virtual ~PinWriter() {}
+        //@deadline the time at which the writes were scheduled to occur. They're issued as soon after it as the OS wakes the SoftPwm thread.
+        virtual void write(EventClockT::time_point deadline, const PinWrite *begin, const PinWrite *end) = 0;
+};
+
+//PinWriter that records every batch of writes, along with the time it was scheduled for and the time it was actually issued. Used for testing.
+class MockPinWriter : public PinWriter {
+    public:
+        struct Batch {
+            EventClockT::time_point deadline; //the time SoftPwm scheduled the writes for
+            EventClockT::time_point time; //the time the writes were issued
+            std::vector<PinWrite> writes;
+        };
+        void write(EventClockT::time_point deadline, const PinWrite *begin, const PinWrite *end) override;
+        //@return a copy of every batch written so far (the SoftPwm thread may still be adding to them),
+        //  after waiting until there are at least @count of them (or @timeout has passed).
+        std::vector<Batch> batches(std::size_t count=0, EventClockT::duration timeout=std::chrono::seconds(10)) const;
+    private:
+        mutable std::mutex _mutex;
+        mutable std::condition_variable _written;
+        std::vector<Batch> _batches;
+};
+
+/*
+ * SoftPwm outputs PWM on any number of pins from a dedicated, high-priority thread.
+ *
+ * Each edge is kept in a list of absolute deadlines, and the thread sleeps (clock_nanosleep with TIMER_ABSTIME) until the earliest one.
+ * Every channel's periods start on a multiple of its period since the engine was created,
+ *   so channels that share a period also share their rising edges, and all the edges due at one deadline cost a single wake-up.
+ * Changes to a channel's duty cycle or period take effect at the start of its next period, so the output never glitches.
+ */
+class SoftPwm {
+    struct Channel {
+        int pinId;
+        IoLevel level;
+        bool isLevelKnown; //false until the channel's first write
+        EventClockT::duration onTime, period; //the parameters of the current period
+        EventClockT::duration nextOnTime, nextPeriod; //the parameters requested by the last queuePwm call
+    };
+    struct Edge {
+        std::size_t channelIdx;
+        bool isPeriodStart; //else, the falling edge in the middle of the period
+    };
+    PinWriter &_writer;
+    EventClockT::time_point _epoch;
+    std::vector<Channel> _channels;
+    std::map<EventClockT::time_point, std::vector<Edge> > _deadlines;
+    //the deadline that the thread is currently sleeping until. New edges are never scheduled before it.
+    EventClockT::time_point _sleepingUntil;
+    bool _doStop;
+    std::mutex _mutex;
+    std::condition_variable _wake; //used to wake the thread when it has no deadlines at all
+    std::thread _thread;
+    public:
+        SoftPwm(PinWriter &writer);
+        ~SoftPwm();
+        //Output a pwm duty-cycle of `duty` (0.0-1.0) on the pin, with a period of `period`.
+        void queuePwm(int pinId, float duty, EventClockT::duration period);
+    private:
+        void threadLoop();
+        void fire(const Edge &edge, EventClockT::time_point time, std::vector<PinWrite> &writes);
+        EventClockT::time_point nextPeriodStart(EventClockT::time_point after, EventClockT::duration period) const;
+};
+
+}
+}
+
+#endif
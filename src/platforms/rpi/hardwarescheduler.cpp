@@ -11,14 +11,21 @@
 #include <errno.h> //for errno
 #include <pthread.h> //for pthread_setschedparam
 #include <chrono>
+#include <cmath> //for std::fabs, std::lround
+#include <algorithm> //for std::min, std::max, std::copy
+#include <vector>
+#include <string> //for std::to_string
+#include <thread>
 
 #include "primitiveiopin.h"
+#include "platforms/auto/thisthreadsleep.h" //for SleepT
 #include "outputevent.h"
 #include "mitpi.h"
 #include "schedulerbase.h"
 #include "common/logging.h"
-#include "platforms/auto/thisthreadsleep.h" //for SleepT 
-#include "compileflags.h" //for RUNNING_IN_VM
+#include "compileflags.h" //for RUNNING_IN_VM, EMULATE_RPI
+#include "iodrivers/iopin.h"
+#include "catch.hpp"
 
 #if MAX_RPI_PIN_ID < 32
     #define NUM_GPIO_WORDS 1
@@ -336,6 +343,215 @@ struct GpioBufferFrame {
     }
 };
 
+//Accumulates the edges that are destined for a single frame, so that the (uncached) frame in the DMA buffer only needs to be written once.
+struct PendingFrameWrite {
+    int idx;
+    GpioBufferFrame masks;
+    inline PendingFrameWrite(int idx=-1) : idx(idx), masks() {}
+    inline void flushTo(GpioBufferFrame *srcArray) const {
+        if (idx < 0) {
+            return;
+        }
+        for (int w=0; w<NUM_GPIO_WORDS; ++w) {
+            if (masks.gpset[w]) {
+                srcArray[idx].gpset[w] |= masks.gpset[w];
+            }
+            if (masks.gpclr[w]) {
+                srcArray[idx].gpclr[w] |= masks.gpclr[w];
+            }
+        }
+    }
+};
+
+//Generate the output of each frame for a PWM of duty cycle (duty/PWM_DUTY_STEPS) and (ideal) period of periodFrames (see queuePwm for the algorithm).
+//The pattern is bit-sliced: bit (idx%32) of pattern[idx/32] is the output of frame idx, so 32 frames are built up in a register before each store.
+void makePwmPattern(int duty, int periodFrames, uint32_t *pattern) {
+    //charge is measured in units of 1/PWM_DUTY_STEPS, so everything is exact integer math.
+    int charge = 0;
+    int transitionCharge = 0;
+    bool out = (2*duty >= PWM_DUTY_STEPS);
+    for (int word=0; word < SOURCE_BUFFER_FRAMES/32; ++word) {
+        uint32_t bits = 0;
+        for (int bit=0; bit < 32; ++bit) {
+            charge += duty;
+            transitionCharge += 1;
+            if (charge <= 0) {
+                out = false;
+            } else if (transitionCharge >= periodFrames) {
+                out = true;
+                transitionCharge -= periodFrames;
+            }
+            charge -= out*PWM_DUTY_STEPS;
+            bits |= (uint32_t)out << bit;
+        }
+        pattern[word] = bits;
+    }
+}
+
+//Generate a train of pulses, each onFrames long, with a pulse starting every periodFrames (which must divide SOURCE_BUFFER_FRAMES).
+//Uses the same bit-sliced layout as makePwmPattern.
+void makePulsePattern(int onFrames, int periodFrames, uint32_t *pattern) {
+    assert(SOURCE_BUFFER_FRAMES % periodFrames == 0);
+    for (int word=0; word < SOURCE_BUFFER_FRAMES/32; ++word) {
+        uint32_t bits = 0;
+        for (int bit=0; bit < 32; ++bit) {
+            bits |= (uint32_t)((word*32 + bit) % periodFrames < onFrames) << bit;
+        }
+        pattern[word] = bits;
+    }
+}
+
+#if EMULATE_RPI
+//Software stand-in for the DMA engine, the PWM pacing & the GPIO bank, used when built with EMULATE_RPI=1.
+//It uses the very same control blocks & GpioBufferFrames as the real hardware, so the frame ring, syncDmaTime, queue & queuePwm can be exercised on any Linux box.
+//Ram that the "DMA engine" must access is registered via makeLockedMem, and is given a fake bus address (below the peripheral range) so that it fits into the 32-bit control block fields.
+
+//Each frame is output up to this many frames late. Larger values use less cpu.
+#define EMULATED_DMA_FRAMES_PER_WAKE 32
+
+namespace emulation {
+
+struct RamRegion {
+    uintptr_t physAddr;
+    uint8_t *virt;
+    std::size_t size;
+};
+//Note: regions are only registered while the UnwrappedHardwareScheduler is being constructed, i.e. before the emulated DMA thread is started.
+//They're never freed, as the (detached) emulated DMA thread may still be running during static destruction.
+static std::vector<RamRegion>& ramRegions() {
+    static std::vector<RamRegion> *regions = new std::vector<RamRegion>();
+    return *regions;
+}
+static uintptr_t nextPhysAddr = 0x01000000;
+
+uintptr_t mapRam(uint8_t *virt, std::size_t size) {
+    RamRegion region = { nextPhysAddr, virt, size };
+    ramRegions().push_back(region);
+    nextPhysAddr += size;
+    assert(nextPhysAddr < 0x20000000); //must not collide with the peripheral addresses
+    return region.physAddr;
+}
+
+uintptr_t virtToPhys(void *virt) {
+    for (const RamRegion &r : ramRegions()) {
+        if ((uintptr_t)virt - (uintptr_t)r.virt < r.size) {
+            return r.physAddr + ((uintptr_t)virt - (uintptr_t)r.virt);
+        }
+    }
+    assert(false); //memory wasn't allocated with makeLockedMem
+    return 0;
+}
+
+//The state of the emulated DMA channel, as seen from the emulation thread.
+struct DmaEngine {
+    DmaChannelHeader *header;
+    volatile uint32_t *gpioMem;
+    volatile uint32_t *pwmMem;
+
+    volatile uint32_t* busToVirt(uint32_t busAddr) const {
+        if ((busAddr & 0xff000000) == 0x7e000000) {
+            //peripheral bus address. The peripherals are emulated one page apiece by mitpi::mapPeripheral.
+            uint32_t armAddr = 0x20000000 | (busAddr & 0x00ffffff);
+            if ((armAddr & ~(PAGE_SIZE-1)) == GPIO_BASE) {
+                return gpioMem + (armAddr & (PAGE_SIZE-1))/4;
+            } else if ((armAddr & ~(PAGE_SIZE-1)) == PWM_BASE) {
+                return pwmMem + (armAddr & (PAGE_SIZE-1))/4;
+            }
+            LOGE("platforms::rpi emulated DMA: access to unemulated peripheral at bus address 0x%08x\n", busAddr);
+            exit(1);
+        }
+        //strip the cache alias bits (see physToUncached)
+        uintptr_t physAddr = busAddr & 0x3fffffff;
+        for (const RamRegion &r : ramRegions()) {
+            if (physAddr - r.physAddr < r.size) {
+                return (volatile uint32_t*)(r.virt + (physAddr - r.physAddr));
+            }
+        }
+        LOGE("platforms::rpi emulated DMA: access to unmapped bus address 0x%08x\n", busAddr);
+        exit(1);
+    }
+    void writeWord(uint32_t busAddr, uint32_t value) const {
+        volatile uint32_t *dest = busToVirt(busAddr);
+        *dest = value;
+        //writes to GPSET/GPCLR are reflected in the pin levels (GPLEV)
+        uint32_t offset = busAddr - GPIO_BASE_BUS;
+        if (offset == GPSET0 || offset == GPSET1) {
+            gpioMem[GPLEV0/4 + (offset-GPSET0)/4] |= value;
+        } else if (offset == GPCLR0 || offset == GPCLR1) {
+            gpioMem[GPLEV0/4 + (offset-GPCLR0)/4] &= ~value;
+        }
+    }
+    void transfer() const {
+        //perform the transfer described by the control block that has been loaded into the channel header
+        uint32_t ti = header->TI;
+        uint32_t src = header->SOURCE_AD, dest = header->DEST_AD;
+        bool is2d = ti & DMA_CB_TI_TDMODE;
+        uint32_t xLength = is2d ? header->TXFR_LEN & 0xffff : header->TXFR_LEN;
+        uint32_t yLength = is2d ? ((header->TXFR_LEN >> 16) & 0x3fff) + 1 : 1;
+        int16_t srcStride = header->STRIDE & 0xffff;
+        int16_t destStride = header->STRIDE >> 16;
+        for (uint32_t y=0; y<yLength; ++y) {
+            for (uint32_t x=0; x<xLength; x += 4) {
+                writeWord(dest, *busToVirt(src));
+                src += (ti & DMA_CB_TI_SRC_INC) ? 4 : 0;
+                dest += (ti & DMA_CB_TI_DEST_INC) ? 4 : 0;
+            }
+            if (is2d) {
+                src += srcStride;
+                dest += destStride;
+            }
+        }
+    }
+    void run() const {
+        //Real DMA runs independently of the CPU, and the scheduler busy-waits on it (see syncDmaTime).
+        //So the emulation must be able to preempt the (realtime) scheduler thread, even on a single core.
+        #if USE_PTHREAD
+            struct sched_param sp;
+            sp.sched_priority = SCHED_PRIORITY+1;
+            if (int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp)) {
+                LOGW("Warning: platforms::rpi emulated DMA: pthread_setschedparam returned non-zero: %i\n", ret);
+            }
+        #endif
+        //The PWM peripheral consumes one FIFO word (i.e. one frame) every 1/FRAMES_PER_SEC seconds, and any DREQ-paced write must wait for that.
+        //Waking for every frame would leave no cpu for anything else, so wake every EMULATED_DMA_FRAMES_PER_WAKE frames & catch up on all that have come due.
+        EventClockT::time_point startTime = EventClockT::now();
+        int64_t numPacedWrites = 0;
+        while ((header->CS & DMA_CS_ACTIVE) && !(header->CS & DMA_CS_RESET)) {
+            int64_t usecElapsed = std::chrono::duration_cast<std::chrono::microseconds>(EventClockT::now() - startTime).count();
+            if (numPacedWrites >= USEC_TO_FRAME(usecElapsed)) {
+                SleepT::sleep_until(startTime + std::chrono::microseconds(FRAME_TO_USEC(numPacedWrites + EMULATED_DMA_FRAMES_PER_WAKE)));
+                continue;
+            }
+            //load the next control block into the channel header, just as the hardware does. In particular, this exposes the frame index via STRIDE.
+            const DmaControlBlock *cb = (const DmaControlBlock*)busToVirt(header->CONBLK_AD);
+            header->TI = cb->TI;
+            header->SOURCE_AD = cb->SOURCE_AD;
+            header->DEST_AD = cb->DEST_AD;
+            header->TXFR_LEN = cb->TXFR_LEN;
+            header->STRIDE = cb->STRIDE;
+            header->NEXTCONBK = cb->NEXTCONBK;
+            transfer();
+            if ((header->TI & DMA_CB_TI_DEST_DREQ) && (header->TI & (0x1f << 16)) == DMA_CB_TI_PERMAP_PWM) {
+                ++numPacedWrites;
+            }
+            header->CONBLK_AD = header->NEXTCONBK;
+            if (header->CONBLK_AD == 0) {
+                header->CS = (header->CS & ~DMA_CS_ACTIVE) | DMA_CS_END;
+            }
+        }
+        LOG("platforms::rpi emulated DMA: channel stopped\n");
+    }
+};
+
+void startDma(DmaChannelHeader *header, int memfd) {
+    DmaEngine engine = { header, mitpi::mapPeripheral(memfd, GPIO_BASE), mitpi::mapPeripheral(memfd, PWM_BASE) };
+    //the thread is detached; it stops once the channel is deactivated in UnwrappedHardwareScheduler::cleanup.
+    std::thread([engine]() { engine.run(); }).detach();
+}
+
+}
+#endif
+
 size_t ceilToPage(size_t size) {
     //round up to nearest page-size multiple
     if (size & (PAGE_SIZE-1)) {
@@ -367,6 +583,10 @@ uint8_t* makeLockedMem(size_t size) {
     }
     memset(mem, 0, size); //simultaneously zero the pages and force them into memory
     mlock(mem, size);
+    #if EMULATE_RPI
+        //make the memory reachable by the emulated DMA engine
+        emulation::mapRam((uint8_t*)mem, size);
+    #endif
     return (uint8_t*)mem;
 }
 
@@ -405,7 +625,9 @@ uintptr_t UnwrappedHardwareScheduler::DmaMem::virtToPhys(void *virt) const {
 
 UnwrappedHardwareScheduler::UnwrappedHardwareScheduler() 
   : _lastTimeAtFrame0(0)
-  , _lastDmaSyncedTime(std::chrono::seconds(0)) {
+  , _lastDmaSyncedTime(std::chrono::seconds(0))
+  , _pwmPatternBits((PWM_PATTERN_CACHE_SIZE+1)*SOURCE_BUFFER_FRAMES/32)
+  , _pwmPatternUseCount(0) {
     dmaCh = 5;
     SchedulerBase::registerExitHandler(&cleanup, SCHED_IO_EXIT_LEVEL);
     makeMaps();
@@ -426,12 +648,18 @@ void UnwrappedHardwareScheduler::cleanup() {
 }
 
 void UnwrappedHardwareScheduler::makeMaps() {
-    memfd = open("/dev/mem", O_RDWR | O_SYNC);
-    if (memfd < 0) {
-        LOGE("Failed to open /dev/mem (did you remember to run as root?)\n");
-        exit(1);
-    }
-    pagemapfd = open("/proc/self/pagemap", O_RDONLY);
+    #if EMULATE_RPI
+        //peripherals are emulated by mitpi::mapPeripheral, and physical addresses by emulation::virtToPhys
+        memfd = -1;
+        pagemapfd = -1;
+    #else
+        memfd = open("/dev/mem", O_RDWR | O_SYNC);
+        if (memfd < 0) {
+            LOGE("Failed to open /dev/mem (did you remember to run as root?)\n");
+            exit(1);
+        }
+        pagemapfd = open("/proc/self/pagemap", O_RDONLY);
+    #endif
     //now map /dev/mem into memory, but only map specific peripheral sections:
     //gpioBaseMem = mapPeripheral(GPIO_BASE);
     dmaBaseMem = mapPeripheral(DMA_BASE);
@@ -482,7 +710,7 @@ void UnwrappedHardwareScheduler::initSrcAndControlBlocks() {
         cbArr[i+1].STRIDE = DMA_CB_STRIDE_D_STRIDE(stride) | DMA_CB_STRIDE_S_STRIDE(0);
         cbArr[i+1].NEXTCONBK = physToUncached(cbMem.physAddrAtByteOffset((i+2)*sizeof(DmaControlBlock)));
         //clear buffer (TODO: investigate using a 4-word copy ("burst") )
-        cbArr[i+2].TI = DMA_CB_TI_DEST_INC | DMA_CB_TI_NO_WIDE_BURSTS | DMA_CB_TI_TDMODE;
+        cbArr[i+2].TI = DMA_CB_TI_SRC_INC | DMA_CB_TI_DEST_INC | DMA_CB_TI_NO_WIDE_BURSTS | DMA_CB_TI_TDMODE;
         cbArr[i+2].SOURCE_AD = physToUncached(srcClrMem.physAddrAtByteOffset(i/3*sizeof(struct GpioBufferFrame)));
         cbArr[i+2].DEST_AD = physToUncached(srcMem.physAddrAtByteOffset(i/3*sizeof(GpioBufferFrame)));
         cbArr[i+2].TXFR_LEN = DMA_CB_TXFR_LEN_YLENGTH(1) | DMA_CB_TXFR_LEN_XLENGTH(sizeof(struct GpioBufferFrame));
@@ -496,6 +724,11 @@ uint8_t* UnwrappedHardwareScheduler::makeUncachedMemView(void* virtaddr, size_t
     //by default, writing to any virtual address will go through the CPU cache.
     //this function will return a pointer that behaves the same as virtaddr, but bypasses the CPU L1 cache (note that because of this, the returned pointer and original pointer should not be used in conjunction, else cache-related inconsistencies will arise)
     //Note: The original memory should not be unmapped during the lifetime of the uncached version, as then the OS won't know that our process still owns the physical memory.
+    #if EMULATE_RPI
+        //the emulated DMA engine shares the CPU's cache, so there's nothing to bypass.
+        (void)bytes; //unused
+        return (uint8_t*)virtaddr;
+    #endif
     bytes = ceilToPage(bytes);
     //first, just allocate enough *virtual* memory for the operation. This is done so that we can do the later mapping to a contiguous range of virtual memory:
     void *mem = mmap(
@@ -523,6 +756,9 @@ uint8_t* UnwrappedHardwareScheduler::makeUncachedMemView(void* virtaddr, size_t
 }
 
 uintptr_t UnwrappedHardwareScheduler::virtToPhys(void* virt) const {
+    #if EMULATE_RPI
+        return emulation::virtToPhys(virt);
+    #endif
     //uintptr_t pgNum = (uintptr_t)(virt)/PAGE_SIZE;
     int pgNum = (uintptr_t)(virt)/PAGE_SIZE;
     int byteOffsetFromPage = (uintptr_t)(virt)%PAGE_SIZE;
@@ -554,6 +790,10 @@ void UnwrappedHardwareScheduler::initPwm() {
     *(clockBaseMem + CM_PWMDIV/4) = CM_PWMDIV_PASSWD | CM_PWMDIV_DIVI(CLOCK_DIV); //configure clock divider (running at 500MHz undivided)
     *(clockBaseMem + CM_PWMCTL/4) = CM_PWMCTL_PASSWD | CM_PWMCTL_SRC_PLLD; //source 500MHz base clock, no MASH.
     *(clockBaseMem + CM_PWMCTL/4) = CM_PWMCTL_PASSWD | CM_PWMCTL_SRC_PLLD | CM_PWMCTL_ENAB; //enable clock
+    #if EMULATE_RPI
+        //there's no clock generator to report that it's running; the emulated DMA engine is paced at FRAMES_PER_SEC directly.
+        *(clockBaseMem + CM_PWMCTL/4) |= CM_PWMCTL_BUSY;
+    #endif
     do {} while ((*(clockBaseMem + CM_PWMCTL/4) & CM_PWMCTL_BUSY) == 0); //wait for clock to activate
     
     //configure rest of PWM:
@@ -592,6 +832,9 @@ void UnwrappedHardwareScheduler::initDma() {
     dmaHeader->CONBLK_AD = firstAddr; //(uint32_t)physCbPage + ((void*)cbArr - virtCbPage); //we have to point it to the PHYSICAL address of the control block (cb1)
     dmaHeader->CS = DMA_CS_PRIORITY(14) | DMA_CS_PANIC_PRIORITY(14) | DMA_CS_DISDEBUG; //high priority (max is 15)
     dmaHeader->CS = DMA_CS_PRIORITY(14) | DMA_CS_PANIC_PRIORITY(14) | DMA_CS_DISDEBUG | DMA_CS_ACTIVE; //activate DMA. 
+    #if EMULATE_RPI
+        emulation::startDma(dmaHeader, memfd);
+    #endif
 }
 
 void UnwrappedHardwareScheduler::syncDmaTime() {
@@ -631,16 +874,61 @@ bool UnwrappedHardwareScheduler::onIdleCpu(OnIdleCpuIntervalT interval) {
     }
     return false;
 }
-void UnwrappedHardwareScheduler::queue(const OutputEvent &evt) {
-    queue(evt.primitiveIoPin().id(), evt.state(), std::chrono::duration_cast<std::chrono::microseconds>(evt.time().time_since_epoch()).count());
+bool UnwrappedHardwareScheduler::queue(const OutputEvent &evt) {
+    return queue(&evt, &evt+1) != &evt;
 }
 
-void UnwrappedHardwareScheduler::queue(int pin, int mode, uint64_t micros) {
-    //This function takes a pin, a mode (0=off, 1=on) and a time. It then manipulates the GpioBufferFrame array in order to ensure that the pin switches to the desired level at the desired time. It will sleep if necessary.
-    //Sleep until we are on the right iteration of the circular buffer (otherwise we cannot queue the command)
-    uint64_t desiredTime = micros - MAX_SCHED_AHEAD_USEC;
-    SleepT::sleep_until(std::chrono::time_point<std::chrono::microseconds>(std::chrono::microseconds(desiredTime)));
+const OutputEvent* UnwrappedHardwareScheduler::queue(const OutputEvent *begin, const OutputEvent *end) {
+    //This function takes a span of events, sorted by time. It then manipulates the GpioBufferFrame array in order to ensure that each pin switches to the desired level at the desired time.
+    //Edges that fall into the same frame (e.g. several axes stepping at once) are combined & written into the buffer together.
+    //It never sleeps: events that lie beyond the writable window are left for a later call.
+    auto toMicros = [](EventClockT::time_point t) -> uint64_t {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+    };
+    //Being sorted, everything before the first event that lies past the window can be written now.
+    EventClockT::time_point horizon = writableUntil();
+    const OutputEvent *stop = begin;
+    while (stop != end && stop->time() <= horizon) {
+        ++stop;
+    }
+    if (stop == begin) {
+        return begin;
+    }
 
+    PendingFrameWrite pending;
+    //edges with identical times are common, and needn't recompute the frame index
+    uint64_t lastMicros = 0;
+    int lastIdx = -1;
+    auto writeEdge = [&](int pin, bool state, uint64_t micros) {
+        int idx = (micros == lastMicros && lastIdx >= 0) ? lastIdx : frameIndexAt(micros);
+        lastMicros = micros;
+        lastIdx = idx;
+        if (idx != pending.idx) {
+            pending.flushTo(srcArray);
+            pending = PendingFrameWrite(idx);
+        }
+        if (state) {
+            pending.masks.writeGpSet(pin);
+        } else {
+            pending.masks.writeGpClr(pin);
+        }
+    };
+    for (const OutputEvent *evt = begin; evt != stop; ++evt) {
+        writeEdge(evt->primitiveIoPin().id(), evt->state(), toMicros(evt->time()));
+    }
+    //place the trailing edges of any pulses into the buffer too. These may fall after the start of the next event, so are written separately.
+    //A trailing edge may extend a few uS past the horizon, but that still lies well within the buffer's dead-space.
+    for (const OutputEvent *evt = begin; evt != stop; ++evt) {
+        if (evt->isPulse()) {
+            writeEdge(evt->primitiveIoPin().id(), !evt->state(), toMicros(evt->time() + evt->pulseWidth()));
+        }
+    }
+    pending.flushTo(srcArray);
+    return stop;
+}
+
+int UnwrappedHardwareScheduler::frameIndexAt(uint64_t micros) const {
+    //Given a time that lies within the circular buffer's window, determine the index of the frame that will be output at that time.
     int64_t lastUsecAtFrame0 = _lastTimeAtFrame0;
     int usecFromFrame0 = micros - lastUsecAtFrame0;
     if (usecFromFrame0 < 0) { //need this check to prevent newIdx from being negative.
@@ -652,16 +940,7 @@ void UnwrappedHardwareScheduler::queue(int pin, int mode, uint64_t micros) {
         usecFromFrame0 = micros - lastUsecAtFrame0;
     }
     int framesFrom0 = USEC_TO_FRAME(usecFromFrame0);
-    int newIdx = framesFrom0%SOURCE_BUFFER_FRAMES;
-
-    //Now queue the command:
-    if (mode == 0) { //turn output off
-        //srcArray[newIdx].gpclr[pin>31] |= 1 << (pin%32);
-        srcArray[newIdx].writeGpClr(pin);
-    } else { //turn output on
-        //srcArray[newIdx].gpset[pin>31] |= 1 << (pin%32);
-        srcArray[newIdx].writeGpSet(pin);
-    }
+    return framesFrom0%SOURCE_BUFFER_FRAMES;
 }
 
 void UnwrappedHardwareScheduler::queuePwm(const PrimitiveIoPin &pin, float ratio, EventClockT::duration idealPeriod) {
@@ -705,25 +984,240 @@ void UnwrappedHardwareScheduler::queuePwm(const PrimitiveIoPin &pin, float ratio
     //  if charge < 0: out = 0
     //  if charge > 0 && transitionCharge > L: out = 1
     //  charge -= out
-    auto pinId = pin.id();
-    float minPeriod = std::chrono::duration_cast<std::chrono::duration<float> >(idealPeriod).count()*(float)(FRAMES_PER_SEC);
-    float charge=0;
-    float transitionCharge=0;
-    bool out = (ratio >= 0.5);
-    for (int idx=0; idx < SOURCE_BUFFER_FRAMES; ++idx) {
-        charge += ratio;
-        transitionCharge += 1;
-        if (charge <= 0) {
-            out = false;
-        } else if (transitionCharge >= minPeriod) {
-            out = true;
-            transitionCharge -= minPeriod;
+    //
+    //The resulting pattern only depends upon r and L, so these are quantised and the pattern is cached (see makePwmPattern).
+    //srcClrArray is uncached, so only the frames whose output differs from the pin's previous pattern are rewritten.
+    int duty = (int)std::lround(std::max(0.f, std::min(1.f, ratio))*PWM_DUTY_STEPS);
+    int periodFrames = (int)std::lround(std::chrono::duration_cast<std::chrono::duration<float> >(idealPeriod).count()*(float)(FRAMES_PER_SEC));
+    writePwmPattern(pin.id(), PwmPatternKey(false, duty, periodFrames));
+}
+
+void UnwrappedHardwareScheduler::queuePulses(const PrimitiveIoPin &pin, EventClockT::duration onTime, EventClockT::duration period, IoLevel pulseLevel) {
+    //The pattern has to repeat seamlessly as the DMA loops over the buffer, so the period is rounded down to a divisor of SOURCE_BUFFER_FRAMES.
+    //Eg a 20 ms servo cycle becomes 4096 frames (16.4 ms); servos respond to the pulse length rather than the period.
+    int64_t requestedFrames = USEC_TO_FRAME(std::chrono::duration_cast<std::chrono::microseconds>(period).count());
+    int periodFrames = SOURCE_BUFFER_FRAMES;
+    while (periodFrames > 1 && periodFrames > requestedFrames) {
+        periodFrames /= 2;
+    }
+    int onFrames = (int)std::max<int64_t>(0, std::min<int64_t>(periodFrames, USEC_TO_FRAME(std::chrono::duration_cast<std::chrono::microseconds>(onTime).count())));
+    //a low pulse of onFrames is a high pulse of the remaining frames (just out of phase, which doesn't matter)
+    if (pulseLevel == IoLow) {
+        onFrames = periodFrames - onFrames;
+    }
+    writePwmPattern(pin.id(), PwmPatternKey(true, onFrames, periodFrames));
+}
+
+void UnwrappedHardwareScheduler::writePwmPattern(int pinId, const PwmPatternKey &key) {
+    auto pinPattern = _pwmPinPatterns.find(pinId);
+    int prevSlot = pinPattern == _pwmPinPatterns.end() ? -1 : pinPattern->second;
+    if (prevSlot >= 0 && _pwmPatterns[prevSlot].key == key) {
+        return; //the pin is already outputting this pattern
+    }
+    int slot = findPwmPattern(key);
+    //if every slot is in use by other pins, the pattern is built in the scratch space instead.
+    uint32_t *pattern = pwmPatternBits(slot >= 0 ? slot : PWM_PATTERN_CACHE_SIZE);
+    if (slot < 0 || !_pwmPatterns[slot].valid) {
+        if (key.isPulseTrain) {
+            makePulsePattern(key.onUnits, key.periodFrames, pattern);
+        } else {
+            makePwmPattern(key.onUnits, key.periodFrames, pattern);
+        }
+        if (slot >= 0) {
+            _pwmPatterns[slot].key = key;
+            _pwmPatterns[slot].valid = true;
+        }
+    }
+    //the previous pattern is in use by this pin, so it's still cached.
+    const uint32_t *prevPattern = prevSlot >= 0 ? pwmPatternBits(prevSlot) : nullptr;
+    for (int word=0; word < SOURCE_BUFFER_FRAMES/32; ++word) {
+        //a pin that hasn't been used for PWM yet has neither its SET nor CLR bits set in any frame, so every frame must be written.
+        uint32_t changed = prevPattern ? pattern[word] ^ prevPattern[word] : 0xffffffff;
+        while (changed) {
+            int bit = __builtin_ctz(changed);
+            changed &= changed - 1;
+            bool out = (pattern[word] >> bit) & 1;
+            int idx = word*32 + bit;
+            srcClrArray[idx].writeGpSet(pinId, out); //if OUT, then set SET and clear CLR
+            srcClrArray[idx].writeGpClr(pinId, !out); //if !OUT, then clr SET and set CLR
+        }
+    }
+    if (prevSlot >= 0) {
+        --_pwmPatterns[prevSlot].numPins;
+        if (slot < 0 && _pwmPatterns[prevSlot].numPins == 0) {
+            //no other pin outputs the previous pattern, so its slot can hold the new one.
+            std::copy(pattern, pattern + SOURCE_BUFFER_FRAMES/32, pwmPatternBits(prevSlot));
+            _pwmPatterns[prevSlot].key = key;
+            slot = prevSlot;
         }
-        charge -= out;
-        srcClrArray[idx].writeGpSet(pinId, out); //if OUT, then set SET and clear CLR
-        srcClrArray[idx].writeGpClr(pinId, !out); //if !OUT, then clr SET and set CLR
+    }
+    if (slot >= 0) {
+        ++_pwmPatterns[slot].numPins;
+        _pwmPatterns[slot].lastUsed = ++_pwmPatternUseCount;
+    }
+    if (pinPattern == _pwmPinPatterns.end()) {
+        _pwmPinPatterns.insert(std::make_pair(pinId, slot));
+    } else {
+        pinPattern->second = slot;
     }
 }
 
+uint32_t* UnwrappedHardwareScheduler::pwmPatternBits(int slot) {
+    return &_pwmPatternBits[slot*(SOURCE_BUFFER_FRAMES/32)];
 }
+
+//@return the slot that caches the pattern for @key,
+//  else the least-recently used slot that no pin is outputting (invalidated, so that the caller can fill it),
+//  else -1 (every slot is in use by a pin).
+int UnwrappedHardwareScheduler::findPwmPattern(const PwmPatternKey &key) {
+    int freeSlot = -1;
+    for (int slot=0; slot < PWM_PATTERN_CACHE_SIZE; ++slot) {
+        const PwmPatternSlot &cached = _pwmPatterns[slot];
+        if (cached.valid && cached.key == key) {
+            return slot;
+        }
+        if (cached.numPins == 0 && (freeSlot < 0 || cached.lastUsed < _pwmPatterns[freeSlot].lastUsed)) {
+            freeSlot = slot;
+        }
+    }
+    if (freeSlot >= 0) {
+        _pwmPatterns[freeSlot].valid = false;
+    }
+    return freeSlot;
+}
+
+}
+}
+
+#if EMULATE_RPI
+//These exercise the frame ring, syncDmaTime, queue & queuePwm against the emulated DMA engine. Build with EMULATE_RPI=1 ENABLE_TESTS=1 to run them.
+TEST_CASE("HardwareScheduler writes queued events to the GPIOs at the right time", "[hardwarescheduler]") {
+    plat::rpi::HardwareScheduler sched;
+    sched.onIdleCpu(OnIdleCpuIntervalWide); //sync with the DMA frame index
+    iodrv::IoPin pin(iodrv::NO_INVERSIONS, plat::rpi::PrimitiveIoPin(mitpi::V2_GPIO_P1_11));
+    pin.makeDigitalOutput(IoLow);
+    EventClockT::time_point start = EventClockT::now() + std::chrono::milliseconds(50);
+    OutputEvent evts[] = { OutputEvent(start, pin, IoHigh), OutputEvent(start + std::chrono::milliseconds(20), pin, IoLow) };
+    REQUIRE(sched.queue(evts, evts+2) == evts+2);
+    SleepT::sleep_until(start - std::chrono::milliseconds(5));
+    REQUIRE(mitpi::readPinState(mitpi::V2_GPIO_P1_11) == IoLow);
+    SleepT::sleep_until(start + std::chrono::milliseconds(5));
+    REQUIRE(mitpi::readPinState(mitpi::V2_GPIO_P1_11) == IoHigh);
+    SleepT::sleep_until(start + std::chrono::milliseconds(25));
+    REQUIRE(mitpi::readPinState(mitpi::V2_GPIO_P1_11) == IoLow);
 }
+
+//measure the duty cycle that a pin is being driven at by the emulated DMA.
+static float measureDutyCycle(mitpi::PinIntType pinId) {
+    //Each frame is reset to the PWM pattern just after it's output, so the pattern only appears once the ring has been through a full pass.
+    //Then sample the pin over the next pass.
+    auto ringPeriod = std::chrono::microseconds(FRAME_TO_USEC(SOURCE_BUFFER_FRAMES));
+    SleepT::sleep_for(ringPeriod);
+    EventClockT::time_point end = EventClockT::now() + ringPeriod;
+    int numSamples = 0, numHigh = 0;
+    while (EventClockT::now() < end) {
+        numHigh += mitpi::readPinState(pinId);
+        ++numSamples;
+        SleepT::sleep_for(std::chrono::microseconds(37)); //not a multiple of the frame period, to avoid aliasing
+    }
+    return (float)numHigh/numSamples;
+}
+
+TEST_CASE("HardwareScheduler outputs PWM patterns to the GPIOs", "[hardwarescheduler]") {
+    plat::rpi::HardwareScheduler sched;
+    iodrv::IoPin pin(iodrv::NO_INVERSIONS, plat::rpi::PrimitiveIoPin(mitpi::V2_GPIO_P1_12));
+    pin.makeDigitalOutput(IoLow);
+    sched.queuePwm(pin.primitiveIoPin(), 0.25, std::chrono::milliseconds(1));
+    float duty = measureDutyCycle(mitpi::V2_GPIO_P1_12);
+    INFO("duty cycle: " + std::to_string(duty));
+    REQUIRE(std::fabs(duty - 0.25f) < 0.05f);
+    //changing the duty cycle only rewrites the frames that differ from the previous pattern
+    sched.queuePwm(pin.primitiveIoPin(), 0.75, std::chrono::milliseconds(1));
+    duty = measureDutyCycle(mitpi::V2_GPIO_P1_12);
+    INFO("duty cycle: " + std::to_string(duty));
+    REQUIRE(std::fabs(duty - 0.75f) < 0.05f);
+    sched.queuePwm(pin.primitiveIoPin(), 0, std::chrono::milliseconds(1));
+}
+
+TEST_CASE("HardwareScheduler outputs PWM patterns after evicting others from its cache", "[hardwarescheduler]") {
+    plat::rpi::HardwareScheduler sched;
+    iodrv::IoPin pin(iodrv::NO_INVERSIONS, plat::rpi::PrimitiveIoPin(mitpi::V2_GPIO_P1_12));
+    iodrv::IoPin other(iodrv::NO_INVERSIONS, plat::rpi::PrimitiveIoPin(mitpi::V2_GPIO_P1_15));
+    pin.makeDigitalOutput(IoLow);
+    other.makeDigitalOutput(IoLow);
+    sched.queuePwm(other.primitiveIoPin(), 0.5, std::chrono::milliseconds(1));
+    //cycle through more patterns than fit in the cache. The pattern output by the other pin must not be evicted.
+    for (int i=0; i < 2*PWM_PATTERN_CACHE_SIZE; ++i) {
+        sched.queuePwm(pin.primitiveIoPin(), (float)i/(2*PWM_PATTERN_CACHE_SIZE), std::chrono::milliseconds(1));
+    }
+    sched.queuePwm(pin.primitiveIoPin(), 0.25, std::chrono::milliseconds(1));
+    sched.queuePwm(other.primitiveIoPin(), 0.75, std::chrono::milliseconds(1));
+    float duty = measureDutyCycle(mitpi::V2_GPIO_P1_12);
+    INFO("duty cycle: " + std::to_string(duty));
+    REQUIRE(std::fabs(duty - 0.25f) < 0.05f);
+    duty = measureDutyCycle(mitpi::V2_GPIO_P1_15);
+    INFO("duty cycle: " + std::to_string(duty));
+    REQUIRE(std::fabs(duty - 0.75f) < 0.05f);
+    sched.queuePwm(pin.primitiveIoPin(), 0, std::chrono::milliseconds(1));
+    sched.queuePwm(other.primitiveIoPin(), 0, std::chrono::milliseconds(1));
+}
+
+TEST_CASE("HardwareScheduler outputs periodic pulses to the GPIOs", "[hardwarescheduler]") {
+    plat::rpi::HardwareScheduler sched;
+    sched.onIdleCpu(OnIdleCpuIntervalWide); //sync with the DMA frame index
+    iodrv::IoPin pin(iodrv::NO_INVERSIONS, plat::rpi::PrimitiveIoPin(mitpi::V2_GPIO_P1_13));
+    //a typical servo pulse. The 20 ms period is rounded down to 4096 frames.
+    pin.makePulseOutput(std::chrono::microseconds(1500), std::chrono::milliseconds(20));
+    //wait for the pattern to reach every frame of the ring, then time the pulses with the rising & falling edges of the pin.
+    SleepT::sleep_for(std::chrono::microseconds(FRAME_TO_USEC(SOURCE_BUFFER_FRAMES)));
+    std::vector<EventClockT::time_point> rises, falls;
+    bool prev = mitpi::readPinState(mitpi::V2_GPIO_P1_13);
+    EventClockT::time_point end = EventClockT::now() + std::chrono::milliseconds(100);
+    while (EventClockT::now() < end) {
+        bool cur = mitpi::readPinState(mitpi::V2_GPIO_P1_13);
+        if (cur && !prev) {
+            rises.push_back(EventClockT::now());
+        } else if (!cur && prev && !rises.empty()) {
+            falls.push_back(EventClockT::now());
+        }
+        prev = cur;
+    }
+    REQUIRE(rises.size() >= 5);
+    REQUIRE(falls.size() >= 4);
+    for (std::size_t i=0; i<falls.size(); ++i) {
+        auto width = std::chrono::duration_cast<std::chrono::microseconds>(falls[i] - rises[i]).count();
+        INFO("pulse width: " + std::to_string(width) + " us");
+        //the emulated DMA catches up on frames in batches, so allow for that much jitter
+        REQUIRE(std::abs(width - 1500) <= 2*FRAME_TO_USEC(EMULATED_DMA_FRAMES_PER_WAKE));
+    }
+    auto period = std::chrono::duration_cast<std::chrono::microseconds>(rises.back() - rises.front()).count() / (int64_t)(rises.size()-1);
+    INFO("period: " + std::to_string(period) + " us");
+    REQUIRE(std::abs(period - FRAME_TO_USEC(4096)) <= 2*FRAME_TO_USEC(EMULATED_DMA_FRAMES_PER_WAKE));
+    sched.queuePwm(pin.primitiveIoPin(), 0, std::chrono::milliseconds(1));
+}
+
+TEST_CASE("PWM patterns have the requested duty cycle & period", "[hardwarescheduler]") {
+    std::vector<uint32_t> pattern(SOURCE_BUFFER_FRAMES/32);
+    int periods[] = { 0, 1, 250, 5000 };
+    int duties[] = { 0, 1, PWM_DUTY_STEPS/4, PWM_DUTY_STEPS/2, PWM_DUTY_STEPS-1, PWM_DUTY_STEPS };
+    for (int periodFrames : periods) {
+        for (int duty : duties) {
+            plat::rpi::makePwmPattern(duty, periodFrames, pattern.data());
+            int numHigh = 0, numRisingEdges = 0;
+            bool prev = pattern.back() >> 31;
+            for (int idx=0; idx < SOURCE_BUFFER_FRAMES; ++idx) {
+                bool out = (pattern[idx/32] >> (idx%32)) & 1;
+                numHigh += out;
+                numRisingEdges += out && !prev;
+                prev = out;
+            }
+            INFO("duty: " + std::to_string(duty) + ", period: " + std::to_string(periodFrames));
+            //any charge left over at the end of the buffer is less than 1 period's worth
+            REQUIRE(std::abs(numHigh - (int64_t)SOURCE_BUFFER_FRAMES*duty/PWM_DUTY_STEPS) <= periodFrames + 1);
+            if (periodFrames > 1) {
+                REQUIRE(numRisingEdges <= SOURCE_BUFFER_FRAMES/periodFrames + 1);
+            }
+        }
+    }
+}
+#endif
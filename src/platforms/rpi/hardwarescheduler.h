@@ -142,9 +142,13 @@
 #include <stdint.h> //for uint32_t
 #include <cstring> //for size_t, memset
 #include <chrono> //for std::chrono::microseconds
+#include <array>
+#include <map>
+#include <vector>
 
 #include "platforms/auto/chronoclock.h" //for EventClockT
 #include "schedulerbase.h" //for OnIdleCpuIntervalT
+#include "compileflags.h" //for IoLevel
 
 //config settings:
 //The DMA transaction is paced through the PWM FIFO. The PWM FIFO consumes 1 word every N uS (set in clock settings). 
@@ -191,6 +195,11 @@
 #define MAX_SCHED_AHEAD_FRAME (SOURCE_BUFFER_FRAMES - (SOURCE_BUFFER_FRAMES>>6))
 #define MAX_SCHED_AHEAD_USEC (FRAME_TO_USEC(MAX_SCHED_AHEAD_FRAME))
 
+//PWM duty cycles are quantised to this many steps, so that re-sending a near-identical duty cycle (eg from a heater's PID loop) costs nothing.
+#define PWM_DUTY_STEPS 1024
+//number of distinct PWM patterns to keep cached. Each one uses SOURCE_BUFFER_FRAMES/8 bytes, all allocated up front.
+#define PWM_PATTERN_CACHE_SIZE 16
+
 //forward declare class defined in outputevent.h
 class OutputEvent;
 
@@ -233,14 +242,52 @@ class UnwrappedHardwareScheduler {
     DmaControlBlock *cbArr;
     int64_t _lastTimeAtFrame0;
     EventClockT::time_point _lastDmaSyncedTime;
+    //PWM patterns are identified by their quantised parameters, and stored with 1 bit per frame.
+    struct PwmPatternKey {
+        //if true, the pattern is a single pulse of onUnits frames every periodFrames (used for servos).
+        //else, it has a duty cycle of onUnits/PWM_DUTY_STEPS and at most 1 rising edge every periodFrames.
+        bool isPulseTrain;
+        int onUnits;
+        int periodFrames;
+        inline PwmPatternKey() : isPulseTrain(false), onUnits(0), periodFrames(0) {}
+        inline PwmPatternKey(bool isPulseTrain, int onUnits, int periodFrames) : isPulseTrain(isPulseTrain), onUnits(onUnits), periodFrames(periodFrames) {}
+        inline bool operator==(const PwmPatternKey &other) const {
+            return isPulseTrain == other.isPulseTrain && onUnits == other.onUnits && periodFrames == other.periodFrames;
+        }
+    };
+    //The patterns are cached in a fixed pool of PWM_PATTERN_CACHE_SIZE slots, so queuePwm never allocates.
+    struct PwmPatternSlot {
+        PwmPatternKey key;
+        bool valid;
+        int numPins; //number of pins currently outputting this pattern. It can't be evicted while > 0.
+        uint32_t lastUsed; //the least-recently used free slot is evicted first.
+        inline PwmPatternSlot() : valid(false), numPins(0), lastUsed(0) {}
+    };
+    std::array<PwmPatternSlot, PWM_PATTERN_CACHE_SIZE> _pwmPatterns;
+    //SOURCE_BUFFER_FRAMES/32 words per slot, followed by one more pattern of scratch space.
+    std::vector<uint32_t> _pwmPatternBits;
+    uint32_t _pwmPatternUseCount;
+    //the slot holding the pattern that each pin's bits in srcClrArray currently hold, so that queuePwm only needs to rewrite the frames that change.
+    //-1 if the pattern couldn't be cached (every slot was in use by other pins), in which case the pin's next pattern rewrites every frame.
+    std::map<int, int> _pwmPinPatterns;
     public:
         UnwrappedHardwareScheduler();
         static void cleanup();
         inline EventClockT::time_point schedTime(EventClockT::time_point evtTime) const {
             return EventClockT::time_point(evtTime.time_since_epoch() - std::chrono::microseconds(MAX_SCHED_AHEAD_USEC));
         }
-        void queue(const OutputEvent &evt);
+        //latest event time that can currently be written into the DMA buffer (the current frame plus the safe horizon).
+        inline EventClockT::time_point writableUntil() const {
+            return EventClockT::now() + std::chrono::microseconds(MAX_SCHED_AHEAD_USEC);
+        }
+        //queue an event, returning false (without blocking) if it's not yet within the writable window.
+        bool queue(const OutputEvent &evt);
+        //queue a span of events, which must be sorted by time.
+        //Returns a pointer to the first event that lies beyond the writable window (or end, if all were queued).
+        const OutputEvent* queue(const OutputEvent *begin, const OutputEvent *end);
         void queuePwm(const PrimitiveIoPin &pin, float ratio, EventClockT::duration maxPeriod);
+        //output a pulse (at level pulseLevel) of length onTime once every period (approximately; see the implementation), without any further cpu involvement.
+        void queuePulses(const PrimitiveIoPin &pin, EventClockT::duration onTime, EventClockT::duration period, IoLevel pulseLevel);
         bool onIdleCpu(OnIdleCpuIntervalT interval);
     private:
         void makeMaps();
@@ -249,10 +296,13 @@ class UnwrappedHardwareScheduler {
         uint8_t* makeUncachedMemView(void* virtaddr, size_t bytes) const;
         uintptr_t virtToPhys(void* virt) const;
         uintptr_t virtToUncachedPhys(void *virt) const;
+        uint32_t* pwmPatternBits(int slot);
+        int findPwmPattern(const PwmPatternKey &key);
+        void writePwmPattern(int pinId, const PwmPatternKey &key);
         void initPwm();
         void initDma();
         void syncDmaTime();
-        void queue(int pin, int mode, uint64_t micros);
+        int frameIndexAt(uint64_t micros) const;
         void sleepUntilMicros(uint64_t micros) const;
 };
 
@@ -278,15 +328,28 @@ class HardwareScheduler {
             static UnwrappedHardwareScheduler singleton;
             _sched = &singleton;
         }
+        //number of OutputEvents that the Scheduler should hold until they can be placed in the DMA buffer.
+        static constexpr std::size_t queueCapacity() {
+            return 256;
+        }
         inline EventClockT::time_point schedTime(EventClockT::time_point evtTime) const {
             return _sched->schedTime(evtTime);
         }
-        inline void queue(const OutputEvent &evt) {
+        inline EventClockT::time_point writableUntil() const {
+            return _sched->writableUntil();
+        }
+        inline bool queue(const OutputEvent &evt) {
             return _sched->queue(evt);
         }
+        inline const OutputEvent* queue(const OutputEvent *begin, const OutputEvent *end) {
+            return _sched->queue(begin, end);
+        }
         inline void queuePwm(const PrimitiveIoPin &pin, float ratio, EventClockT::duration maxPeriod) {
             return _sched->queuePwm(pin, ratio, maxPeriod);
         }
+        inline void queuePulses(const PrimitiveIoPin &pin, EventClockT::duration onTime, EventClockT::duration period, IoLevel pulseLevel) {
+            return _sched->queuePulses(pin, onTime, period, pulseLevel);
+        }
         inline bool onIdleCpu(OnIdleCpuIntervalT interval) {
             return _sched->onIdleCpu(interval);
         }
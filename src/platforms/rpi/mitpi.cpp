@@ -39,7 +39,10 @@
 #include <stdlib.h> //for exit
 #include <cassert> //for assert
 #include <fcntl.h> //for file opening
+#include <map>
+#include <chrono>
 #include "common/logging.h"
+#include "compileflags.h" //for EMULATE_RPI
 
 
 namespace mitpi {
@@ -64,6 +67,20 @@ static void writeBitmasked(volatile uint32_t *dest, uint32_t mask, uint32_t valu
     *dest = revised; //best to be safe when crossing memory boundaries
 }
 
+#if EMULATE_RPI
+volatile uint32_t* mapPeripheral(int memfd, int addr) {
+    //Each peripheral is emulated by a page of ordinary memory. Mapping the same address twice yields the same page, just as with /dev/mem.
+    //The pages are never freed, as the emulated DMA engine may still be accessing them during static destruction.
+    (void)memfd; //unused
+    static std::map<int, volatile uint32_t*> pages;
+    volatile uint32_t *&page = pages[addr];
+    if (!page) {
+        page = new uint32_t[PAGE_SIZE/4]();
+        LOGV("MitPi::mapPeripheral emulating peripheral at 0x%08x: %p\n", addr, page);
+    }
+    return page;
+}
+#else
 volatile uint32_t* mapPeripheral(int memfd, int addr) {
     ///dev/mem behaves as a file. We need to map that file into memory:
     //NULL = virtual address of mapping is chosen by kernel.
@@ -81,16 +98,21 @@ volatile uint32_t* mapPeripheral(int memfd, int addr) {
     }
     return (volatile uint32_t*)mapped;
 }
+#endif
 
 bool init() {
     if (gpioBaseMem) {
         return 0; //already initialized
     }
-    int memfd = open("/dev/mem", O_RDWR | O_SYNC);
-    if (memfd < 0) {
-        LOGE("Failed to open /dev/mem (did you remember to run as root?)\n");
-        exit(1);
-    }
+    #if EMULATE_RPI
+        int memfd = -1;
+    #else
+        int memfd = open("/dev/mem", O_RDWR | O_SYNC);
+        if (memfd < 0) {
+            LOGE("Failed to open /dev/mem (did you remember to run as root?)\n");
+            exit(1);
+        }
+    #endif
     gpioBaseMem =    mapPeripheral(memfd, GPIO_BASE);
     timerBaseMem =   mapPeripheral(memfd, TIMER_BASE);
     gpioPadBaseMem = mapPeripheral(memfd, GPIO_PADS_BASE);
@@ -116,6 +138,10 @@ void setPinHigh(PinIntType pin) {
     volatile uint32_t *gpSetAddr = (volatile uint32_t*)(gpioBaseMem + GPSET0/4 + (pin/32));
     //now write a 1 ONLY to our pin. The act of writing a 1 to the address triggers it to be set high.
     *gpSetAddr = 1 << (pin & 31);
+    #if EMULATE_RPI
+        //there's no hardware to reflect the write in the pin's level
+        *(gpioBaseMem + GPLEV0/4 + (pin/32)) |= 1 << (pin & 31);
+    #endif
 }
 void setPinLow(PinIntType pin) {
     assertValidPin(pin);
@@ -123,6 +149,9 @@ void setPinLow(PinIntType pin) {
     volatile uint32_t *gpClrAddr = (volatile uint32_t*)(gpioBaseMem + GPCLR0/4 + (pin/32));
     //now write a 1 ONLY to our pin. The act of writing a 1 to the address triggers it to be set high.
     *gpClrAddr = 1 << (pin & 31);
+    #if EMULATE_RPI
+        *(gpioBaseMem + GPLEV0/4 + (pin/32)) &= ~(1 << (pin & 31));
+    #endif
 }
 void setPinState(PinIntType pin, bool state) {
     state ? setPinHigh(pin) : setPinLow(pin);
@@ -158,7 +187,12 @@ void usleep(unsigned int us) {
 }
 
 uint64_t readSysTime() {
-    return ((uint64_t)*(timerBaseMem + TIMER_CHI/4) << 32) + (uint64_t)(*(timerBaseMem + TIMER_CLO/4));
+    #if EMULATE_RPI
+        //the system timer is a free-running 1 MHz counter. CLOCK_MONOTONIC is the closest match (and is what ThisThreadSleep measures against).
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    #else
+        return ((uint64_t)*(timerBaseMem + TIMER_CHI/4) << 32) + (uint64_t)(*(timerBaseMem + TIMER_CLO/4));
+    #endif
 }
 
 }
@@ -95,6 +95,15 @@ class PrimitiveIoPin {
         inline void pwmWrite(float duty, EventClockT::duration desiredPeriod) {
         	HardwareScheduler().queuePwm(*this, duty, desiredPeriod);
         }
+        //configure the pin to output a pulse (at level pulseLevel) of length onTime every period, timed by the DMA hardware.
+        inline void makePulseOutput(EventClockT::duration onTime, EventClockT::duration period, IoLevel pulseLevel) {
+        	mitpi::makeOutput(pinIdx);
+        	pulseWrite(onTime, period, pulseLevel);
+        }
+        //set pulse length & period. Must call makePulseOutput beforehand.
+        inline void pulseWrite(EventClockT::duration onTime, EventClockT::duration period, IoLevel pulseLevel) {
+        	HardwareScheduler().queuePulses(*this, onTime, period, pulseLevel);
+        }
 };
 
 }
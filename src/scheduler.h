@@ -27,10 +27,11 @@
 
 #include <cassert> //for assert
 #include <array>
+#include <cstddef> //for std::size_t
 #include "outputevent.h"
 #include "common/logging.h"
 #include "common/intervaltimer.h"
-#include "compileflags.h"
+#include "compileflags.h" //for CACHE_LINE_SIZE
 #include "platforms/auto/thisthreadsleep.h" //for SleepT
 #include "platforms/auto/primitiveiopin.h"
 #include "iodrivers/iopin.h"
@@ -47,14 +48,24 @@
  * Scheduler.eventLoop should be called after any program setup is completed.
  * The eventLoop function will frequently yield control *briefly* to Interface.onIdleCpu.
  * This gives the onIdleCpu function the possibility to schedule events using Scheduler.queue.
+ * Up to Interface::queueCapacity() events can be held at once, and each is passed on to Interface.queue once its time comes.
  */
 template <typename Interface> class Scheduler : public SchedulerBase {
+    static constexpr std::size_t QueueCapacity = Interface::queueCapacity();
     EventClockT::duration MAX_SLEEP; //need to call onIdleCpu handlers every so often, even if no events are ready.
     Interface interface;
-    OutputEvent nextEvent;
+    //events waiting for their time to come, ordered by time. This is a circular buffer, whose oldest event is at _eventsBegin.
+    //  It's touched on every pass through the event loop, so keep it aligned to a cache line.
+    alignas(CACHE_LINE_SIZE) std::array<OutputEvent, QueueCapacity> _events;
+    std::size_t _eventsBegin;
+    std::size_t _numEvents;
     bool _doExit;
     public:
+        //schedule an event. It is illegal to call this unless isRoomInBuffer() is true.
+        //Events needn't be queued in time order, but events with equal times are executed in the order they were queued.
         void queue(const OutputEvent &evt);
+        //schedule as many events from [begin, end) as there is room for, and return an iterator to the first event that wasn't queued.
+        template <typename It> It queue(It begin, It end);
         template <typename T> void setMaxSleep(T duration) {
             MAX_SLEEP = std::chrono::duration_cast<EventClockT::duration>(duration);
         }
@@ -62,29 +73,53 @@ template <typename Interface> class Scheduler : public SchedulerBase {
             setMaxSleep(std::chrono::milliseconds(40));
         }
         Scheduler(Interface interface);
-        void initSchedThread() const; //call this from whatever threads call nextEvent to optimize that thread's priority.
+        void initSchedThread(int priority=SCHED_PRIORITY) const; //call this from whatever threads call nextEvent to optimize that thread's priority.
         bool isRoomInBuffer() const;
+        //return true if any event that is yet to be executed is scheduled at or before the given time.
+        bool hasEventsUpTo(EventClockT::time_point time) const;
         void eventLoop();
         void exitEventLoop();
     private:
+        //access queued events by their position in the queue (0 being the earliest)
+        OutputEvent& eventAt(std::size_t idx) {
+            return _events[(_eventsBegin + idx) % QueueCapacity];
+        }
+        const OutputEvent& eventAt(std::size_t idx) const {
+            return _events[(_eventsBegin + idx) % QueueCapacity];
+        }
         void sleepUntilEvent(const OutputEvent &evt) const;
         bool isEventTime(const OutputEvent &evt) const;
 };
 
 template <typename Interface> Scheduler<Interface>::Scheduler(Interface interface) 
-    : interface(interface), _doExit(false) {
+    : interface(interface), _events(), _eventsBegin(0), _numEvents(0), _doExit(false) {
     setDefaultMaxSleep();
 }
 
 
 template <typename Interface> void Scheduler<Interface>::queue(const OutputEvent &evt) {
-    this->nextEvent = evt;
+    assert(isRoomInBuffer());
+    //insert into the queue, searching from the back. Events are nearly always queued in order, so this rarely has to move anything.
+    std::size_t idx = _numEvents;
+    while (idx > 0 && evt.time() < eventAt(idx-1).time()) {
+        eventAt(idx) = eventAt(idx-1);
+        --idx;
+    }
+    eventAt(idx) = evt;
+    ++_numEvents;
+}
+
+template <typename Interface> template <typename It> It Scheduler<Interface>::queue(It begin, It end) {
+    for (; begin != end && isRoomInBuffer(); ++begin) {
+        queue(*begin);
+    }
+    return begin;
 }
 
-template <typename Interface> void Scheduler<Interface>::initSchedThread() const {
+template <typename Interface> void Scheduler<Interface>::initSchedThread(int priority) const {
     #if USE_PTHREAD
         struct sched_param sp; 
-        sp.sched_priority=SCHED_PRIORITY; 
+        sp.sched_priority=priority; 
         if (int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp)) {
             LOGW("Warning: pthread_setschedparam (increase thread priority) at scheduler.cpp returned non-zero: %i\n", ret);
         } else {
@@ -94,7 +129,11 @@ template <typename Interface> void Scheduler<Interface>::initSchedThread() const
 }
 
 template <typename Interface> bool Scheduler<Interface>::isRoomInBuffer() const {
-    return nextEvent.isNull();
+    return _numEvents < QueueCapacity;
+}
+
+template <typename Interface> bool Scheduler<Interface>::hasEventsUpTo(EventClockT::time_point time) const {
+    return _numEvents != 0 && eventAt(0).time() <= time;
 }
 
 
@@ -102,11 +141,25 @@ template <typename Interface> void Scheduler<Interface>::eventLoop() {
     OnIdleCpuIntervalT intervalT = OnIdleCpuIntervalWide;
     int numShortIntervals = 0; //need to track the number of short cpu intervals, because if we just execute short intervals constantly for, say, 1 second, then certain services that only run at long intervals won't occur. So make every, say, 10000th short interval transform into a wide interval.
     while (!_doExit) {
-        if (!nextEvent.isNull() && isEventTime(nextEvent)) {
-            //queue the pending event and reset it
+        //pass on every event whose time has come.
+        //These are handed over as contiguous spans of the circular buffer, so that the interface can batch its writes.
+        //The interface never blocks; if it refuses some events (they're not yet within its writable window), they're retried next pass.
+        std::size_t numDue = 0;
+        while (numDue < _numEvents && isEventTime(eventAt(numDue))) {
+            ++numDue;
+        }
+        while (numDue != 0) {
             LOGV("Scheduler::queue\n");
-            interface.queue(nextEvent);
-            this->nextEvent = OutputEvent();
+            std::size_t numUntilWrap = QueueCapacity - _eventsBegin;
+            std::size_t spanLength = numDue < numUntilWrap ? numDue : numUntilWrap;
+            const OutputEvent *spanBegin = _events.data() + _eventsBegin;
+            std::size_t numQueued = interface.queue(spanBegin, spanBegin + spanLength) - spanBegin;
+            _eventsBegin = (_eventsBegin + numQueued) % QueueCapacity;
+            _numEvents -= numQueued;
+            numDue -= numQueued;
+            if (numQueued != spanLength) {
+                break;
+            }
         }
         if (!interface.onIdleCpu(intervalT)) {
             if (_doExit) {
@@ -116,7 +169,7 @@ template <typename Interface> void Scheduler<Interface>::eventLoop() {
             //if we don't need any onIdleCpu, then sleep until the event.
             //sleepUntilEvent won't always do the full sleep; it has a time limit.
             LOGV("Scheduler::sleepUntilEvent\n");
-            this->sleepUntilEvent(this->nextEvent);
+            this->sleepUntilEvent(_numEvents != 0 ? eventAt(0) : OutputEvent());
             //We just slept for a while, which translates to a wide interval. Note that it may not actually be the event time yet.
             intervalT = OnIdleCpuIntervalWide;
             //numShortIntervals = 0;
@@ -147,7 +200,7 @@ template <typename Interface> void Scheduler<Interface>::sleepUntilEvent(const O
 }
 
 template <typename Interface> bool Scheduler<Interface>::isEventTime(const OutputEvent &evt) const {
-    return interface.schedTime(evt.time()) <= EventClockT::now();
+    return evt.time() <= interface.writableUntil();
 }
 
 #endif
@@ -56,6 +56,13 @@
 #include "outputevent.h"
 #include "common/vector4.h"
 #include "common/optionalarg.h"
+#if USE_STEP_THREAD
+    #include <atomic>
+    #include <mutex>
+    #include <thread>
+    #include "common/spscring.h"
+    #include "platforms/auto/thisthreadsleep.h" //for SleepT
+#endif
 
 //g-code coordinates can either be interpreted as absolute or relative to the last coordinates received
 enum PositionMode {
@@ -101,14 +108,23 @@ template <typename Drv> class State {
                 LOGV("Time spent in state.h:onIdleCpu: %" PRId64 ", %i, ret %i\n", (int64_t)timer.clockDiff().count(), interval, stateNeedsCpu);
                 return hwNeedsCpu || stateNeedsCpu;
             }
-            inline void queue(const OutputEvent &evt) {
-                //schedule an event to happen at some time in the future (relay message to hardware scheduler)
-                _hardwareScheduler.queue(evt);
+            inline const OutputEvent* queue(const OutputEvent *begin, const OutputEvent *end) {
+                //schedule a span of events (sorted by time) to happen at some time in the future (relay message to hardware scheduler)
+                //returns a pointer to the first event that the hardware couldn't accept yet.
+                return _hardwareScheduler.queue(begin, end);
+            }
+            //expose the platform's preferred scheduler queue size to <Scheduler>
+            static constexpr std::size_t queueCapacity() {
+                return HardwareScheduler::queueCapacity();
             }
             EventClockT::time_point schedTime(EventClockT::time_point evtTime) const {
                 //if an event is to occur at evtTime, then return the soonest that we are capable of scheduling it in hardware (we may have limited buffers, etc).
                 return _hardwareScheduler.schedTime(evtTime);
             }
+            EventClockT::time_point writableUntil() const {
+                //the latest event time that the hardware scheduler can accept right now
+                return _hardwareScheduler.writableUntil();
+            }
     };
     //The MotionPlanner needs certain information about the physical machine, so we provide that without exposing all of Drv:
     class MotionInterface {
@@ -119,6 +135,14 @@ template <typename Drv> class State {
             //expose AccelerationProfileT typedef to <MotionPlanner>
             typedef State<Drv>::AccelerationProfileT AccelerationProfileT;
             MotionInterface(State<Drv> &state) : state(state) {}
+            //expose the Machine's move queue size to <MotionPlanner>
+            static constexpr std::size_t moveQueueCapacity() {
+                return Drv::moveQueueCapacity();
+            }
+            //expose the Machine's arc approximation tolerance to <MotionPlanner>
+            static constexpr float arcChordTolerance() {
+                return Drv::arcChordTolerance();
+            }
             AccelerationProfileT getAccelerationProfile() const {
                 return state.driver.getAccelerationProfile();
             }
@@ -149,6 +173,15 @@ template <typename Drv> class State {
             }
     };
     typedef Scheduler<SchedInterface> SchedType;
+    #if USE_STEP_THREAD
+        typedef std::unique_lock<std::mutex> MotionPlannerLockT;
+    #else
+        //nothing else touches the MotionPlanner, so there's no need to lock it.
+        //(the empty destructor prevents unused-variable warnings where the lock is taken)
+        struct MotionPlannerLockT {
+            ~MotionPlannerLockT() {}
+        };
+    #endif
     //The ioDrivers are a combination of the ones used by the coordmap and the miscellaneous ones from the machine
     typedef iodrv::IODrivers<decltype(std::tuple_cat(
         std::declval<Drv>().getCoordMap().getDependentIoDrivers(), 
@@ -189,6 +222,29 @@ template <typename Drv> class State {
     Drv driver;
     FileSystem filesystem;
     IODriverTypes ioDrivers;
+    #if USE_STEP_THREAD
+        //data shared with the step-generation thread.
+        struct StepThread {
+            //OutputEvents computed by the step thread, waiting to be handed to the scheduler by onIdleCpu
+            SpscRing<OutputEvent, STEP_THREAD_RING_SIZE> ring;
+            //the step thread holds this whenever it touches _motionPlanner. It only does so while _doBufferMoves is true,
+            //  so while homing (for example), the event loop has exclusive use of the _motionPlanner.
+            std::mutex motionPlannerMutex;
+            //the time of the last OutputEvent that was generated, which may still be waiting in the ring.
+            EventClockT::time_point lastMotionGeneratedTime;
+            std::atomic<bool> doStop;
+            std::thread thread;
+            StepThread() : lastMotionGeneratedTime(std::chrono::seconds(0)), doStop(false) {}
+            ~StepThread() {
+                doStop.store(true);
+                if (thread.joinable()) {
+                    thread.join();
+                }
+            }
+        };
+        //declared last, so that the thread is stopped before anything it uses is destroyed
+        StepThread _stepThread;
+    #endif
     public:
         //Initialize the state:
         //@drv Machine instance to take ownership of
@@ -198,6 +254,10 @@ template <typename Drv> class State {
         //  But if we want to continue reading from that original com channel while simultaneously reading from the new gcode file, then 'needPersistentCom' should be set to true.
         //  This is normally only relevant for communication with a host, like Octoprint, where we want temperature reading, emergency stop, etc to still work.
         State(Drv &&drv=std::move(Drv()), const FileSystem &fs=FileSystem(), bool needPersistentCom=true);
+        #if USE_STEP_THREAD
+            //the step thread captures this, so a State must stay where it was constructed.
+            State(State &&) = delete;
+        #endif
         //Continually service communication channels & execute received commands until we receive a command to exit
         void eventLoop();
         //return a read-only reference to the interal MotionPlanner object
@@ -215,6 +275,22 @@ template <typename Drv> class State {
         }
     private:
         void setMoveBuffering(bool doBufferMoves);
+        /* Take exclusive use of the MotionPlanner, if it is shared with the step-generation thread. Must not be held while running the event loop. */
+        MotionPlannerLockT lockMotionPlanner();
+        /* Get the next OutputEvent of the current motion, without consuming it (null if none is ready yet) */
+        OutputEvent peekNextMotionEvent();
+        void consumeNextMotionEvent();
+        /* True if every step of the current motion has been handed to the scheduler */
+        bool isMotionComplete();
+        /* True if there is no move in progress or queued (homing can only be performed when idle) */
+        bool isMotionIdle();
+        bool isReadyForNextMove();
+        /* Get the earliest time at which a newly-queued move may begin. Must be called with the MotionPlanner locked. */
+        EventClockT::time_point nextMoveStartTime() const;
+        #if USE_STEP_THREAD
+            /* Continually compute steps into _stepThread.ring until the State is destroyed */
+            void stepThreadLoop();
+        #endif
         /* Control interpretation of positions from the host as relative or absolute */
         PositionMode positionMode() const;
         void setPositionMode(PositionMode mode);
@@ -277,10 +353,18 @@ template <typename Drv> State<Drv>::State(Drv &&drv, const FileSystem &fs, bool
     ioDrivers(std::tuple_cat(_motionPlanner.coordMap().getDependentIoDrivers(), drv.getIoDrivers()))
     {
     this->setDestMoveRatePrimitive(this->driver.defaultMoveRate());
+    #if USE_STEP_THREAD
+        _stepThread.thread = std::thread([this]() { 
+            this->stepThreadLoop(); 
+        });
+    #endif
 }
 
 template <typename Drv> void State<Drv>::setMoveBuffering(bool doBufferMoves) {
-    _doBufferMoves = doBufferMoves;
+    {
+        auto lock = lockMotionPlanner();
+        _doBufferMoves = doBufferMoves;
+    }
     if (doBufferMoves) {
         this->scheduler.setDefaultMaxSleep();
     } else {
@@ -358,11 +442,12 @@ template <typename Drv> void State<Drv>::setHostZeroPos(float x, float y, float
 
 template <typename Drv> bool State<Drv>::onIdleCpu(OnIdleCpuIntervalT interval) {
     bool motionNeedsCpu = false;
-    if (scheduler.isRoomInBuffer()) { 
+    //hand the scheduler as many events as it has room for, taking them from the IoDrivers & the motion in order of their time.
+    while (scheduler.isRoomInBuffer()) { 
         auto ioDriverIterEvtPair = ioDrivers.peekNextEvent();
         auto ioDriverEvtIter = ioDriverIterEvtPair.first;
         OutputEvent ioDriverEvt = ioDriverIterEvtPair.second;
-        OutputEvent motionEvt = _motionPlanner.peekNextEvent();
+        OutputEvent motionEvt = peekNextMotionEvent();
 
         //LOG("Next IoDriverEvt at %lu, state: %i\n", ioDriverEvt.time().time_since_epoch().count(), ioDriverEvt.state());
         //bool doServiceMotion =   !motionEvt.isNull()   && (ioDriverEvt.isNull() || motionEvt.time() <= ioDriverEvt.time());
@@ -373,29 +458,35 @@ template <typename Drv> bool State<Drv>::onIdleCpu(OnIdleCpuIntervalT interval)
             //IoDriver event occurs first, so queue it & consume it.
             this->scheduler.queue(ioDriverEvt);
             ioDriverEvtIter.consumeNextEvent();
-        } else if (_doBufferMoves || _lastMotionPlannedTime <= EventClockT::now()) { 
+        } else if (!motionEvt.isNull() && (_doBufferMoves || _lastMotionPlannedTime <= EventClockT::now())) { 
             //if we're homing (_doBufferMoves==false), we don't want to queue the next step until the current one has actually completed.
-            //Although the IoDriver event does not occur first, that doesn't mean there is necessarily a motion event.
-            if (!motionEvt.isNull()) {
-                _motionPlanner.consumeNextEvent();
-                this->scheduler.queue(motionEvt);
-                _lastMotionPlannedTime = motionEvt.time();
-                motionNeedsCpu = scheduler.isRoomInBuffer();
-            }
+            consumeNextMotionEvent();
+            this->scheduler.queue(motionEvt);
+            _lastMotionPlannedTime = motionEvt.time();
+        } else {
+            //nothing more can be queued yet
+            break;
         }
-        if (_motionPlanner.peekNextEvent().isNull()) {
-            //LOG("State::onIdleCpu() motionEvt is null; signals end of move\n");
-            //check if we have received a command to exit after the current move is complete
-            //if that command has been received, and the current move has been completed, then exit the event loop.
-            if ((_doShutdownAfterMoveCompletes || _doExitEventLoopAfterMoveCompletes) && !motionNeedsCpu) {
-                //reset the event loop exit flag (but not the shutdown flag!)
-                _doExitEventLoopAfterMoveCompletes = false;
-                scheduler.exitEventLoop();
-                //It would be best to return now rather than tend the com channel
-                //As we don't want to risk the homing routine being interrupted.
-                return false;
-            }
+    }
+    #if !USE_STEP_THREAD
+        //use the spare time to set up the next move before the current one hands over to it (the step thread does this itself)
+        _motionPlanner.prepareNextMove();
+    #endif
+    if (isMotionComplete()) {
+        //LOG("State::onIdleCpu() motionEvt is null; signals end of move\n");
+        //check if we have received a command to exit after the current move is complete
+        //if that command has been received, and the last step of the move has left the scheduler's queue, then exit the event loop.
+        if ((_doShutdownAfterMoveCompletes || _doExitEventLoopAfterMoveCompletes) && !scheduler.hasEventsUpTo(_lastMotionPlannedTime)) {
+            //reset the event loop exit flag (but not the shutdown flag!)
+            _doExitEventLoopAfterMoveCompletes = false;
+            scheduler.exitEventLoop();
+            //It would be best to return now rather than tend the com channel
+            //As we don't want to risk the homing routine being interrupted.
+            return false;
         }
+    } else if (_doBufferMoves && scheduler.isRoomInBuffer()) {
+        //this only happens when the next step is still being computed on the step thread; poll for it rather than sleeping.
+        motionNeedsCpu = true;
     }
 
     //Only check the communications periodically because calling execute(com.getCommand()) DOES add up.
@@ -421,6 +512,111 @@ template <typename Drv> bool State<Drv>::onIdleCpu(OnIdleCpuIntervalT interval)
     return motionNeedsCpu || driversNeedCpu;
 }
 
+template <typename Drv> typename State<Drv>::MotionPlannerLockT State<Drv>::lockMotionPlanner() {
+    #if USE_STEP_THREAD
+        return MotionPlannerLockT(_stepThread.motionPlannerMutex);
+    #else
+        return MotionPlannerLockT();
+    #endif
+}
+
+template <typename Drv> OutputEvent State<Drv>::peekNextMotionEvent() {
+    #if USE_STEP_THREAD
+        if (_doBufferMoves) {
+            return _stepThread.ring.empty() ? OutputEvent() : _stepThread.ring.front();
+        }
+    #endif
+    //otherwise, steps are generated on demand (e.g. when homing, the endstops must be checked between each step)
+    auto lock = lockMotionPlanner();
+    return _motionPlanner.peekNextEvent();
+}
+
+template <typename Drv> void State<Drv>::consumeNextMotionEvent() {
+    #if USE_STEP_THREAD
+        if (_doBufferMoves) {
+            _stepThread.ring.pop();
+            return;
+        }
+    #endif
+    auto lock = lockMotionPlanner();
+    _motionPlanner.consumeNextEvent();
+}
+
+template <typename Drv> bool State<Drv>::isMotionComplete() {
+    #if USE_STEP_THREAD
+        //avoid contending for the lock in the common case
+        if (!_stepThread.ring.empty()) {
+            return false;
+        }
+    #endif
+    auto lock = lockMotionPlanner();
+    bool isPlannerDone = _motionPlanner.peekNextEvent().isNull();
+    #if USE_STEP_THREAD
+        //the step thread may have pushed the final steps between the above check & acquiring the lock
+        return isPlannerDone && _stepThread.ring.empty();
+    #else
+        return isPlannerDone;
+    #endif
+}
+
+template <typename Drv> bool State<Drv>::isMotionIdle() {
+    auto lock = lockMotionPlanner();
+    #if USE_STEP_THREAD
+        return _motionPlanner.isIdle() && _stepThread.ring.empty();
+    #else
+        return _motionPlanner.isIdle();
+    #endif
+}
+
+template <typename Drv> bool State<Drv>::isReadyForNextMove() {
+    auto lock = lockMotionPlanner();
+    return _motionPlanner.readyForNextMove();
+}
+
+template <typename Drv> EventClockT::time_point State<Drv>::nextMoveStartTime() const {
+    //start the next move at the time that the previous move is scheduled to complete, unless that time is in the past
+    #if USE_STEP_THREAD
+        //steps may have been generated that haven't yet reached the scheduler
+        return std::max(std::max(_lastMotionPlannedTime, _stepThread.lastMotionGeneratedTime), EventClockT::now());
+    #else
+        return std::max(_lastMotionPlannedTime, EventClockT::now());
+    #endif
+}
+
+#if USE_STEP_THREAD
+template <typename Drv> void State<Drv>::stepThreadLoop() {
+    //generate steps at a higher priority than the event loop, which busy-waits. Otherwise, on a single core (e.g. the original Pi),
+    //  the step thread would never be scheduled again once it slept. It sleeps whenever the ring is full, so the event loop isn't starved.
+    this->scheduler.initSchedThread(SCHED_PRIORITY+1);
+    //release the lock every so often so that the event loop can queue new moves without waiting long
+    const int maxStepsPerLock = 64;
+    while (!_stepThread.doStop.load()) {
+        bool didGenerateSteps = false;
+        {
+            auto lock = lockMotionPlanner();
+            for (int i=0; i<maxStepsPerLock && _doBufferMoves && !_stepThread.ring.full(); ++i) {
+                OutputEvent evt = _motionPlanner.peekNextEvent();
+                if (evt.isNull()) {
+                    break;
+                }
+                _motionPlanner.consumeNextEvent();
+                _stepThread.ring.push(evt);
+                _stepThread.lastMotionGeneratedTime = evt.time();
+                didGenerateSteps = true;
+            }
+            if (_doBufferMoves) {
+                //set up the next move while the ring drains, rather than when the current move ends
+                _motionPlanner.prepareNextMove();
+            }
+        }
+        if (!didGenerateSteps) {
+            //either the ring is full or there's no motion; either way, there's nothing to do for a while.
+            SleepT::sleep_for(std::chrono::microseconds(500));
+        }
+    }
+}
+#endif
+
 template <typename Drv> void State<Drv>::eventLoop() {
     this->scheduler.initSchedThread();
     this->scheduler.eventLoop();
@@ -446,7 +642,7 @@ template <typename Drv> void State<Drv>::tendComChannel(gparse::Com &com) {
 template <typename Drv> template <typename ReplyFunc> void State<Drv>::execute(gparse::Command const &cmd, ReplyFunc reply) {
     //process a gcode command received on the given communications channel and return an appropriate response
     if (cmd.isG0() || cmd.isG1()) { //rapid movement / controlled (linear) movement (currently uses same code)
-        if (!_motionPlanner.readyForNextMove()) { //don't queue another command unless we have the memory for it.
+        if (!isReadyForNextMove()) { //don't queue another command unless we have the memory for it.
             return;
         }
         if (!areHeatersReady()) { //make sure that a call to M109 doesn't allow movements until it's complete.
@@ -471,7 +667,7 @@ template <typename Drv> template <typename ReplyFunc> void State<Drv>::execute(g
         this->queueMovement(trueDest);
         reply(gparse::Response::Ok);
     } else if (cmd.isG2() || cmd.isG3()) {
-        if (!_motionPlanner.readyForNextMove()) { //don't queue another command unless we have the memory for it.
+        if (!isReadyForNextMove()) { //don't queue another command unless we have the memory for it.
             return;
         }
         if (!areHeatersReady()) { //make sure that a call to M109 doesn't allow movements until it's complete.
@@ -512,7 +708,7 @@ template <typename Drv> template <typename ReplyFunc> void State<Drv>::execute(g
         setUnitMode(UNIT_MM);
         reply(gparse::Response::Ok);
     } else if (cmd.isG28()) { //home to end-stops / zero coordinates
-        if (!_motionPlanner.readyForNextMove()) { //don't queue another command unless we have the memory for it.
+        if (!isMotionIdle()) { //wait for any queued moves to complete before homing.
             return;
         }
         if (!areHeatersReady()) { //make sure that a call to M109 doesn't allow movements until it's complete.
@@ -712,9 +908,8 @@ template <typename Drv> void State<Drv>::queueArc(const Vector4f &dest, const Ve
     float velXyz = destMoveRatePrimitive();
     float minExtRate = -this->driver.maxRetractRate();
     float maxExtRate = this->driver.maxExtrudeRate();
-    //start the next move at the time that the previous move is scheduled to complete, unless that time is in the past
-    auto startTime = std::max(_lastMotionPlannedTime, EventClockT::now());
-    _motionPlanner.arcTo(startTime, dest, center, velXyz, minExtRate, maxExtRate, isCW);
+    auto lock = lockMotionPlanner();
+    _motionPlanner.arcTo(nextMoveStartTime(), dest, center, velXyz, minExtRate, maxExtRate, isCW);
 }
         
 template <typename Drv> void State<Drv>::queueMovement(const Vector4f &dest, OptionalArg<float> velXyz, const motion::MotionFlags flags) {
@@ -723,9 +918,8 @@ template <typename Drv> void State<Drv>::queueMovement(const Vector4f &dest, Opt
     //now determine the velocity limits & relay the info to the motionPlanner
     float minExtRate = -this->driver.maxRetractRate();
     float maxExtRate = this->driver.maxExtrudeRate();
-    //start the next move at the time that the previous move is scheduled to complete, unless that time is in the past
-    auto startTime = std::max(_lastMotionPlannedTime, EventClockT::now());
-    _motionPlanner.moveTo(startTime, dest, velXyz.get(destMoveRatePrimitive()), minExtRate, maxExtRate, flags);
+    auto lock = lockMotionPlanner();
+    _motionPlanner.moveTo(nextMoveStartTime(), dest, velXyz.get(destMoveRatePrimitive()), minExtRate, maxExtRate, flags);
 }
 
 template <typename Drv> void State<Drv>::homeEndstops() {
@@ -309,6 +309,7 @@ template <typename MachineT=machines::Machine> class TestHelper {
         }        
 };
 
+//Note: the returned TestHelper is moved, which isn't possible if steps are generated on a thread (see State::State(State&&)).
 template <typename MachineT, typename ... Args> TestHelper<MachineT> makeTestHelper(MachineT &&machine, Args ...args) {
     return TestHelper<MachineT>(std::move(machine), args...);
 }